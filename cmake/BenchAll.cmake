@@ -0,0 +1,73 @@
+# Runs every demo headless in benchmark mode, one after the other, and
+# gathers their reports into one JSON file with a short table on the
+# console.
+#
+# cmake -DDEMOS=<a,b,...> -DFRAMES=<n> -DDEMO_DIR=<dir> -DSUFFIX=<.exe>
+#       -DREPORT=<file> -P BenchAll.cmake
+
+string(REPLACE "," ";" DEMOS "${DEMOS}")
+set(BENCH_DIR ${DEMO_DIR}/bench)
+file(MAKE_DIRECTORY ${BENCH_DIR})
+
+set(JSON "")
+set(FAILED "")
+set(TABLE "demo                      cpu p50   cpu p99   gpu p50\n")
+# the padding comes out of this, string(REPEAT) needs CMake 3.15
+set(BLANKS "                          ")
+foreach(DEMO ${DEMOS})
+  set(OUTPUT ${BENCH_DIR}/${DEMO}.json)
+  file(REMOVE ${OUTPUT})
+  execute_process(COMMAND ${DEMO_DIR}/${DEMO}${SUFFIX} --headless
+    --bench ${FRAMES} --bench-out ${OUTPUT}
+    WORKING_DIRECTORY ${DEMO_DIR}
+    RESULT_VARIABLE RESULT
+    OUTPUT_VARIABLE LOG
+    ERROR_VARIABLE LOG
+    TIMEOUT 600)
+  if(NOT RESULT EQUAL 0 OR NOT EXISTS ${OUTPUT})
+    message(STATUS "${DEMO} failed (${RESULT})")
+    list(APPEND FAILED "\"${DEMO}\"")
+    continue()
+  endif()
+
+  file(READ ${OUTPUT} REPORT_TEXT)
+  string(STRIP "${REPORT_TEXT}" REPORT_TEXT)
+  # indent the demo's report one level inside the combined one
+  string(REPLACE "\n" "\n    " REPORT_TEXT "${REPORT_TEXT}")
+  if(JSON)
+    set(JSON "${JSON},\n")
+  endif()
+  set(JSON "${JSON}    \"${DEMO}\": ${REPORT_TEXT}")
+
+  # name in 26 columns, then 10 per value
+  string(LENGTH "${DEMO}" LENGTH)
+  math(EXPR PADDING "26 - ${LENGTH}")
+  if(PADDING LESS 1)
+    set(PADDING 1)
+  endif()
+  string(SUBSTRING "${BLANKS}" 0 ${PADDING} SPACES)
+  set(ROW "${DEMO}${SPACES}")
+  foreach(FIELD "cpu_ms\": {[^}]*\"p50" "cpu_ms\": {[^}]*\"p99"
+      "gpu_ms\": {[^}]*\"p50")
+    if(REPORT_TEXT MATCHES "\"${FIELD}\": ([0-9.]+)")
+      set(VALUE ${CMAKE_MATCH_1})
+    else()
+      set(VALUE "-")
+    endif()
+    string(LENGTH "${VALUE}" LENGTH)
+    math(EXPR PADDING "10 - ${LENGTH}")
+    if(PADDING LESS 1)
+      set(PADDING 1)
+    endif()
+    string(SUBSTRING "${BLANKS}" 0 ${PADDING} SPACES)
+    set(ROW "${ROW}${VALUE}${SPACES}")
+  endforeach()
+  set(TABLE "${TABLE}${ROW}\n")
+endforeach()
+
+string(REPLACE ";" ", " FAILED "${FAILED}")
+file(WRITE ${REPORT}
+  "{\n  \"frames\": ${FRAMES},\n  \"failed\": [${FAILED}],\n"
+  "  \"demos\": {\n${JSON}\n  }\n}\n")
+message("${TABLE}")
+message(STATUS "benchmark reports in ${REPORT}")
@@ -0,0 +1,148 @@
+# Validates one shader stage and writes a pre-optimized copy of it.
+#
+# cmake -DSHADER=<file> -DOUTPUT_DIR=<dir> [-DGLSLANG=<glslangValidator>]
+#       [-DSPIRV_OPT=<spirv-opt>] [-DSPIRV_CROSS=<spirv-cross>]
+#       [-DSPIRV_DIS=<spirv-dis>] -P OptimizeShader.cmake
+#
+# The #include lines are expanded like Shader::preprocess does, the
+# result is validated by glslang, compiled to SPIR-V, run through the
+# SPIR-V optimizer and cross-compiled back to GLSL 330, which is written
+# to OUTPUT_DIR/<name>. OUTPUT_DIR/<name>.txt gets one line for the
+# report: the instruction count before and after optimization.
+# Validation errors fail the build; when a tool is missing or the
+# SPIR-V path cannot handle the shader, no optimized copy is written and
+# Shader keeps loading the original.
+
+get_filename_component(NAME ${SHADER} NAME)
+get_filename_component(EXT ${SHADER} EXT)
+set(OPTIMIZED ${OUTPUT_DIR}/${NAME})
+set(REPORT ${OUTPUT_DIR}/${NAME}.txt)
+set(WORK ${OUTPUT_DIR}/work/${NAME})
+file(MAKE_DIRECTORY ${OUTPUT_DIR}/work)
+file(REMOVE ${OPTIMIZED})
+
+if(EXT STREQUAL ".vs")
+  set(STAGE vert)
+elseif(EXT STREQUAL ".fs")
+  set(STAGE frag)
+elseif(EXT STREQUAL ".gs")
+  set(STAGE geom)
+else()
+  message(FATAL_ERROR "${NAME}: unknown shader stage")
+endif()
+
+# replaces every #include "file" with that file, each file once. The
+# source is never split into lines, GLSL is full of semicolons
+function(expand_includes PATH RESULT)
+  get_filename_component(DIRECTORY ${PATH} DIRECTORY)
+  file(READ ${PATH} CODE)
+  set(CODE "\n${CODE}")
+  string(REGEX MATCHALL "\n[ \t]*#include[ \t]*\"[^\"\n]+\""
+    DIRECTIVES "${CODE}")
+  foreach(DIRECTIVE IN LISTS DIRECTIVES)
+    string(REGEX REPLACE ".*\"([^\"]+)\"" "\\1" FILE "${DIRECTIVE}")
+    set(INCLUDE ${DIRECTORY}/${FILE})
+    set(INCLUDED_CODE "")
+    list(FIND INCLUDED ${INCLUDE} SEEN)
+    if(SEEN EQUAL -1)
+      list(APPEND INCLUDED ${INCLUDE})
+      expand_includes(${INCLUDE} INCLUDED_CODE)
+    endif()
+    string(REPLACE "${DIRECTIVE}" "\n${INCLUDED_CODE}" CODE "${CODE}")
+  endforeach()
+  string(SUBSTRING "${CODE}" 1 -1 CODE)
+  set(INCLUDED ${INCLUDED} PARENT_SCOPE)
+  set(${RESULT} "${CODE}" PARENT_SCOPE)
+endfunction()
+
+set(INCLUDED "")
+expand_includes(${SHADER} SOURCE)
+file(WRITE ${WORK}.glsl "${SOURCE}")
+
+# two vertex attributes sharing a location silently alias each other,
+# which GL accepts and glslang does not complain about either
+if(STAGE STREQUAL "vert")
+  string(REGEX MATCHALL
+    "layout[ \t]*\\([ \t]*location[ \t]*=[ \t]*[0-9]+[ \t]*\\)[ \t]*in[ \t]"
+    ATTRIBUTES "${SOURCE}")
+  set(LOCATIONS "")
+  foreach(ATTRIBUTE IN LISTS ATTRIBUTES)
+    string(REGEX REPLACE ".*=[ \t]*([0-9]+).*" "\\1" LOCATION "${ATTRIBUTE}")
+    list(FIND LOCATIONS ${LOCATION} SEEN)
+    if(NOT SEEN EQUAL -1)
+      message(FATAL_ERROR
+        "${SHADER}: more than one vertex attribute at location ${LOCATION}")
+    endif()
+    list(APPEND LOCATIONS ${LOCATION})
+  endforeach()
+endif()
+
+if(NOT GLSLANG)
+  file(WRITE ${REPORT} "${NAME} not optimized, glslangValidator not found\n")
+  return()
+endif()
+
+# validate with OpenGL semantics
+execute_process(COMMAND ${GLSLANG} -S ${STAGE} ${WORK}.glsl
+  RESULT_VARIABLE FAILED OUTPUT_VARIABLE LOG ERROR_VARIABLE LOG)
+if(FAILED)
+  message(FATAL_ERROR "${SHADER} does not validate:\n${LOG}")
+endif()
+
+if(NOT SPIRV_OPT OR NOT SPIRV_CROSS OR NOT SPIRV_DIS)
+  file(WRITE ${REPORT} "${NAME} validated, SPIRV-Tools or spirv-cross not found\n")
+  return()
+endif()
+
+# loose uniforms and varyings need locations in SPIR-V, let glslang
+# pick them, the names are kept so GL still finds everything by name
+execute_process(COMMAND ${GLSLANG} -G -S ${STAGE}
+  --auto-map-locations --auto-map-bindings -o ${WORK}.spv ${WORK}.glsl
+  RESULT_VARIABLE FAILED OUTPUT_VARIABLE LOG ERROR_VARIABLE LOG)
+if(NOT FAILED)
+  execute_process(COMMAND ${SPIRV_OPT} -O ${WORK}.spv -o ${WORK}.opt.spv
+    RESULT_VARIABLE FAILED OUTPUT_VARIABLE LOG ERROR_VARIABLE LOG)
+endif()
+if(NOT FAILED)
+  execute_process(COMMAND ${SPIRV_CROSS} --version 330 --no-es
+    --no-420pack-extension --output ${WORK}.opt.glsl ${WORK}.opt.spv
+    RESULT_VARIABLE FAILED OUTPUT_VARIABLE LOG ERROR_VARIABLE LOG)
+endif()
+if(FAILED)
+  message(WARNING "${NAME} not optimized:\n${LOG}")
+  file(WRITE ${REPORT} "${NAME} validated, not optimized\n")
+  return()
+endif()
+
+# instructions inside function bodies, declarations are not counted
+function(count_instructions SPV RESULT)
+  execute_process(COMMAND ${SPIRV_DIS} --no-header --raw-id ${SPV}
+    OUTPUT_VARIABLE ASSEMBLY)
+  string(REPLACE ";" "" ASSEMBLY "${ASSEMBLY}")
+  string(REGEX REPLACE "\n" ";" ASSEMBLY "${ASSEMBLY}")
+  set(COUNT 0)
+  set(INSIDE FALSE)
+  foreach(LINE IN LISTS ASSEMBLY)
+    if(LINE MATCHES "OpFunctionEnd")
+      set(INSIDE FALSE)
+    elseif(LINE MATCHES "OpFunction ")
+      set(INSIDE TRUE)
+    elseif(INSIDE AND LINE MATCHES "Op[A-Z]" AND NOT LINE MATCHES "OpLabel")
+      math(EXPR COUNT "${COUNT} + 1")
+    endif()
+  endforeach()
+  set(${RESULT} ${COUNT} PARENT_SCOPE)
+endfunction()
+
+count_instructions(${WORK}.spv BEFORE)
+count_instructions(${WORK}.opt.spv AFTER)
+
+# GLSL 330 has no uniform locations, GL assigns them at link time
+file(READ ${WORK}.opt.glsl OPTIMIZED_SOURCE)
+string(REGEX REPLACE "#extension GL_ARB_explicit_uniform_location : require\n"
+  "" OPTIMIZED_SOURCE "${OPTIMIZED_SOURCE}")
+string(REGEX REPLACE "layout\\(location = [0-9]+\\) uniform " "uniform "
+  OPTIMIZED_SOURCE "${OPTIMIZED_SOURCE}")
+file(WRITE ${OPTIMIZED} "${OPTIMIZED_SOURCE}")
+
+file(WRITE ${REPORT} "${NAME} ${BEFORE} ${AFTER}\n")
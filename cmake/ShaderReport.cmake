@@ -0,0 +1,45 @@
+# Collects the per-shader lines written by OptimizeShader.cmake into
+# one table with the instruction counts before and after optimization.
+#
+# cmake -DOUTPUT_DIR=<dir> -DREPORT=<file> -P ShaderReport.cmake
+
+file(GLOB LINES ${OUTPUT_DIR}/*.txt)
+list(SORT LINES)
+
+set(TABLE "shader                          before   after  change\n")
+# the padding comes out of this, string(REPEAT) needs CMake 3.15
+set(BLANKS "                                ")
+set(SKIPPED "")
+set(TOTAL_BEFORE 0)
+set(TOTAL_AFTER 0)
+foreach(LINE_FILE ${LINES})
+  file(READ ${LINE_FILE} LINE)
+  string(STRIP "${LINE}" LINE)
+  if(LINE MATCHES "^([^ ]+) ([0-9]+) ([0-9]+)$")
+    set(NAME ${CMAKE_MATCH_1})
+    set(BEFORE ${CMAKE_MATCH_2})
+    set(AFTER ${CMAKE_MATCH_3})
+    math(EXPR TOTAL_BEFORE "${TOTAL_BEFORE} + ${BEFORE}")
+    math(EXPR TOTAL_AFTER "${TOTAL_AFTER} + ${AFTER}")
+    set(CHANGE 0)
+    if(BEFORE GREATER 0)
+      math(EXPR CHANGE "(${AFTER} - ${BEFORE}) * 100 / ${BEFORE}")
+    endif()
+    string(LENGTH "${NAME}" LENGTH)
+    math(EXPR PADDING "32 - ${LENGTH}")
+    if(PADDING LESS 1)
+      set(PADDING 1)
+    endif()
+    string(SUBSTRING "${BLANKS}" 0 ${PADDING} SPACES)
+    set(TABLE "${TABLE}${NAME}${SPACES}${BEFORE}\t${AFTER}\t${CHANGE}%\n")
+  else()
+    set(SKIPPED "${SKIPPED}${LINE}\n")
+  endif()
+endforeach()
+set(TABLE "${TABLE}total                           ${TOTAL_BEFORE}\t${TOTAL_AFTER}\n")
+if(SKIPPED)
+  set(TABLE "${TABLE}\n${SKIPPED}")
+endif()
+
+file(WRITE ${REPORT} "${TABLE}")
+message(STATUS "shader instruction counts in ${REPORT}")
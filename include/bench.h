@@ -0,0 +1,431 @@
+/*
+ * Benchmark mode of the run loop (--bench N, see platform.h).
+ *
+ * A benchmark renders a number of warmup frames, then records N frames
+ * with everything that could make two runs differ taken out: time
+ * advances by a fixed step per frame, the camera input comes from a
+ * script instead of the mouse and keyboard, and vsync is off. For every
+ * recorded frame it keeps the CPU frame time, the GPU time (a
+ * GL_TIME_ELAPSED query read back a few frames later, so the CPU never
+ * waits on it) and what GlIntercept saw of the frame: draw calls, state
+ * changes, uniform uploads, redundant calls and uploaded bytes, and the
+ * calls the GlState cache let through or skipped. Built with
+ * TRACK_ALLOCATIONS it also keeps the frame's heap allocations, bytes
+ * and peak bytes alive, and the allocations and bytes of each
+ * heap_tracker.h tag. The run loop ends the GlIntercept, GlState and
+ * HeapTracker frames before beginFrame(). finish() writes
+ * the report as JSON, with the GPU scopes of the profiler if one is
+ * attached.
+ *
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <gl_intercept.h>
+#include <gl_state.h>
+#include <gpu_profiler.h>
+#include <heap_tracker.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+
+namespace bench_detail {
+  // value at percentile p (0-100) of sorted values, nearest rank
+  inline double percentile(const std::vector<double> &sorted, double p)
+  {
+    if (sorted.empty())
+      return 0.0;
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+  }
+
+  // {"mean": .., "min": .., "p50": .., ...} of the values in ms
+  inline std::string summary(std::vector<double> values)
+  {
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); i++)
+      sum += values[i];
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4)
+	<< "{\"mean\": " << (values.empty() ? 0.0 : sum / values.size())
+	<< ", \"min\": " << (values.empty() ? 0.0 : values.front())
+	<< ", \"p50\": " << percentile(values, 50)
+	<< ", \"p90\": " << percentile(values, 90)
+	<< ", \"p95\": " << percentile(values, 95)
+	<< ", \"p99\": " << percentile(values, 99)
+	<< ", \"max\": " << (values.empty() ? 0.0 : values.back()) << "}";
+    return out.str();
+  }
+}
+
+class Bench
+{
+ public:
+  // frames in flight before a GPU time is read back
+  static const unsigned int GPU_LATENCY = 4;
+
+  Bench(const std::string &name, unsigned int frames, unsigned int warmup,
+	double timestep)
+    : name(name), output(name + ".bench.json"), frames(frames),
+      warmup(warmup), timestep(timestep), frameIndex(0), started(false),
+      queryActive(false), peakGpuMemoryKB(0), profiler(NULL)
+  {
+    // the recorded frames add their samples without allocating
+    std::vector<double>* samples[] = {
+      &cpuTimes, &gpuTimes, &draws, &stateChanges, &uniformUploads,
+      &redundantCalls, &uploadBytes, &glCalls, &stateCacheIssued,
+      &stateCacheSkipped, &uniformCacheIssued, &uniformCacheSkipped,
+      &heapAllocations, &heapBytes, &heapPeakBytes
+    };
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+      samples[i]->reserve(frames);
+    for (int t = 0; t < HeapTracker::MAX_TAGS; t++)
+      tagAllocations[t] = tagBytes[t] = 0.0;
+  }
+
+  // the report goes to <demo>.bench.json unless told otherwise
+  void setOutput(const std::string &path)
+  {
+    output = path;
+  }
+
+  // the profiler whose scopes go into the report; it starts counting
+  // with the first recorded frame
+  void setProfiler(GpuProfiler* profiler)
+  {
+    this->profiler = profiler;
+  }
+
+  // frames rendered in total, warmup included
+  unsigned int totalFrames() const
+  {
+    return warmup + frames;
+  }
+
+  // the fixed time of a frame
+  double time(unsigned int frame) const
+  {
+    return frame * timestep;
+  }
+
+  // call with the context current, before the first frame
+  void start(int width, int height, bool headless)
+  {
+    this->width = width;
+    this->height = height;
+    this->headless = headless;
+    glGenQueries(GPU_LATENCY, queries);
+    for (unsigned int i = 0; i < GPU_LATENCY; i++)
+      queryFrame[i] = -1;
+    GlIntercept::install();
+    started = true;
+    beginFrame();
+  }
+
+  // call after the last GL command of a frame
+  void endFrame()
+  {
+    if (queryActive)
+      {
+	glEndQuery(GL_TIME_ELAPSED);
+	queryActive = false;
+      }
+  }
+
+  // call after the frame is presented, closes its CPU time and counters
+  // and starts the next one
+  void beginFrame()
+  {
+    std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+    if (frameIndex > 0)
+      closeFrame(frameIndex - 1, now);
+    frameStart = now;
+
+    if (frameIndex < totalFrames())
+      {
+	unsigned int slot = frameIndex % GPU_LATENCY;
+	readQuery(slot);
+	glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+	queryFrame[slot] = frameIndex;
+	queryActive = true;
+      }
+    frameIndex++;
+  }
+
+  // scripted keyboard, a slow walk forward and back with some strafing
+  // over an 8 second loop
+  bool keyPressed(int key, double t) const
+  {
+    double phase = std::fmod(t, 8.0);
+    switch (key)
+      {
+      case GLFW_KEY_W: return phase < 1.0;
+      case GLFW_KEY_D: return phase >= 2.0 && phase < 2.5;
+      case GLFW_KEY_S: return phase >= 4.0 && phase < 5.0;
+      case GLFW_KEY_A: return phase >= 6.0 && phase < 6.5;
+      default: return false;
+      }
+  }
+
+  // scripted cursor, the camera sweeps left and right and nods
+  void cursor(double t, int width, int height, double &x, double &y) const
+  {
+    const double pi = 3.14159265358979;
+    x = width / 2.0 + 300.0 * std::sin(2.0 * pi * t / 8.0);
+    y = height / 2.0 + 60.0 * std::sin(2.0 * pi * t / 4.0);
+  }
+
+  // adds "key": json to the report
+  void addSection(const std::string &key, const std::string &json)
+  {
+    sections.push_back(std::make_pair(key, json));
+  }
+
+  // waits for the outstanding GPU times and writes the report
+  void finish()
+  {
+    if (!started)
+      return;
+    started = false;
+    endFrame();
+    for (unsigned int i = 0; i < GPU_LATENCY; i++)
+      readQuery(i);
+    glDeleteQueries(GPU_LATENCY, queries);
+    addSection("gl", GlIntercept::json());
+    if (profiler != NULL)
+      {
+	profiler->flush();
+	addSection("gpu_scopes", profiler->json());
+	std::ostringstream stalls;
+	stalls << profiler->stalls();
+	addSection("gpu_query_stalls", stalls.str());
+      }
+
+    std::ofstream file(output.c_str());
+    file << json();
+    if (!file)
+      {
+	std::cout << "ERROR::BENCH::FILE_NOT_WRITTEN " << output << std::endl;
+	return;
+      }
+    std::vector<double> sorted(cpuTimes);
+    std::sort(sorted.begin(), sorted.end());
+    std::cout << name << ": " << cpuTimes.size() << " frames, cpu p50 "
+	      << bench_detail::percentile(sorted, 50) << " ms, p99 "
+	      << bench_detail::percentile(sorted, 99) << " ms, report in "
+	      << output << std::endl;
+  }
+
+ private:
+  std::string name;
+  std::string output;
+  unsigned int frames;
+  unsigned int warmup;
+  double timestep;
+  unsigned int frameIndex;
+  bool started;
+  bool headless;
+  int width;
+  int height;
+  std::chrono::steady_clock::time_point frameStart;
+
+  GLuint queries[GPU_LATENCY];
+  long queryFrame[GPU_LATENCY];
+  bool queryActive;
+
+  std::vector<double> cpuTimes;
+  std::vector<double> gpuTimes;
+  std::vector<double> draws;
+  std::vector<double> stateChanges;
+  std::vector<double> uniformUploads;
+  std::vector<double> redundantCalls;
+  std::vector<double> uploadBytes;
+  std::vector<double> glCalls;
+  std::vector<double> stateCacheIssued;
+  std::vector<double> stateCacheSkipped;
+  std::vector<double> uniformCacheIssued;
+  std::vector<double> uniformCacheSkipped;
+  std::vector<double> heapAllocations;
+  std::vector<double> heapBytes;
+  std::vector<double> heapPeakBytes;
+  // summed over the recorded frames
+  double tagAllocations[HeapTracker::MAX_TAGS];
+  double tagBytes[HeapTracker::MAX_TAGS];
+  long peakGpuMemoryKB;
+  std::vector<std::pair<std::string, std::string> > sections;
+  GpuProfiler* profiler;
+
+  bool recorded(unsigned int frame) const
+  {
+    return frame >= warmup && frame < totalFrames();
+  }
+
+  void closeFrame(unsigned int frame, std::chrono::steady_clock::time_point now)
+  {
+    const GlIntercept::Stats &stats = GlIntercept::lastFrame();
+    if (recorded(frame))
+      {
+	cpuTimes.push_back(std::chrono::duration<double, std::milli>
+			   (now - frameStart).count());
+	draws.push_back(stats.draws());
+	stateChanges.push_back(stats.stateChanges());
+	uniformUploads.push_back(stats.uniformUploads());
+	redundantCalls.push_back(stats.redundantCalls());
+	uploadBytes.push_back(stats.uploadBytes);
+	glCalls.push_back(stats.total());
+	stateCacheIssued.push_back(GlState::lastFrameStats().issued);
+	stateCacheSkipped.push_back(GlState::lastFrameStats().skipped);
+	uniformCacheIssued.push_back(Shader::lastFrameStats().issued);
+	uniformCacheSkipped.push_back(Shader::lastFrameStats().skipped);
+	if (HeapTracker::enabled())
+	  {
+	    const HeapTracker::Frame &heap = HeapTracker::lastFrame();
+	    heapAllocations.push_back(heap.total.allocations);
+	    heapBytes.push_back(heap.total.bytes);
+	    heapPeakBytes.push_back(heap.peak);
+	    for (int t = 0; t < HeapTracker::MAX_TAGS; t++)
+	      {
+		tagAllocations[t] += heap.tags[t].allocations;
+		tagBytes[t] += heap.tags[t].bytes;
+	      }
+	  }
+	if (GLAD_GL_NVX_gpu_memory_info)
+	  {
+	    GLint total = 0, available = 0;
+	    // GPU_MEMORY_TOTAL_AVAILABLE_MEMORY_NVX and
+	    // GPU_MEMORY_CURRENT_AVAILABLE_VIDMEM_NVX, glad has no enums for them
+	    glGetIntegerv(0x9048, &total);
+	    glGetIntegerv(0x9049, &available);
+	    peakGpuMemoryKB = std::max(peakGpuMemoryKB,
+				       (long)total - available);
+	  }
+      }
+    if (frame + 1 == warmup)
+      {
+	GlIntercept::resetTotals();
+	if (profiler != NULL)
+	  profiler->reset();
+      }
+  }
+
+  // collects the GPU time held by a query slot, waiting only when the
+  // GPU is more than GPU_LATENCY frames behind
+  void readQuery(unsigned int slot)
+  {
+    if (queryFrame[slot] < 0)
+      return;
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+    if (recorded(queryFrame[slot]))
+      gpuTimes.push_back(elapsed / 1.0e6);
+    queryFrame[slot] = -1;
+  }
+
+  static long peakResidentKB()
+  {
+#ifdef __unix__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+      return usage.ru_maxrss;
+#endif
+    return 0;
+  }
+
+  std::string json() const
+  {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4);
+    out << "{\n"
+	<< "  \"demo\": \"" << name << "\",\n"
+	<< "  \"frames\": " << cpuTimes.size() << ",\n"
+	<< "  \"warmup\": " << warmup << ",\n"
+	<< "  \"timestep\": " << timestep << ",\n"
+	<< "  \"width\": " << width << ",\n"
+	<< "  \"height\": " << height << ",\n"
+	<< "  \"headless\": " << (headless ? "true" : "false") << ",\n"
+	<< "  \"renderer\": \"" << glString(GL_RENDERER) << "\",\n"
+	<< "  \"cpu_ms\": " << bench_detail::summary(cpuTimes) << ",\n"
+	<< "  \"gpu_ms\": " << bench_detail::summary(gpuTimes) << ",\n"
+	<< "  \"draws\": " << bench_detail::summary(draws) << ",\n"
+	<< "  \"state_changes\": " << bench_detail::summary(stateChanges)
+	<< ",\n"
+	<< "  \"uniform_uploads\": " << bench_detail::summary(uniformUploads)
+	<< ",\n"
+	<< "  \"redundant_calls\": " << bench_detail::summary(redundantCalls)
+	<< ",\n"
+	<< "  \"upload_bytes\": " << bench_detail::summary(uploadBytes)
+	<< ",\n"
+	<< "  \"gl_calls\": " << bench_detail::summary(glCalls) << ",\n"
+	<< "  \"state_cache_issued\": "
+	<< bench_detail::summary(stateCacheIssued) << ",\n"
+	<< "  \"state_cache_skipped\": "
+	<< bench_detail::summary(stateCacheSkipped) << ",\n"
+	<< "  \"uniform_cache_issued\": "
+	<< bench_detail::summary(uniformCacheIssued) << ",\n"
+	<< "  \"uniform_cache_skipped\": "
+	<< bench_detail::summary(uniformCacheSkipped) << ",\n"
+	<< "  \"peak_rss_kb\": " << peakResidentKB() << ",\n"
+	<< "  \"peak_gpu_memory_kb\": " << peakGpuMemoryKB;
+    if (HeapTracker::enabled())
+      out << heapJson();
+    for (size_t i = 0; i < sections.size(); i++)
+      out << ",\n  \"" << sections[i].first << "\": " << sections[i].second;
+    out << "\n}\n";
+    return out.str();
+  }
+
+  // the heap fields, with the mean per frame of every tag
+  std::string heapJson() const
+  {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4)
+	<< ",\n  \"heap_allocations\": "
+	<< bench_detail::summary(heapAllocations)
+	<< ",\n  \"heap_bytes\": " << bench_detail::summary(heapBytes)
+	<< ",\n  \"heap_peak_bytes\": "
+	<< bench_detail::summary(heapPeakBytes)
+	<< ",\n  \"heap_tags\": {";
+    double recorded = heapAllocations.empty() ? 1.0 : heapAllocations.size();
+    for (int t = 0; t < HeapTracker::tagCount(); t++)
+      out << (t > 0 ? ", " : "") << "\"" << HeapTracker::tagName(t)
+	  << "\": {\"allocations\": " << tagAllocations[t] / recorded
+	  << ", \"bytes\": " << tagBytes[t] / recorded << "}";
+    out << "}";
+    return out.str();
+  }
+
+  // a GL string with anything that would break the JSON string removed
+  static std::string glString(GLenum name)
+  {
+    const GLubyte* value = glGetString(name);
+    std::string text = value != NULL ? (const char*)value : "";
+    text.erase(std::remove_if(text.begin(), text.end(), needsEscape),
+	       text.end());
+    return text;
+  }
+
+  static bool needsEscape(char c)
+  {
+    return c == '"' || c == '\\' || (unsigned char)c < 0x20;
+  }
+};
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Compile-time std140/std430 layouts for GPU-side structs.
+ *
+ * A block is declared as a list of GLSL-equivalent member types, e.g.
+ *   typedef GpuBlock<Std140, glm::mat4, glm::mat4> MatricesLayout;
+ * and the byte offset of every member, the block size and alignment are
+ * computed as constants. A C++ struct that mirrors the block is checked
+ * against it with GPU_LAYOUT_MEMBER/GPU_LAYOUT_SIZE, so a misaligned
+ * member fails to compile instead of silently reading garbage, and the
+ * whole struct can be uploaded with a single memcpy. checkBlockLayout()
+ * compares the same numbers against what the linked program reports.
+ *
+ */
+#ifndef BUFFER_LAYOUT_H
+#define BUFFER_LAYOUT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// layout rule tags
+struct Std140 {};
+struct Std430 {};
+
+// a GLSL array member, T name[N]
+template <typename T, std::size_t N>
+struct GpuArray {};
+
+// a nested struct member or a whole block
+template <typename Layout, typename... Members>
+struct GpuBlock;
+
+namespace gpu_layout_detail {
+  constexpr std::size_t alignUp(std::size_t value, std::size_t alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  constexpr std::size_t maxOf(std::size_t a, std::size_t b)
+  {
+    return a > b ? a : b;
+  }
+
+  // std140 rounds array and struct alignment up to a vec4
+  template <typename Layout>
+  constexpr std::size_t aggregateAlignment(std::size_t alignment)
+  {
+    return alignment;
+  }
+  template <>
+  constexpr std::size_t aggregateAlignment<Std140>(std::size_t alignment)
+  {
+    return alignUp(alignment, 16);
+  }
+
+  template <std::size_t I, typename... Types>
+  struct Nth;
+  template <typename First, typename... Rest>
+  struct Nth<0, First, Rest...> { typedef First type; };
+  template <std::size_t I, typename First, typename... Rest>
+  struct Nth<I, First, Rest...> { typedef typename Nth<I - 1, Rest...>::type type; };
+}
+
+// base alignment and size of a member type under a layout
+template <typename Layout, typename T>
+struct GpuType;
+
+template <typename Layout>
+struct GpuType<Layout, float>
+{
+  static constexpr std::size_t alignment = 4;
+  static constexpr std::size_t size = 4;
+};
+template <typename Layout>
+struct GpuType<Layout, int> : GpuType<Layout, float> {};
+template <typename Layout>
+struct GpuType<Layout, unsigned int> : GpuType<Layout, float> {};
+template <typename Layout>
+struct GpuType<Layout, glm::vec2>
+{
+  static constexpr std::size_t alignment = 8;
+  static constexpr std::size_t size = 8;
+};
+// a vec3 is aligned like a vec4 but a scalar may follow in its last 4 bytes
+template <typename Layout>
+struct GpuType<Layout, glm::vec3>
+{
+  static constexpr std::size_t alignment = 16;
+  static constexpr std::size_t size = 12;
+};
+template <typename Layout>
+struct GpuType<Layout, glm::vec4>
+{
+  static constexpr std::size_t alignment = 16;
+  static constexpr std::size_t size = 16;
+};
+// matrices are arrays of column vectors, each column padded to a vec4
+template <typename Layout>
+struct GpuType<Layout, glm::mat3>
+{
+  static constexpr std::size_t alignment = 16;
+  static constexpr std::size_t size = 3 * 16;
+};
+template <typename Layout>
+struct GpuType<Layout, glm::mat4>
+{
+  static constexpr std::size_t alignment = 16;
+  static constexpr std::size_t size = 4 * 16;
+};
+
+template <typename Layout, typename T, std::size_t N>
+struct GpuType<Layout, GpuArray<T, N> >
+{
+  static constexpr std::size_t alignment =
+    gpu_layout_detail::aggregateAlignment<Layout>(GpuType<Layout, T>::alignment);
+  // distance between two elements
+  static constexpr std::size_t stride =
+    gpu_layout_detail::alignUp(GpuType<Layout, T>::size, alignment);
+  static constexpr std::size_t size = N * stride;
+};
+
+template <typename Layout, typename... Members>
+struct GpuType<Layout, GpuBlock<Layout, Members...> >
+{
+  static constexpr std::size_t alignment =
+    GpuBlock<Layout, Members...>::alignment();
+  static constexpr std::size_t size = GpuBlock<Layout, Members...>::size();
+};
+
+template <typename Layout, typename... Members>
+struct GpuBlock
+{
+  static constexpr std::size_t count = sizeof...(Members);
+
+  // type of member I
+  template <std::size_t I>
+  struct Member
+  {
+    typedef typename gpu_layout_detail::Nth<I, Members...>::type type;
+  };
+
+  // byte offset of member I from the start of the block
+  template <std::size_t I>
+  static constexpr std::size_t offset()
+  {
+    return Offset<I, I == 0>::value;
+  }
+
+  // byte offset just past member I
+  template <std::size_t I>
+  static constexpr std::size_t end()
+  {
+    return offset<I>() + GpuType<Layout, typename Member<I>::type>::size;
+  }
+
+  static constexpr std::size_t alignment()
+  {
+    return gpu_layout_detail::aggregateAlignment<Layout>(MaxAlignment<0>::value);
+  }
+
+  // size of the block including the padding at the end
+  static constexpr std::size_t size()
+  {
+    return gpu_layout_detail::alignUp(end<count - 1>(), alignment());
+  }
+
+ private:
+  template <std::size_t I, bool First>
+  struct Offset
+  {
+    static constexpr std::size_t value = 0;
+  };
+  template <std::size_t I>
+  struct Offset<I, false>
+  {
+    static constexpr std::size_t value =
+      gpu_layout_detail::alignUp(end<I - 1>(),
+        GpuType<Layout, typename Member<I>::type>::alignment);
+  };
+
+  template <std::size_t I, bool Last = (I + 1 == count)>
+  struct MaxAlignment
+  {
+    static constexpr std::size_t value = gpu_layout_detail::maxOf(
+      GpuType<Layout, typename Member<I>::type>::alignment,
+      MaxAlignment<I + 1>::value);
+  };
+  template <std::size_t I>
+  struct MaxAlignment<I, true>
+  {
+    static constexpr std::size_t value =
+      GpuType<Layout, typename Member<I>::type>::alignment;
+  };
+};
+
+// fails to compile when a member of the C++ mirror struct is not at the
+// offset the GPU reads it from
+#define GPU_LAYOUT_MEMBER(Struct, member, Block, index)			\
+  static_assert(offsetof(Struct, member) == Block::offset<index>(),	\
+		#Struct "::" #member " does not match the GPU layout")
+
+// fails to compile when the C++ mirror struct has a different size
+#define GPU_LAYOUT_SIZE(Struct, Block)					\
+  static_assert(sizeof(Struct) == Block::size(),			\
+		#Struct " does not match the GPU block size")
+
+namespace gpu_layout_detail {
+  template <typename Block, std::size_t I, bool Done = (I == Block::count)>
+  struct Offsets
+  {
+    static void collect(std::vector<std::size_t> &offsets)
+    {
+      offsets.push_back(Block::template offset<I>());
+      Offsets<Block, I + 1>::collect(offsets);
+    }
+  };
+  template <typename Block, std::size_t I>
+  struct Offsets<Block, I, true>
+  {
+    static void collect(std::vector<std::size_t> &) {}
+  };
+}
+
+// compares a block layout with the one the linker reflected for a
+// uniform block of the program; names lists the uniform name of every
+// member in order. Returns false (and prints the mismatch) on error
+template <typename Block>
+bool checkBlockLayout(GLuint program, const char* blockName,
+		      const std::vector<std::string> &names)
+{
+  GLuint blockIndex = glGetUniformBlockIndex(program, blockName);
+  if (blockIndex == GL_INVALID_INDEX)
+    {
+      std::cout << "ERROR::LAYOUT::NO_SUCH_BLOCK " << blockName << std::endl;
+      return false;
+    }
+  bool ok = true;
+  GLint dataSize = 0;
+  glGetActiveUniformBlockiv(program, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE,
+			    &dataSize);
+  if ((std::size_t)dataSize != Block::size())
+    {
+      std::cout << "ERROR::LAYOUT::SIZE " << blockName << " is " << dataSize
+		<< " bytes, expected " << Block::size() << std::endl;
+      ok = false;
+    }
+
+  std::vector<std::size_t> offsets;
+  gpu_layout_detail::Offsets<Block, 0>::collect(offsets);
+  for (unsigned int i = 0; i < names.size() && i < offsets.size(); i++)
+    {
+      const char* name = names[i].c_str();
+      GLuint index = GL_INVALID_INDEX;
+      glGetUniformIndices(program, 1, &name, &index);
+      // members the linker removed cannot be checked
+      if (index == GL_INVALID_INDEX)
+	continue;
+      GLint offset = 0;
+      glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+      if ((std::size_t)offset != offsets[i])
+	{
+	  std::cout << "ERROR::LAYOUT::OFFSET " << blockName << "." << name
+		    << " is at " << offset << ", expected " << offsets[i]
+		    << std::endl;
+	  ok = false;
+	}
+    }
+  return ok;
+}
+
+#endif
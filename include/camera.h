@@ -123,6 +123,16 @@ class Camera
     updateCameraVectors();
   }
 
+  // places the camera directly, for a recorded path (camera_recorder.h)
+  void SetPose(glm::vec3 position, float yaw, float pitch, float zoom)
+  {
+    Position = position;
+    Yaw = yaw;
+    Pitch = pitch;
+    Zoom = zoom;
+    updateCameraVectors();
+  }
+
   // Processes input received from a mouse scroll-wheel event.
   // Only requires input on the vertical wheel-axis
   void ProcessMouseScroll(float yoffset)
@@ -0,0 +1,282 @@
+/*
+ * Records the path of a Camera to a file and plays it back, so two runs
+ * (two builds, two machines) look at the scene along the same views.
+ *
+ *   CameraRecorder cameraRecorder(platform, camera);
+ *   while (platform.running())
+ *     {
+ *       processInput(platform);
+ *       cameraRecorder.update();
+ *       ...
+ *
+ * With --record-camera FILE update() samples the pose the input left the
+ * camera in (position, yaw, pitch and zoom) at platform.time(), and the
+ * samples are written when the recorder goes out of scope. With
+ * --replay-camera FILE the platform ignores the mouse and keyboard
+ * (escape aside) and update() sets the pose the path had at
+ * platform.time(), interpolated between the two nearest samples. Replay
+ * follows time rather than frames, so it takes the same path at any
+ * frame rate; with --bench the timestep is fixed too and every frame is
+ * the same from run to run. Without --frames or --bench the run ends
+ * with the path.
+ *
+ * update() also tells an --on-demand loop (platform.h) to keep drawing
+ * while the camera moves.
+ *
+ * The file is a header (the magic "CAMP", a version and the number of
+ * samples, as 32 bit little endian words) followed by the samples, 7
+ * floats each: time, position x, y, z, yaw, pitch, zoom. A sample is
+ * written only when the pose changed, plus one to close each still
+ * period, so a path takes 28 bytes per moving frame.
+ *
+ */
+#ifndef CAMERA_RECORDER_H
+#define CAMERA_RECORDER_H
+
+#include <glm/glm.hpp>
+
+#include <camera.h>
+#include <platform.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class CameraRecorder
+{
+ public:
+  static const uint32_t VERSION = 1;
+
+  // a pose of the camera at a time in seconds
+  struct Sample
+  {
+    float time;
+    float position[3];
+    float yaw;
+    float pitch;
+    float zoom;
+  };
+
+  CameraRecorder(Platform &platform, Camera &camera)
+    : platform(platform), camera(camera), recording(false),
+      replaying(false), held(false)
+  {
+    seen = pose(0.0f);
+    if (!platform.cameraReplay().empty())
+      {
+	replaying = load(platform.cameraReplay(), samples);
+	if (replaying)
+	  update();
+      }
+    else if (!platform.cameraRecording().empty())
+      recording = true;
+  }
+
+  ~CameraRecorder()
+  {
+    if (recording)
+      {
+	// the pose the path stood still in to the end
+	if (held)
+	  samples.push_back(last);
+	if (save(platform.cameraRecording(), samples))
+	  std::cout << "camera path of " << samples.size()
+		    << " samples written to " << platform.cameraRecording()
+		    << std::endl;
+      }
+  }
+
+  // call once per frame, after the input moved the camera
+  void update()
+  {
+    float t = (float)platform.time();
+    if (replaying)
+      {
+	Sample pose = sample(samples, t);
+	camera.SetPose(glm::vec3(pose.position[0], pose.position[1],
+				 pose.position[2]), pose.yaw, pose.pitch,
+		       pose.zoom);
+	if (t > samples.back().time && platform.frameLimit() == 0)
+	  platform.close();
+      }
+    else if (recording)
+      record(t);
+
+    Sample now = pose(t);
+    if (!samePose(now, seen))
+      platform.requestRedraw();
+    seen = now;
+  }
+
+  // the pose of the path at time t
+  static Sample sample(const std::vector<Sample> &samples, float t)
+  {
+    std::vector<Sample>::const_iterator next =
+      std::upper_bound(samples.begin(), samples.end(), t, before);
+    if (next == samples.begin())
+      return samples.front();
+    if (next == samples.end())
+      return samples.back();
+    const Sample &a = *(next - 1);
+    const Sample &b = *next;
+    float k = (t - a.time) / (b.time - a.time);
+    Sample pose;
+    pose.time = t;
+    for (int i = 0; i < 3; i++)
+      pose.position[i] = a.position[i] + k * (b.position[i] - a.position[i]);
+    pose.yaw = a.yaw + k * (b.yaw - a.yaw);
+    pose.pitch = a.pitch + k * (b.pitch - a.pitch);
+    pose.zoom = a.zoom + k * (b.zoom - a.zoom);
+    return pose;
+  }
+
+  static bool load(const std::string &path, std::vector<Sample> &samples)
+  {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    char magic[4];
+    uint32_t version = 0, count = 0;
+    file.read(magic, 4);
+    readWord(file, version);
+    readWord(file, count);
+    if (!file || memcmp(magic, "CAMP", 4) != 0 || version != VERSION ||
+	count == 0)
+      {
+	std::cout << "ERROR::CAMERA_RECORDER::FILE_NOT_READ " << path
+		  << std::endl;
+	return false;
+      }
+    samples.resize(count);
+    for (uint32_t i = 0; i < count && file; i++)
+      {
+	Sample &sample = samples[i];
+	readFloat(file, sample.time);
+	for (int c = 0; c < 3; c++)
+	  readFloat(file, sample.position[c]);
+	readFloat(file, sample.yaw);
+	readFloat(file, sample.pitch);
+	readFloat(file, sample.zoom);
+      }
+    if (!file)
+      {
+	std::cout << "ERROR::CAMERA_RECORDER::FILE_TRUNCATED " << path
+		  << std::endl;
+	return false;
+      }
+    return true;
+  }
+
+  static bool save(const std::string &path, const std::vector<Sample> &samples)
+  {
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file.write("CAMP", 4);
+    writeWord(file, VERSION);
+    writeWord(file, samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
+      {
+	const Sample &sample = samples[i];
+	writeFloat(file, sample.time);
+	for (int c = 0; c < 3; c++)
+	  writeFloat(file, sample.position[c]);
+	writeFloat(file, sample.yaw);
+	writeFloat(file, sample.pitch);
+	writeFloat(file, sample.zoom);
+      }
+    if (!file)
+      std::cout << "ERROR::CAMERA_RECORDER::FILE_NOT_WRITTEN " << path
+		<< std::endl;
+    return file.good();
+  }
+
+ private:
+  Platform &platform;
+  Camera &camera;
+  bool recording;
+  bool replaying;
+  std::vector<Sample> samples;
+  // the last pose seen, and whether it was left out of samples
+  Sample last;
+  bool held;
+
+  // the pose the camera shows at the last update()
+  Sample seen;
+
+  // the camera's pose now
+  Sample pose(float t) const
+  {
+    Sample pose;
+    pose.time = t;
+    pose.position[0] = camera.Position.x;
+    pose.position[1] = camera.Position.y;
+    pose.position[2] = camera.Position.z;
+    pose.yaw = camera.Yaw;
+    pose.pitch = camera.Pitch;
+    pose.zoom = camera.Zoom;
+    return pose;
+  }
+
+  void record(float t)
+  {
+    Sample pose = this->pose(t);
+    if (!samples.empty() && samePose(pose, last))
+      held = true;
+    else
+      {
+	// without the end of the still period the replay would drift
+	// from the old pose to the new one over all of it
+	if (held)
+	  samples.push_back(last);
+	samples.push_back(pose);
+	held = false;
+      }
+    last = pose;
+  }
+
+  static bool samePose(const Sample &a, const Sample &b)
+  {
+    return memcmp(a.position, b.position, sizeof(a.position)) == 0 &&
+      a.yaw == b.yaw && a.pitch == b.pitch && a.zoom == b.zoom;
+  }
+
+  static bool before(float t, const Sample &sample)
+  {
+    return t < sample.time;
+  }
+
+  // the file is little endian whatever the machine
+  static void writeWord(std::ostream &out, uint32_t word)
+  {
+    unsigned char bytes[4] = { (unsigned char)word,
+			       (unsigned char)(word >> 8),
+			       (unsigned char)(word >> 16),
+			       (unsigned char)(word >> 24) };
+    out.write((const char*)bytes, 4);
+  }
+
+  static void readWord(std::istream &in, uint32_t &word)
+  {
+    unsigned char bytes[4] = { 0, 0, 0, 0 };
+    in.read((char*)bytes, 4);
+    word = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+      ((uint32_t)bytes[3] << 24);
+  }
+
+  static void writeFloat(std::ostream &out, float value)
+  {
+    uint32_t word;
+    memcpy(&word, &value, 4);
+    writeWord(out, word);
+  }
+
+  static void readFloat(std::istream &in, float &value)
+  {
+    uint32_t word;
+    readWord(in, word);
+    memcpy(&value, &word, 4);
+  }
+};
+
+#endif
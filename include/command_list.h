@@ -0,0 +1,273 @@
+/*
+ * Draw commands recorded on the CPU, by any thread, and replayed later
+ * on the thread that owns the GL context. Only replay() calls GL, so the
+ * work of building a frame (walking the scene, computing matrices,
+ * choosing state) can run on several cores at once.
+ *
+ *   GLint modelLocation = shader.uniformLocation("model");
+ *   CommandRecorder recorder(platform.threads());
+ *   ...
+ *   recorder.record(cubes.size(), [&](CommandList &list, size_t begin,
+ *                                     size_t end)
+ *     {
+ *       list.useProgram(shader.ID);
+ *       list.bindVertexArray(cubeVAO);
+ *       for (size_t i = begin; i < end; i++)
+ *         {
+ *           list.uniformMat4(modelLocation, cubes[i].model());
+ *           list.drawArrays(GL_TRIANGLES, 0, 36);
+ *         }
+ *     });
+ *   recorder.replay();
+ *
+ * record() splits the items into one slice per thread, records slice i
+ * into list i (the calling thread takes the first) and returns when all
+ * are done. replay() then runs the lists in slice order, so the result
+ * is the same as recording everything in one list.
+ *
+ * Uniforms are given by location: looking one up is a GL call, so do it
+ * before recording. A command is five words, with matrix and vector
+ * values kept in a separate array, and a list drops a bind of what it
+ * bound last itself, so replay is one switch per command. Binds go
+ * through GlState, which catches what the previous list left bound.
+ * The lists keep their memory from frame to frame.
+ *
+ */
+#ifndef COMMAND_LIST_H
+#define COMMAND_LIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cpu_profiler.h>
+#include <gl_state.h>
+#include <worker_pool.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+class CommandList
+{
+ public:
+  CommandList()
+  {
+    clear();
+  }
+
+  // empties the list, keeping its memory
+  void clear()
+  {
+    commands.clear();
+    values.clear();
+    program = vertexArray = -1;
+    for (int u = 0; u < UNITS; u++)
+      textures[u] = -1;
+  }
+
+  void useProgram(GLuint program)
+  {
+    if (this->program == (long)program)
+      return;
+    this->program = program;
+    add(USE_PROGRAM, program);
+  }
+
+  void bindVertexArray(GLuint array)
+  {
+    if (vertexArray == (long)array)
+      return;
+    vertexArray = array;
+    add(BIND_VERTEX_ARRAY, array);
+  }
+
+  // unit is a number, 0 for GL_TEXTURE0
+  void bindTexture(GLuint unit, GLenum target, GLuint texture)
+  {
+    if (unit < (GLuint)UNITS)
+      {
+	if (textures[unit] == (long)texture)
+	  return;
+	textures[unit] = texture;
+      }
+    add(BIND_TEXTURE, unit, target, texture);
+  }
+
+  // a range of a uniform buffer for a uniform block binding point
+  void bindUniformBlock(GLuint binding, GLuint buffer, GLintptr offset,
+			GLsizeiptr size)
+  {
+    add(BIND_UNIFORM_BLOCK, binding, buffer, (uint32_t)offset,
+	(uint32_t)size);
+  }
+
+  void uniformVec4(GLint location, const glm::vec4 &value)
+  {
+    add(UNIFORM_VEC4, location, values.size());
+    values.insert(values.end(), &value[0], &value[0] + 4);
+  }
+
+  void uniformMat4(GLint location, const glm::mat4 &value)
+  {
+    add(UNIFORM_MAT4, location, values.size());
+    values.insert(values.end(), &value[0][0], &value[0][0] + 16);
+  }
+
+  void drawArrays(GLenum mode, GLint first, GLsizei count)
+  {
+    add(DRAW_ARRAYS, mode, first, count);
+  }
+
+  // offset is in bytes into the bound element buffer
+  void drawElements(GLenum mode, GLsizei count, GLenum type, size_t offset)
+  {
+    add(DRAW_ELEMENTS, mode, count, type, (uint32_t)offset);
+  }
+
+  // number of commands recorded
+  size_t size() const
+  {
+    return commands.size();
+  }
+
+  // runs the commands, on the thread that owns the GL context
+  void replay() const
+  {
+    const float* data = values.empty() ? NULL : &values[0];
+    for (size_t i = 0; i < commands.size(); i++)
+      {
+	const Command &c = commands[i];
+	switch (c.op)
+	  {
+	  case USE_PROGRAM:
+	    GlState::useProgram(c.a);
+	    break;
+	  case BIND_VERTEX_ARRAY:
+	    GlState::bindVertexArray(c.a);
+	    break;
+	  case BIND_TEXTURE:
+	    GlState::bindTexture(c.a, c.b, c.c);
+	    break;
+	  case BIND_UNIFORM_BLOCK:
+	    glBindBufferRange(GL_UNIFORM_BUFFER, c.a, c.b, c.c, c.d);
+	    break;
+	  case UNIFORM_VEC4:
+	    glUniform4fv((GLint)c.a, 1, data + c.b);
+	    break;
+	  case UNIFORM_MAT4:
+	    glUniformMatrix4fv((GLint)c.a, 1, GL_FALSE, data + c.b);
+	    break;
+	  case DRAW_ARRAYS:
+	    glDrawArrays(c.a, (GLint)c.b, (GLsizei)c.c);
+	    break;
+	  case DRAW_ELEMENTS:
+	    glDrawElements(c.a, (GLsizei)c.b, c.c, (const void*)(size_t)c.d);
+	    break;
+	  }
+      }
+  }
+
+ private:
+  static const int UNITS = 16;
+
+  enum Op {
+    USE_PROGRAM, BIND_VERTEX_ARRAY, BIND_TEXTURE, BIND_UNIFORM_BLOCK,
+    UNIFORM_VEC4, UNIFORM_MAT4, DRAW_ARRAYS, DRAW_ELEMENTS
+  };
+
+  struct Command
+  {
+    uint32_t op;
+    uint32_t a, b, c, d;
+  };
+
+  std::vector<Command> commands;
+  std::vector<float> values;
+  // what the list bound last, -1 when nothing yet
+  long program;
+  long vertexArray;
+  long textures[UNITS];
+
+  void add(Op op, uint32_t a, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0)
+  {
+    Command command = { (uint32_t)op, a, b, c, d };
+    commands.push_back(command);
+  }
+};
+
+// records one CommandList per thread of a WorkerPool
+class CommandRecorder
+{
+ public:
+  explicit CommandRecorder(unsigned int threads)
+    : pool(threads), lists(pool.threads()), frames(0), recordSeconds(0.0),
+      replaySeconds(0.0), commands(0)
+  {
+  }
+
+  ~CommandRecorder()
+  {
+    if (frames > 0)
+      std::cout << "command lists on " << lists.size() << " threads: "
+		<< commands / frames << " commands, recorded in "
+		<< recordSeconds * 1000.0 / frames << " ms and replayed in "
+		<< replaySeconds * 1000.0 / frames << " ms per frame"
+		<< std::endl;
+  }
+
+  unsigned int threads() const
+  {
+    return lists.size();
+  }
+
+  // records count items across the threads and waits for them. job is
+  // called as job(list, begin, end) to record the items [begin, end)
+  template <class Job>
+  void record(size_t count, const Job &job)
+  {
+    PROFILE_ZONE("CommandRecorder::record");
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+    // slice i goes to list i
+    pool.run([this, count, &job](unsigned int index)
+	     {
+	       CommandList &list = lists[index];
+	       list.clear();
+	       size_t slices = lists.size();
+	       size_t first = count * index / slices;
+	       size_t last = count * (index + 1) / slices;
+	       if (first < last)
+		 job(list, first, last);
+	     });
+    recordSeconds += std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - begin).count();
+  }
+
+  // replays the lists in order, on the thread that owns the GL context
+  void replay()
+  {
+    PROFILE_ZONE("CommandRecorder::replay");
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lists.size(); i++)
+      {
+	lists[i].replay();
+	commands += lists[i].size();
+      }
+    replaySeconds += std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - begin).count();
+    frames++;
+  }
+
+ private:
+  WorkerPool pool;
+  std::vector<CommandList> lists;
+
+  unsigned long frames;
+  double recordSeconds;
+  double replaySeconds;
+  unsigned long commands;
+};
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ * CPU time in named zones, exported as a Chrome trace (chrome://tracing,
+ * Perfetto, speedscope).
+ *
+ *   PROFILE_ZONE("Model::processMesh");   // to the end of the block
+ *
+ *   PROFILE_BEGIN("stbi_load");           // or around a statement
+ *   data = stbi_load(...);
+ *   PROFILE_END();
+ *
+ *   PROFILE_COUNTER("heap bytes", bytes);  // a value over time
+ *
+ * A zone costs two steady_clock reads and a store into a ring buffer
+ * owned by the calling thread, so zones need no locking and can sit in
+ * per-frame paths. When a buffer is full the oldest zones are
+ * overwritten. writeTrace() (--trace FILE, see platform.h) collects the
+ * buffers of every thread that recorded a zone, with the counters as
+ * counter tracks.
+ *
+ * Everything here is compiled only with MODERNOPENGL_PROFILE defined
+ * (cmake -DPROFILE_CPU=ON); without it the macros expand to nothing.
+ *
+ */
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#ifdef MODERNOPENGL_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cpu_profiler_detail {
+  // a closed zone, times in ns since the profiler started
+  struct Zone
+  {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  // a counter sample, the trace draws the values of a name as a graph
+  struct Counter
+  {
+    const char* name;
+    uint64_t time;
+    double value;
+  };
+
+  struct ThreadBuffer
+  {
+    // zones kept per thread
+    static const size_t CAPACITY = 1 << 16;
+    // deepest nesting of PROFILE_BEGIN
+    static const int MAX_DEPTH = 64;
+    // counter samples kept per thread
+    static const size_t COUNTERS = 1 << 14;
+
+    unsigned int id;
+    std::vector<Zone> zones;
+    // zones written so far, the next one goes to written % CAPACITY
+    uint64_t written;
+    Zone open[MAX_DEPTH];
+    int depth;
+    std::vector<Counter> counters;
+    uint64_t countersWritten;
+  };
+
+  struct Registry
+  {
+    std::mutex mutex;
+    std::vector<ThreadBuffer*> buffers;
+    std::chrono::steady_clock::time_point epoch;
+
+    Registry() : epoch(std::chrono::steady_clock::now())
+    {
+    }
+  };
+
+  inline Registry& registry()
+  {
+    static Registry instance;
+    return instance;
+  }
+
+  inline uint64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now() - registry().epoch).count();
+  }
+
+  // the calling thread's buffer, registered on first use. Buffers are
+  // never freed so a trace still has the zones of finished threads
+  inline ThreadBuffer& threadBuffer()
+  {
+    static thread_local ThreadBuffer* buffer = NULL;
+    if (buffer == NULL)
+      {
+	buffer = new ThreadBuffer();
+	buffer->zones.resize(ThreadBuffer::CAPACITY);
+	buffer->written = 0;
+	buffer->depth = 0;
+	buffer->counters.resize(ThreadBuffer::COUNTERS);
+	buffer->countersWritten = 0;
+	Registry &instance = registry();
+	std::lock_guard<std::mutex> lock(instance.mutex);
+	buffer->id = instance.buffers.size() + 1;
+	instance.buffers.push_back(buffer);
+      }
+    return *buffer;
+  }
+
+  inline void record(ThreadBuffer &buffer, const Zone &zone)
+  {
+    buffer.zones[buffer.written % ThreadBuffer::CAPACITY] = zone;
+    buffer.written++;
+  }
+}
+
+class CpuProfiler
+{
+ public:
+  // opens a zone on the calling thread
+  static void begin(const char* name)
+  {
+    using namespace cpu_profiler_detail;
+    ThreadBuffer &buffer = threadBuffer();
+    if (buffer.depth < ThreadBuffer::MAX_DEPTH)
+      {
+	Zone &zone = buffer.open[buffer.depth];
+	zone.name = name;
+	zone.start = now();
+      }
+    buffer.depth++;
+  }
+
+  // closes the innermost zone of the calling thread
+  static void end()
+  {
+    using namespace cpu_profiler_detail;
+    ThreadBuffer &buffer = threadBuffer();
+    if (buffer.depth == 0)
+      return;
+    buffer.depth--;
+    if (buffer.depth < ThreadBuffer::MAX_DEPTH)
+      {
+	Zone zone = buffer.open[buffer.depth];
+	zone.end = now();
+	record(buffer, zone);
+      }
+  }
+
+  // records a sample of a counter on the calling thread
+  static void counter(const char* name, double value)
+  {
+    using namespace cpu_profiler_detail;
+    ThreadBuffer &buffer = threadBuffer();
+    Counter &sample =
+      buffer.counters[buffer.countersWritten % ThreadBuffer::COUNTERS];
+    sample.name = name;
+    sample.time = now();
+    sample.value = value;
+    buffer.countersWritten++;
+  }
+
+  // writes every recorded zone as Chrome trace events. Call it once the
+  // other threads stopped recording
+  static bool writeTrace(const std::string &path)
+  {
+    using namespace cpu_profiler_detail;
+    std::ofstream file(path.c_str());
+    file << std::fixed << std::setprecision(3)
+	 << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    Registry &instance = registry();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    for (size_t b = 0; b < instance.buffers.size(); b++)
+      {
+	const ThreadBuffer &buffer = *instance.buffers[b];
+	file << (first ? "\n" : ",\n")
+	     << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+	     << "\"tid\": " << buffer.id << ", \"args\": {\"name\": \""
+	     << (buffer.id == 1 ? "main" : "worker") << "\"}}";
+	first = false;
+
+	// copied first, std::min would bind the member by reference and
+	// need a definition of it
+	uint64_t capacity = ThreadBuffer::CAPACITY;
+	uint64_t count = std::min(buffer.written, capacity);
+	for (uint64_t i = buffer.written - count; i < buffer.written; i++)
+	  {
+	    const Zone &zone = buffer.zones[i % ThreadBuffer::CAPACITY];
+	    file << ",\n{\"name\": \"" << zone.name
+		 << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer.id
+		 << ", \"ts\": " << zone.start / 1000.0
+		 << ", \"dur\": " << (zone.end - zone.start) / 1000.0 << "}";
+	  }
+
+	capacity = ThreadBuffer::COUNTERS;
+	count = std::min(buffer.countersWritten, capacity);
+	for (uint64_t i = buffer.countersWritten - count;
+	     i < buffer.countersWritten; i++)
+	  {
+	    const Counter &sample = buffer.counters[i % ThreadBuffer::COUNTERS];
+	    file << ",\n{\"name\": \"" << sample.name
+		 << "\", \"ph\": \"C\", \"pid\": 1, \"tid\": " << buffer.id
+		 << ", \"ts\": " << sample.time / 1000.0
+		 << ", \"args\": {\"value\": " << sample.value << "}}";
+	  }
+      }
+    file << "\n]}\n";
+    return file.good();
+  }
+};
+
+// a zone from here to the end of the enclosing block
+class CpuZone
+{
+ public:
+  CpuZone(const char* name)
+  {
+    CpuProfiler::begin(name);
+  }
+
+  ~CpuZone()
+  {
+    CpuProfiler::end();
+  }
+};
+
+#define PROFILE_ZONE_CONCAT2(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) \
+  CpuZone PROFILE_ZONE_CONCAT(cpuZone, __LINE__)(name)
+#define PROFILE_BEGIN(name) CpuProfiler::begin(name)
+#define PROFILE_END() CpuProfiler::end()
+#define PROFILE_COUNTER(name, value) CpuProfiler::counter(name, value)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_BEGIN(name) ((void)0)
+#define PROFILE_END() ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * A hierarchical depth buffer for occlusion culling: a scene target
+ * whose depth is reduced, level by level, to a mip chain where every
+ * texel holds the farthest depth of the pixels it covers.
+ *
+ *   DepthPyramid pyramid(SCR_WIDTH, SCR_HEIGHT);
+ *   ...
+ *   GlState::bindFramebuffer(GL_FRAMEBUFFER, pyramid.framebuffer());
+ *   ...draw the occluders...
+ *   pyramid.build();
+ *   ...test boxes against pyramid.texture(), draw the rest...
+ *   pyramid.present(platform.framebuffer());
+ *   ...
+ *   pyramid.destroy();
+ *   platform.terminate();
+ *
+ * The target has an RGBA8 colour renderbuffer and a 32 bit float depth
+ * texture. Level 0 of the pyramid is half its size, an R32F texel per
+ * 2 x 2 pixels, and every further level halves again down to 1 x 1. A
+ * level of odd width or height folds its last row or column into the
+ * texels next to it, so texel i of level L covers exactly the pixels
+ * [i * 2^(L + 1), (i + 1) * 2^(L + 1)), the last texel the rest. A box
+ * that spans at most 2^(L + 1) pixels touches at most 2 x 2 texels of
+ * level L, and is hidden when its nearest depth is beyond all four.
+ *
+ * depthPyramid.fs does the reduction with texelFetch, one draw of a
+ * full screen triangle per level, reading the level below through
+ * GL_TEXTURE_BASE_LEVEL so it never samples the level it writes. Until
+ * the first build() every level holds the far plane, which hides
+ * nothing. The target should match the framebuffer it is presented to;
+ * resize() makes both again when that changes.
+ *
+ */
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#include <glad/glad.h>
+
+#include <gl_state.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <iostream>
+
+class DepthPyramid
+{
+ public:
+  DepthPyramid(int width, int height)
+    : width(width), height(height), count(0),
+      shader("./depthPyramid.vs", "./depthPyramid.fs", nullptr)
+  {
+    create();
+
+    // the full screen triangle is made from gl_VertexID
+    glGenVertexArrays(1, &vao);
+    shader.use();
+    shader.setInt("source", 0);
+  }
+
+  ~DepthPyramid()
+  {
+    destroy();
+  }
+
+  // the framebuffer to draw the scene into
+  GLuint framebuffer() const
+  {
+    return target;
+  }
+
+  // the R32F mip chain, level 0 at half the target's size
+  GLuint texture() const
+  {
+    return pyramid;
+  }
+
+  int levels() const
+  {
+    return count;
+  }
+
+  // the size of the target, and of the depth the pyramid covers
+  int targetWidth() const
+  {
+    return width;
+  }
+
+  int targetHeight() const
+  {
+    return height;
+  }
+
+  // makes the target and the pyramid again at a new size, e.g. the
+  // framebuffer's after a resize. Every level holds the far plane again
+  void resize(int width, int height)
+  {
+    if (width == this->width && height == this->height)
+      return;
+    release();
+    this->width = width;
+    this->height = height;
+    count = 0;
+    create();
+  }
+
+  // reduces the depth drawn so far into the pyramid and binds the
+  // target again, with its viewport and the depth test on
+  void build()
+  {
+    shader.use();
+    GlState::bindVertexArray(vao);
+    GlState::disable(GL_DEPTH_TEST);
+    GlState::bindFramebuffer(GL_FRAMEBUFFER, reduction);
+    int sourceWidth = width, sourceHeight = height;
+    for (int level = 0; level < count; level++)
+      {
+	int w = std::max(sourceWidth / 2, 1), h = std::max(sourceHeight / 2, 1);
+	if (level == 0)
+	  GlState::bindTexture(0, GL_TEXTURE_2D, depth);
+	else
+	  {
+	    GlState::bindTexture(0, GL_TEXTURE_2D, pyramid);
+	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+	    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+	  }
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			       GL_TEXTURE_2D, pyramid, level);
+	GlState::viewport(0, 0, w, h);
+	shader.setVec2("sourceSize", sourceWidth, sourceHeight);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	sourceWidth = w;
+	sourceHeight = h;
+      }
+    GlState::bindTexture(0, GL_TEXTURE_2D, pyramid);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+
+    GlState::bindFramebuffer(GL_FRAMEBUFFER, target);
+    GlState::viewport(0, 0, width, height);
+    GlState::enable(GL_DEPTH_TEST);
+  }
+
+  // copies the colour of the target to framebuffer, the screen
+  void present(GLuint framebuffer)
+  {
+    GlState::bindFramebuffer(GL_READ_FRAMEBUFFER, target);
+    GlState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+		      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    GlState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  }
+
+  // deletes the target and the pyramid, for before the context goes away
+  void destroy()
+  {
+    if (shader.ID == 0)
+      return;
+    glDeleteProgram(shader.ID);
+    shader.ID = 0;
+    release();
+    GlState::forget(vao);
+    glDeleteVertexArrays(1, &vao);
+  }
+
+ private:
+  int width, height;
+  int count;
+  Shader shader;
+  GLuint target, colour, depth;
+  GLuint pyramid, reduction;
+  GLuint vao;
+
+  // the target and the pyramid at width x height
+  void create()
+  {
+    // the scene target
+    glGenFramebuffers(1, &target);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glGenRenderbuffers(1, &colour);
+    glBindRenderbuffer(GL_RENDERBUFFER, colour);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			      GL_RENDERBUFFER, colour);
+    glGenTextures(1, &depth);
+    GlState::bindTexture(0, GL_TEXTURE_2D, depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0,
+		 GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+			   depth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      std::cout << "ERROR::DEPTH_PYRAMID:: scene target is not complete"
+		<< std::endl;
+
+    // the pyramid, cleared to the far plane
+    glGenTextures(1, &pyramid);
+    GlState::bindTexture(0, GL_TEXTURE_2D, pyramid);
+    int w = std::max(width / 2, 1), h = std::max(height / 2, 1);
+    for (;;)
+      {
+	glTexImage2D(GL_TEXTURE_2D, count, GL_R32F, w, h, 0, GL_RED, GL_FLOAT,
+		     NULL);
+	count++;
+	if (w == 1 && h == 1)
+	  break;
+	w = std::max(w / 2, 1);
+	h = std::max(h / 2, 1);
+      }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+		    GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+    glGenFramebuffers(1, &reduction);
+    glBindFramebuffer(GL_FRAMEBUFFER, reduction);
+    const GLfloat far[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int level = 0; level < count; level++)
+      {
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			       GL_TEXTURE_2D, pyramid, level);
+	glClearBufferfv(GL_COLOR, 0, far);
+      }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GlState::invalidate();
+  }
+
+  void release()
+  {
+    GlState::forget(target);
+    GlState::forget(reduction);
+    GlState::forget(depth);
+    GlState::forget(pyramid);
+    glDeleteFramebuffers(1, &target);
+    glDeleteFramebuffers(1, &reduction);
+    glDeleteRenderbuffers(1, &colour);
+    glDeleteTextures(1, &depth);
+    glDeleteTextures(1, &pyramid);
+  }
+
+  DepthPyramid(const DepthPyramid&);
+  DepthPyramid& operator=(const DepthPyramid&);
+};
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * Memory for data that lives one frame: names built for a uniform, a
+ * list sorted for this frame's draws. Allocating is bumping a pointer
+ * and the platform frees everything at once at the end of the frame.
+ *
+ *   FrameArena &arena = FrameArena::frame();
+ *   shader.setVec2(arena.format("offsets[%u]", i).c_str(), offset);
+ *
+ *   ArenaVector<glm::vec3> panes(arena);
+ *   panes.push_back(position);
+ *
+ * The arena starts with one block. What does not fit goes to extra
+ * blocks, and at reset() they are merged into one block as large as
+ * the frame needed, so once the frames are alike nothing is allocated
+ * from the heap any more (heap_tracker.h checks that). Nothing
+ * allocated here may be kept past platform.endFrame(), and no
+ * destructors run: the containers are for plain data.
+ *
+ * StringView is a pointer and a length. The ones format() and copy()
+ * return end with a '\0', so c_str() can go to GL and the Shader
+ * setters.
+ *
+ */
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+class StringView
+{
+ public:
+  StringView() : text(""), length(0)
+  {
+  }
+
+  StringView(const char* text) : text(text), length(strlen(text))
+  {
+  }
+
+  StringView(const char* text, size_t length) : text(text), length(length)
+  {
+  }
+
+  StringView(const std::string &text) : text(text.c_str()), length(text.size())
+  {
+  }
+
+  const char* data() const
+  {
+    return text;
+  }
+
+  // only for views that end with a '\0', as the arena's do
+  const char* c_str() const
+  {
+    return text;
+  }
+
+  size_t size() const
+  {
+    return length;
+  }
+
+  bool empty() const
+  {
+    return length == 0;
+  }
+
+  char operator[](size_t i) const
+  {
+    return text[i];
+  }
+
+  bool operator==(const StringView &other) const
+  {
+    return length == other.length && memcmp(text, other.text, length) == 0;
+  }
+
+  bool operator!=(const StringView &other) const
+  {
+    return !(*this == other);
+  }
+
+ private:
+  const char* text;
+  size_t length;
+};
+
+class FrameArena
+{
+ public:
+  static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+  // the arena the platform resets at the end of every frame
+  static FrameArena& frame()
+  {
+    static FrameArena arena;
+    return arena;
+  }
+
+  explicit FrameArena(size_t capacity = DEFAULT_CAPACITY)
+    : block((char*)malloc(capacity)), capacity(capacity), offset(0),
+      overflowBytes(0), peak(0), grown(0)
+  {
+  }
+
+  ~FrameArena()
+  {
+    release();
+    free(block);
+  }
+
+  // size bytes, aligned to align (a power of two)
+  void* allocate(size_t size, size_t align = alignof(std::max_align_t))
+  {
+    size_t start = (offset + align - 1) & ~(align - 1);
+    if (start + size <= capacity)
+      {
+	offset = start + size;
+	return block + start;
+      }
+    // the frame outgrew the block, take another until reset() resizes
+    char* extra = (char*)malloc(size + align);
+    if (extra == NULL)
+      throw std::bad_alloc();
+    overflow.push_back(extra);
+    overflowBytes += size + align;
+    size_t misalign = (size_t)extra & (align - 1);
+    return extra + (misalign ? align - misalign : 0);
+  }
+
+  // room for count objects of T, not constructed
+  template <class T>
+  T* allocate(size_t count)
+  {
+    return (T*)allocate(count * sizeof(T), alignof(T));
+  }
+
+  // a copy of the text
+  StringView copy(const StringView &text)
+  {
+    char* out = allocate<char>(text.size() + 1);
+    memcpy(out, text.data(), text.size());
+    out[text.size()] = '\0';
+    return StringView(out, text.size());
+  }
+
+  // printf into the arena
+  StringView format(const char* fmt, ...)
+  {
+    va_list args;
+    va_start(args, fmt);
+    // most names fit in what is left of the block
+    size_t start = offset;
+    size_t room = capacity - start;
+    int length = vsnprintf(block + start, room, fmt, args);
+    va_end(args);
+    if (length < 0)
+      return StringView();
+    if ((size_t)length < room)
+      {
+	offset = start + length + 1;
+	return StringView(block + start, length);
+      }
+    char* out = allocate<char>(length + 1);
+    va_start(args, fmt);
+    vsnprintf(out, length + 1, fmt, args);
+    va_end(args);
+    return StringView(out, length);
+  }
+
+  // frees everything allocated since the last reset
+  void reset()
+  {
+    size_t used = offset + overflowBytes;
+    if (used > peak)
+      peak = used;
+    if (!overflow.empty())
+      {
+	release();
+	// room for the whole frame in one block from now on
+	free(block);
+	capacity = peak + peak / 2;
+	block = (char*)malloc(capacity);
+	grown++;
+      }
+    offset = 0;
+  }
+
+  // bytes in use this frame
+  size_t used() const
+  {
+    return offset + overflowBytes;
+  }
+
+  // the most any frame used
+  size_t highWater() const
+  {
+    return peak > used() ? peak : used();
+  }
+
+  // times the block had to be resized
+  unsigned int resizes() const
+  {
+    return grown;
+  }
+
+ private:
+  char* block;
+  size_t capacity;
+  size_t offset;
+  std::vector<char*> overflow;
+  size_t overflowBytes;
+  size_t peak;
+  unsigned int grown;
+
+  FrameArena(const FrameArena&);
+  FrameArena& operator=(const FrameArena&);
+
+  void release()
+  {
+    for (size_t i = 0; i < overflow.size(); i++)
+      free(overflow[i]);
+    overflow.clear();
+    overflowBytes = 0;
+  }
+};
+
+// a standard allocator on an arena, freeing is left to reset()
+template <class T>
+class ArenaAllocator
+{
+ public:
+  typedef T value_type;
+
+  ArenaAllocator(FrameArena &arena = FrameArena::frame()) : arena(&arena)
+  {
+  }
+
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena)
+  {
+  }
+
+  T* allocate(size_t count)
+  {
+    return arena->allocate<T>(count);
+  }
+
+  void deallocate(T*, size_t)
+  {
+  }
+
+  template <class U>
+  bool operator==(const ArenaAllocator<U> &other) const
+  {
+    return arena == other.arena;
+  }
+
+  template <class U>
+  bool operator!=(const ArenaAllocator<U> &other) const
+  {
+    return arena != other.arena;
+  }
+
+ private:
+  template <class U> friend class ArenaAllocator;
+  FrameArena* arena;
+};
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * Writes the rendered frames to disk without stalling the GPU
+ * (--capture, see platform.h).
+ *
+ * capture() only queues a glReadPixels into one of a ring of pixel pack
+ * buffers and puts a fence after it, so the copy runs on the GPU behind
+ * the frame. A few frames later, once the fence has passed, the buffer
+ * is mapped and the pixels are copied out and handed to a worker
+ * thread, which flips them upright and encodes them. The render thread
+ * waits only when the GPU falls RING frames behind or the worker falls
+ * QUEUE frames behind.
+ *
+ * The path picks the format: a name ending in .y4m gets one YUV4MPEG2
+ * stream (4:2:0, for ffmpeg and other encoders), anything else is a
+ * printf pattern for one PNG per frame, e.g. frames/%05d.png (a name
+ * without a % gets _%05d before its extension). The PNGs are stored
+ * without compression (deflate "stored" blocks), which keeps the worker
+ * fast and needs no image library.
+ *
+ */
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace frame_capture_detail {
+  inline uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size)
+  {
+    static uint32_t table[256];
+    static bool filled = false;
+    if (!filled)
+      {
+	for (uint32_t n = 0; n < 256; n++)
+	  {
+	    uint32_t c = n;
+	    for (int k = 0; k < 8; k++)
+	      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+	    table[n] = c;
+	  }
+	filled = true;
+      }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+      crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+  }
+
+  inline void putWord(std::vector<unsigned char> &out, uint32_t word)
+  {
+    out.push_back(word >> 24);
+    out.push_back(word >> 16);
+    out.push_back(word >> 8);
+    out.push_back(word);
+  }
+
+  // appends a PNG chunk, the type and data followed by their CRC
+  inline void putChunk(std::vector<unsigned char> &out, const char* type,
+		       const unsigned char* data, size_t size)
+  {
+    putWord(out, size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    putWord(out, crc32(0, &out[start], out.size() - start));
+  }
+
+  // an 8 bit RGB PNG of the RGBA pixels, stored bottom row first as GL
+  // reads them
+  inline void encodePng(const unsigned char* rgba, int width, int height,
+			std::vector<unsigned char> &out,
+			std::vector<unsigned char> &raw)
+  {
+    // the scanlines: a filter byte (none) and the RGB bytes, top row first
+    size_t stride = 1 + 3 * (size_t)width;
+    raw.resize(stride * height);
+    for (int y = 0; y < height; y++)
+      {
+	const unsigned char* src = rgba + (size_t)(height - 1 - y) * width * 4;
+	unsigned char* dst = &raw[y * stride];
+	*dst++ = 0;
+	for (int x = 0; x < width; x++, src += 4)
+	  {
+	    *dst++ = src[0];
+	    *dst++ = src[1];
+	    *dst++ = src[2];
+	  }
+      }
+
+    static const unsigned char signature[8] =
+      { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.assign(signature, signature + 8);
+    unsigned char header[13] = { 0 };
+    header[0] = width >> 24; header[1] = width >> 16;
+    header[2] = width >> 8; header[3] = width;
+    header[4] = height >> 24; header[5] = height >> 16;
+    header[6] = height >> 8; header[7] = height;
+    header[8] = 8;     // bits per sample
+    header[9] = 2;     // RGB
+    putChunk(out, "IHDR", header, 13);
+
+    // a zlib stream of stored blocks of at most 65535 bytes
+    std::vector<unsigned char> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    size_t pos = 0;
+    do
+      {
+	size_t size = std::min<size_t>(raw.size() - pos, 65535);
+	bool last = pos + size == raw.size();
+	zlib.push_back(last ? 1 : 0);
+	zlib.push_back(size);
+	zlib.push_back(size >> 8);
+	zlib.push_back(~size);
+	zlib.push_back(~size >> 8);
+	zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + size);
+	for (size_t i = pos; i < pos + size; i++)
+	  {
+	    a = (a + raw[i]) % 65521;
+	    b = (b + a) % 65521;
+	  }
+	pos += size;
+      }
+    while (pos < raw.size());
+    putWord(zlib, (b << 16) | a);
+    putChunk(out, "IDAT", &zlib[0], zlib.size());
+    putChunk(out, "IEND", NULL, 0);
+  }
+
+  // the Y, U and V planes (4:2:0, full range BT.601) of the RGBA pixels
+  inline void encodeYuv(const unsigned char* rgba, int width, int height,
+			std::vector<unsigned char> &out)
+  {
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    out.resize((size_t)width * height + 2 * (size_t)cw * ch);
+    unsigned char* yPlane = &out[0];
+    unsigned char* uPlane = yPlane + (size_t)width * height;
+    unsigned char* vPlane = uPlane + (size_t)cw * ch;
+    for (int y = 0; y < height; y++)
+      {
+	const unsigned char* src = rgba + (size_t)(height - 1 - y) * width * 4;
+	for (int x = 0; x < width; x++, src += 4)
+	  yPlane[y * width + x] =
+	    (77 * src[0] + 150 * src[1] + 29 * src[2] + 128) >> 8;
+      }
+    for (int y = 0; y < ch; y++)
+      for (int x = 0; x < cw; x++)
+	{
+	  // the average of the 2x2 block, clamped at the right and bottom edges
+	  int r = 0, g = 0, b = 0;
+	  for (int dy = 0; dy < 2; dy++)
+	    for (int dx = 0; dx < 2; dx++)
+	      {
+		int sx = std::min(2 * x + dx, width - 1);
+		int sy = std::min(2 * y + dy, height - 1);
+		const unsigned char* p =
+		  rgba + ((size_t)(height - 1 - sy) * width + sx) * 4;
+		r += p[0];
+		g += p[1];
+		b += p[2];
+	      }
+	  int u = (-43 * r - 85 * g + 128 * b + 512) / 1024 + 128;
+	  int v = (128 * r - 107 * g - 21 * b + 512) / 1024 + 128;
+	  uPlane[y * cw + x] = std::max(0, std::min(255, u));
+	  vPlane[y * cw + x] = std::max(0, std::min(255, v));
+	}
+  }
+}
+
+class FrameCapture
+{
+ public:
+  // pixel pack buffers in flight
+  static const unsigned int RING = 3;
+  // frames waiting for the worker
+  static const unsigned int QUEUE = 8;
+
+  FrameCapture(const std::string &path, int width, int height)
+    : path(path), width(width), height(height), frameIndex(0),
+      written(0), stopping(false), renderSeconds(0.0), waits(0)
+  {
+    y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+    if (!y4m && path.find('%') == std::string::npos)
+      {
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos ||
+	    (slash != std::string::npos && dot < slash))
+	  dot = path.size();
+	this->path = path.substr(0, dot) + "_%05d" + path.substr(dot);
+      }
+    size_t size = (size_t)width * height * 4;
+    glGenBuffers(RING, buffers);
+    for (unsigned int i = 0; i < RING; i++)
+      {
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+	glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	fences[i] = 0;
+      }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    worker = std::thread(&FrameCapture::work, this);
+  }
+
+  ~FrameCapture()
+  {
+    finish();
+  }
+
+  // queues the readback of the framebuffer's color. Call after the
+  // frame is drawn and before the swap
+  void capture(GLuint framebuffer)
+  {
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    unsigned int slot = frameIndex % RING;
+    // the slot's last readback has to be out before it is reused
+    if (fences[slot] != 0)
+      collect(slot, true);
+
+    GLint readFramebuffer = 0, packAlignment = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slotFrame[slot] = frameIndex;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    frameIndex++;
+
+    // pick up whatever else the GPU has finished, oldest first
+    for (unsigned int i = 1; i < RING; i++)
+      {
+	unsigned int older = (slot + i) % RING;
+	if (fences[older] != 0)
+	  collect(older, false);
+      }
+    renderSeconds += std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - start).count();
+  }
+
+  // waits for the outstanding readbacks and the worker
+  void finish()
+  {
+    if (!worker.joinable())
+      return;
+    // the next slot to be written holds the oldest readback, then on
+    // around the ring, so a video gets its last frames in order
+    for (unsigned int i = 0; i < RING; i++)
+      {
+	unsigned int slot = (frameIndex + i) % RING;
+	if (fences[slot] != 0)
+	  collect(slot, true);
+      }
+    glDeleteBuffers(RING, buffers);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    ready.notify_all();
+    worker.join();
+    std::cout << "captured " << written << " frames to " << path << ", "
+	      << (frameIndex > 0 ? renderSeconds * 1000.0 / frameIndex : 0.0)
+	      << " ms per frame on the render thread, " << waits
+	      << " waits" << std::endl;
+  }
+
+ private:
+  struct Frame
+  {
+    unsigned int index;
+    std::vector<unsigned char> pixels;
+  };
+
+  std::string path;
+  bool y4m;
+  int width;
+  int height;
+  GLuint buffers[RING];
+  GLsync fences[RING];
+  unsigned int slotFrame[RING];
+  unsigned int frameIndex;
+  unsigned int written;
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::condition_variable drained;
+  std::deque<Frame> queue;
+  // pixel vectors the worker is done with, reused to spare allocations
+  std::vector<std::vector<unsigned char> > spare;
+  bool stopping;
+
+  double renderSeconds;
+  unsigned long waits;
+
+  // copies a finished readback out of its buffer and queues it for the
+  // worker; without wait it gives up if the GPU is not done yet
+  void collect(unsigned int slot, bool wait)
+  {
+    GLenum status = glClientWaitSync(fences[slot], 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      {
+	if (!wait)
+	  return;
+	waits++;
+	status = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT,
+				  1000000000ull);
+      }
+    glDeleteSync(fences[slot]);
+    fences[slot] = 0;
+    if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED)
+      {
+	std::cout << "ERROR::FRAME_CAPTURE::READBACK_LOST "
+		  << slotFrame[slot] << std::endl;
+	return;
+      }
+
+    Frame frame;
+    frame.index = slotFrame[slot];
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (queue.size() >= QUEUE)
+	{
+	  waits++;
+	  drained.wait(lock, [this] { return queue.size() < QUEUE; });
+	}
+      if (!spare.empty())
+	{
+	  frame.pixels.swap(spare.back());
+	  spare.pop_back();
+	}
+    }
+    size_t size = (size_t)width * height * 4;
+    frame.pixels.resize(size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[slot]);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+					  GL_MAP_READ_BIT);
+    if (mapped != NULL)
+      {
+	memcpy(&frame.pixels[0], mapped, size);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (mapped == NULL)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(Frame());
+      queue.back().index = frame.index;
+      queue.back().pixels.swap(frame.pixels);
+    }
+    ready.notify_one();
+  }
+
+  // the worker thread: encodes and writes the queued frames in order
+  void work()
+  {
+    std::ofstream stream;
+    if (y4m)
+      {
+	stream.open(path.c_str(), std::ios::binary);
+	stream << "YUV4MPEG2 W" << width << " H" << height
+	       << " F60:1 Ip A1:1 C420jpeg\n";
+      }
+    std::vector<unsigned char> encoded, scratch;
+    Frame frame;
+    for (;;)
+      {
+	{
+	  std::unique_lock<std::mutex> lock(mutex);
+	  ready.wait(lock, [this] { return stopping || !queue.empty(); });
+	  if (queue.empty())
+	    break;
+	  frame.index = queue.front().index;
+	  frame.pixels.swap(queue.front().pixels);
+	  queue.pop_front();
+	}
+	drained.notify_one();
+
+	if (y4m)
+	  {
+	    frame_capture_detail::encodeYuv(&frame.pixels[0], width, height,
+					    encoded);
+	    stream << "FRAME\n";
+	    stream.write((const char*)&encoded[0], encoded.size());
+	    if (stream)
+	      written++;
+	  }
+	else
+	  {
+	    frame_capture_detail::encodePng(&frame.pixels[0], width, height,
+					    encoded, scratch);
+	    std::vector<char> name(path.size() + 32);
+	    snprintf(&name[0], name.size(), path.c_str(), frame.index);
+	    std::ofstream file(&name[0], std::ios::binary);
+	    file.write((const char*)&encoded[0], encoded.size());
+	    if (file)
+	      written++;
+	    else
+	      std::cout << "ERROR::FRAME_CAPTURE::FILE_NOT_WRITTEN "
+			<< &name[0] << std::endl;
+	  }
+
+	std::lock_guard<std::mutex> lock(mutex);
+	spare.push_back(std::vector<unsigned char>());
+	spare.back().swap(frame.pixels);
+      }
+  }
+};
+
+#endif
@@ -0,0 +1,407 @@
+/*
+ * Culls static instances against the view frustum on the CPU and
+ * writes the model matrices of the visible ones, packed, into a
+ * StreamBuffer for Mesh::DrawInstanced.
+ *
+ *   FrustumCuller culler(platform.threads());
+ *   for (...)
+ *     culler.add(model, low, high);   // the mesh's bounds, model space
+ *   StreamBuffer stream(culler.size() * sizeof(glm::mat4));
+ *   ...
+ *   stream.beginFrame();
+ *   StreamBuffer::Range range;
+ *   GLsizei visible = culler.cull(Frustum::fromMatrix(projection * view),
+ *                                 stream, range);
+ *   stream.commit();
+ *   model.DrawInstanced(shader, stream.buffer(), visible, range.offset);
+ *   stream.endFrame();
+ *
+ * add() keeps the bounds in world space as structures of arrays: the
+ * bounding spheres (centre x, y, z and radius) and the boxes (min and
+ * max x, y, z), one array each, padded with NaN (never visible) to
+ * whole SIMD blocks. cull() tests a block of 8 instances at once with
+ * AVX2 when the compiler targets it (-mavx2), 4 with SSE2 otherwise on
+ * x86, and one at a time elsewhere. The sphere test against the six
+ * planes comes first; the blocks with a sphere inside or across the
+ * frustum are tested again with the boxes, which fit tighter.
+ *
+ * The instances are cut into one chunk per thread of a WorkerPool. A
+ * first pass writes the indices of each chunk's visible instances into
+ * the chunk's part of one index array. Their counts give each chunk
+ * its place in the output, and a second pass copies the matrices
+ * there, so the stream gets only what is drawn and nothing allocates.
+ * The culler prints on exit what it tested and how fast, and json()
+ * gives the same for a benchmark report.
+ *
+ */
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <cpu_profiler.h>
+#include <stream_buffer.h>
+#include <worker_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE2
+#endif
+
+// the six planes of a view frustum, pointing inwards: a point p is
+// inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum
+{
+  glm::vec4 planes[6];
+
+  // the planes of a projection * view matrix, in world space
+  static Frustum fromMatrix(const glm::mat4 &m)
+  {
+    // the rows of the matrix, glm stores columns
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++)
+      rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0]; // left
+    frustum.planes[1] = rows[3] - rows[0]; // right
+    frustum.planes[2] = rows[3] + rows[1]; // bottom
+    frustum.planes[3] = rows[3] - rows[1]; // top
+    frustum.planes[4] = rows[3] + rows[2]; // near
+    frustum.planes[5] = rows[3] - rows[2]; // far
+    for (int p = 0; p < 6; p++)
+      {
+	glm::vec4 &plane = frustum.planes[p];
+	float length = sqrtf(plane.x * plane.x + plane.y * plane.y +
+			     plane.z * plane.z);
+	plane = plane * (1.0f / length);
+      }
+    return frustum;
+  }
+};
+
+// the world space bounds of an instance: the box around its
+// transformed model space box, and the sphere around the model space
+// box scaled by the largest scale of the transform
+struct Bounds
+{
+  glm::vec3 centre;
+  float radius;
+  glm::vec3 low;
+  glm::vec3 high;
+
+  Bounds(const glm::mat4 &transform, const glm::vec3 &modelLow,
+	 const glm::vec3 &modelHigh)
+  {
+    glm::vec3 half = (modelHigh - modelLow) * 0.5f;
+    centre = glm::vec3(transform * glm::vec4((modelLow + modelHigh) * 0.5f,
+					     1.0f));
+    glm::vec3 extent(0.0f);
+    float scale = 0.0f;
+    for (int column = 0; column < 3; column++)
+      {
+	glm::vec3 axis(transform[column]);
+	extent.x += fabsf(axis.x) * half[column];
+	extent.y += fabsf(axis.y) * half[column];
+	extent.z += fabsf(axis.z) * half[column];
+	scale = std::max(scale, glm::length(axis));
+      }
+    radius = glm::length(half) * scale;
+    low = centre - extent;
+    high = centre + extent;
+  }
+};
+
+class FrustumCuller
+{
+ public:
+#if defined(__AVX2__)
+  static const size_t LANES = 8;
+#elif defined(FRUSTUM_CULLER_SSE2)
+  static const size_t LANES = 4;
+#else
+  static const size_t LANES = 1;
+#endif
+
+  explicit FrustumCuller(unsigned int threads)
+    : pool(threads), counts(pool.threads()), offsets(pool.threads()),
+      frames(0), seconds(0.0), visibleTotal(0)
+  {
+  }
+
+  ~FrustumCuller()
+  {
+    if (frames > 0)
+      std::cout << "frustum culling (" << instructionSet() << ", "
+		<< pool.threads() << " threads): " << visibleTotal / frames
+		<< " of " << transforms.size() << " visible, "
+		<< seconds * 1000.0 / frames << " ms and "
+		<< instancesPerMs() << " instances per ms" << std::endl;
+  }
+
+  // the SIMD path compiled in
+  static const char* instructionSet()
+  {
+    return LANES == 8 ? "AVX2" : LANES == 4 ? "SSE2" : "scalar";
+  }
+
+  // an instance, with the box [low, high] of its mesh in model space
+  void add(const glm::mat4 &transform, const glm::vec3 &low,
+	   const glm::vec3 &high)
+  {
+    // drop the padding of the last block, it is put back below
+    size_t count = transforms.size();
+    resizeBounds(count);
+    transforms.push_back(transform);
+
+    Bounds bounds(transform, low, high);
+    centreX.push_back(bounds.centre.x);
+    centreY.push_back(bounds.centre.y);
+    centreZ.push_back(bounds.centre.z);
+    radius.push_back(bounds.radius);
+    minX.push_back(bounds.low.x);
+    minY.push_back(bounds.low.y);
+    minZ.push_back(bounds.low.z);
+    maxX.push_back(bounds.high.x);
+    maxY.push_back(bounds.high.y);
+    maxZ.push_back(bounds.high.z);
+    resizeBounds((transforms.size() + LANES - 1) / LANES * LANES);
+    indices.resize(centreX.size());
+  }
+
+  size_t size() const
+  {
+    return transforms.size();
+  }
+
+  // writes the matrices of the instances inside the frustum to a range
+  // of the stream's frame and returns how many there are
+  GLsizei cull(const Frustum &frustum, StreamBuffer &stream,
+	       StreamBuffer::Range &range)
+  {
+    PROFILE_ZONE("FrustumCuller::cull");
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+    pool.run([this, &frustum](unsigned int index)
+	     {
+	       size_t first, last;
+	       chunk(index, first, last);
+	       counts[index] = test(frustum, first, last,
+				      indices.data() + first);
+	     });
+    size_t visible = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+      {
+	offsets[i] = visible;
+	visible += counts[i];
+      }
+    range = stream.allocate(visible * sizeof(glm::mat4));
+    if (range.pointer == NULL)
+      visible = 0;
+    else if (visible > 0)
+      {
+	glm::mat4* out = (glm::mat4*)range.pointer;
+	pool.run([this, out](unsigned int index)
+		 {
+		   size_t first, last;
+		   chunk(index, first, last);
+		   glm::mat4* to = out + offsets[index];
+		   for (size_t i = 0; i < counts[index]; i++)
+		     memcpy(to + i, &transforms[indices[first + i]],
+			    sizeof(glm::mat4));
+		 });
+      }
+    seconds += std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - begin).count();
+    visibleTotal += visible;
+    frames++;
+    return visible;
+  }
+
+  // instances tested per millisecond of cull()
+  double instancesPerMs() const
+  {
+    return seconds > 0.0 ? transforms.size() * frames / (seconds * 1000.0)
+      : 0.0;
+  }
+
+  // what the culler did per frame, as a JSON object
+  std::string json() const
+  {
+    std::ostringstream out;
+    out << "{\"method\": \"cpu\", \"instruction_set\": \""
+	<< instructionSet()
+	<< "\", \"threads\": " << pool.threads()
+	<< ", \"instances\": " << transforms.size()
+	<< ", \"visible\": " << (frames > 0 ? visibleTotal / frames : 0)
+	<< ", \"cull_ms\": " << (frames > 0 ? seconds * 1000.0 / frames : 0.0)
+	<< ", \"instances_per_ms\": " << instancesPerMs() << "}";
+    return out.str();
+  }
+
+ private:
+  WorkerPool pool;
+  std::vector<glm::mat4> transforms;
+  // world space bounds, padded to whole blocks of LANES
+  std::vector<float> centreX, centreY, centreZ, radius;
+  std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+  // the visible instances, each chunk in its own part
+  std::vector<uint32_t> indices;
+  std::vector<size_t> counts;
+  std::vector<size_t> offsets;
+
+  unsigned long frames;
+  double seconds;
+  unsigned long long visibleTotal;
+
+  void resizeBounds(size_t size)
+  {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    std::vector<float>* arrays[] = {
+      &centreX, &centreY, &centreZ, &radius, &minX, &minY, &minZ, &maxX,
+      &maxY, &maxZ
+    };
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+      arrays[i]->resize(size, nan);
+  }
+
+  // the blocks of thread index
+  void chunk(unsigned int index, size_t &first, size_t &last) const
+  {
+    size_t blocks = centreX.size() / LANES;
+    first = blocks * index / pool.threads() * LANES;
+    last = blocks * (index + 1) / pool.threads() * LANES;
+  }
+
+  // writes the indices of the visible instances in [first, last) to out
+  // and returns how many there are
+  size_t test(const Frustum &frustum, size_t first, size_t last,
+	      uint32_t* out) const
+  {
+    size_t count = 0;
+#if defined(__AVX2__)
+    __m256 zero = _mm256_setzero_ps();
+    for (size_t i = first; i < last; i += LANES)
+      {
+	__m256 x = _mm256_loadu_ps(&centreX[i]);
+	__m256 y = _mm256_loadu_ps(&centreY[i]);
+	__m256 z = _mm256_loadu_ps(&centreZ[i]);
+	__m256 negativeRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&radius[i]));
+	__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	for (int p = 0; p < 6; p++)
+	  {
+	    const glm::vec4 &plane = frustum.planes[p];
+	    __m256 d = _mm256_add_ps
+	      (_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)),
+			     _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+	       _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)),
+			     _mm256_set1_ps(plane.w)));
+	    inside = _mm256_and_ps(inside,
+				   _mm256_cmp_ps(d, negativeRadius, _CMP_GE_OQ));
+	  }
+	if (_mm256_movemask_ps(inside) == 0)
+	  continue;
+	for (int p = 0; p < 6; p++)
+	  {
+	    // the corner of each box furthest along the plane's normal
+	    const glm::vec4 &plane = frustum.planes[p];
+	    __m256 px = _mm256_loadu_ps(plane.x >= 0.0f ? &maxX[i] : &minX[i]);
+	    __m256 py = _mm256_loadu_ps(plane.y >= 0.0f ? &maxY[i] : &minY[i]);
+	    __m256 pz = _mm256_loadu_ps(plane.z >= 0.0f ? &maxZ[i] : &minZ[i]);
+	    __m256 d = _mm256_add_ps
+	      (_mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(plane.x)),
+			     _mm256_mul_ps(py, _mm256_set1_ps(plane.y))),
+	       _mm256_add_ps(_mm256_mul_ps(pz, _mm256_set1_ps(plane.z)),
+			     _mm256_set1_ps(plane.w)));
+	    inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+	  }
+	count += emit(_mm256_movemask_ps(inside), i, out + count);
+      }
+#elif defined(FRUSTUM_CULLER_SSE2)
+    __m128 zero = _mm_setzero_ps();
+    for (size_t i = first; i < last; i += LANES)
+      {
+	__m128 x = _mm_loadu_ps(&centreX[i]);
+	__m128 y = _mm_loadu_ps(&centreY[i]);
+	__m128 z = _mm_loadu_ps(&centreZ[i]);
+	__m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(&radius[i]));
+	__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for (int p = 0; p < 6; p++)
+	  {
+	    const glm::vec4 &plane = frustum.planes[p];
+	    __m128 d = _mm_add_ps
+	      (_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)),
+			  _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+	       _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)),
+			  _mm_set1_ps(plane.w)));
+	    inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negativeRadius));
+	  }
+	if (_mm_movemask_ps(inside) == 0)
+	  continue;
+	for (int p = 0; p < 6; p++)
+	  {
+	    // the corner of each box furthest along the plane's normal
+	    const glm::vec4 &plane = frustum.planes[p];
+	    __m128 px = _mm_loadu_ps(plane.x >= 0.0f ? &maxX[i] : &minX[i]);
+	    __m128 py = _mm_loadu_ps(plane.y >= 0.0f ? &maxY[i] : &minY[i]);
+	    __m128 pz = _mm_loadu_ps(plane.z >= 0.0f ? &maxZ[i] : &minZ[i]);
+	    __m128 d = _mm_add_ps
+	      (_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x)),
+			  _mm_mul_ps(py, _mm_set1_ps(plane.y))),
+	       _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(plane.z)),
+			  _mm_set1_ps(plane.w)));
+	    inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+	  }
+	count += emit(_mm_movemask_ps(inside), i, out + count);
+      }
+#else
+    for (size_t i = first; i < last; i++)
+      {
+	bool inside = true;
+	for (int p = 0; p < 6 && inside; p++)
+	  {
+	    const glm::vec4 &plane = frustum.planes[p];
+	    inside = plane.x * centreX[i] + plane.y * centreY[i] +
+	      plane.z * centreZ[i] + plane.w >= -radius[i];
+	  }
+	for (int p = 0; p < 6 && inside; p++)
+	  {
+	    const glm::vec4 &plane = frustum.planes[p];
+	    inside = plane.x * (plane.x >= 0.0f ? maxX[i] : minX[i]) +
+	      plane.y * (plane.y >= 0.0f ? maxY[i] : minY[i]) +
+	      plane.z * (plane.z >= 0.0f ? maxZ[i] : minZ[i]) + plane.w >= 0.0f;
+	  }
+	if (inside)
+	  out[count++] = i;
+      }
+#endif
+    return count;
+  }
+
+  // the indices of the lanes set in mask
+  static size_t emit(int mask, size_t block, uint32_t* out)
+  {
+    size_t count = 0;
+    for (size_t lane = 0; lane < LANES; lane++)
+      if (mask & (1 << lane))
+	out[count++] = block + lane;
+    return count;
+  }
+
+  FrustumCuller(const FrustumCuller&);
+  FrustumCuller& operator=(const FrustumCuller&);
+};
+
+#endif
@@ -0,0 +1,857 @@
+/*
+ * An optional layer between the demos and the driver. glad calls every
+ * GL function through a pointer (glDrawArrays is glad_glDrawArrays), so
+ * install() can swap the pointers of the functions listed below for
+ * wrappers that count the call and then forward it. On top of the
+ * counts the wrappers keep
+ *
+ *  - a shadow of the bindings and switches, to spot redundant calls
+ *    that set what is already set (the same VAO bound again, the same
+ *    texture unit made active, GL_DEPTH_TEST enabled twice, ...)
+ *  - the bytes sent with glBufferData, glBufferSubData, glTexImage*,
+ *    glTexSubImage2D and written through glMapBufferRange
+ *
+ * per frame (endFrame() rolls them over) and summed since resetTotals().
+ * The benchmark report (bench.h) and --gl-stats (platform.h) read them.
+ *
+ * The shadow starts out unknown, so the first call of each kind is
+ * never reported; calls that bypass the layer (before install() or
+ * from another context) make it stale.
+ *
+ */
+#ifndef GL_INTERCEPT_H
+#define GL_INTERCEPT_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// name and kind of every intercepted function
+#define GL_INTERCEPT_FUNCTIONS(X)		\
+  X(glDrawArrays, DRAW)				\
+  X(glDrawElements, DRAW)			\
+  X(glDrawArraysInstanced, DRAW)		\
+  X(glDrawElementsInstanced, DRAW)		\
+  X(glDrawElementsBaseVertex, DRAW)		\
+  X(glDrawElementsInstancedBaseVertex, DRAW)	\
+  X(glDrawRangeElements, DRAW)			\
+  X(glMultiDrawArrays, DRAW)			\
+  X(glMultiDrawElements, DRAW)			\
+  X(glMultiDrawElementsBaseVertex, DRAW)	\
+  X(glDrawArraysIndirect, DRAW)			\
+  X(glDrawElementsIndirect, DRAW)		\
+  X(glMultiDrawArraysIndirect, DRAW)		\
+  X(glMultiDrawElementsIndirect, DRAW)		\
+  X(glDrawTransformFeedback, DRAW)		\
+  X(glDrawTransformFeedbackInstanced, DRAW)	\
+  X(glUseProgram, STATE)			\
+  X(glBindVertexArray, STATE)			\
+  X(glBindBuffer, STATE)			\
+  X(glBindBufferBase, STATE)			\
+  X(glBindBufferRange, STATE)			\
+  X(glActiveTexture, STATE)			\
+  X(glBindTexture, STATE)			\
+  X(glBindSampler, STATE)			\
+  X(glBindFramebuffer, STATE)			\
+  X(glBindRenderbuffer, STATE)			\
+  X(glEnable, STATE)				\
+  X(glDisable, STATE)				\
+  X(glBlendFunc, STATE)				\
+  X(glBlendFuncSeparate, STATE)			\
+  X(glBlendEquation, STATE)			\
+  X(glDepthFunc, STATE)				\
+  X(glDepthMask, STATE)				\
+  X(glColorMask, STATE)				\
+  X(glStencilFunc, STATE)			\
+  X(glStencilOp, STATE)				\
+  X(glStencilMask, STATE)			\
+  X(glCullFace, STATE)				\
+  X(glFrontFace, STATE)				\
+  X(glPolygonMode, STATE)			\
+  X(glViewport, STATE)				\
+  X(glScissor, STATE)				\
+  X(glClearColor, STATE)			\
+  X(glPixelStorei, STATE)			\
+  X(glVertexAttribPointer, STATE)		\
+  X(glEnableVertexAttribArray, STATE)		\
+  X(glDisableVertexAttribArray, STATE)		\
+  X(glVertexAttribDivisor, STATE)		\
+  X(glTexParameteri, STATE)			\
+  X(glTexParameterf, STATE)			\
+  X(glUniformBlockBinding, STATE)		\
+  X(glUniform1i, UNIFORM)			\
+  X(glUniform1f, UNIFORM)			\
+  X(glUniform2f, UNIFORM)			\
+  X(glUniform3f, UNIFORM)			\
+  X(glUniform4f, UNIFORM)			\
+  X(glUniform1iv, UNIFORM)			\
+  X(glUniform1fv, UNIFORM)			\
+  X(glUniform2fv, UNIFORM)			\
+  X(glUniform3fv, UNIFORM)			\
+  X(glUniform4fv, UNIFORM)			\
+  X(glUniformMatrix2fv, UNIFORM)		\
+  X(glUniformMatrix3fv, UNIFORM)		\
+  X(glUniformMatrix4fv, UNIFORM)		\
+  X(glBufferData, UPLOAD)			\
+  X(glBufferSubData, UPLOAD)			\
+  X(glBufferStorage, UPLOAD)			\
+  X(glMapBufferRange, UPLOAD)			\
+  X(glFlushMappedBufferRange, UPLOAD)		\
+  X(glUnmapBuffer, UPLOAD)			\
+  X(glTexImage2D, UPLOAD)			\
+  X(glTexImage3D, UPLOAD)			\
+  X(glTexSubImage2D, UPLOAD)			\
+  X(glTexBuffer, UPLOAD)			\
+  X(glClear, OTHER)				\
+  X(glGenerateMipmap, OTHER)			\
+  X(glBlitFramebuffer, OTHER)			\
+  X(glReadPixels, OTHER)			\
+  X(glFlush, OTHER)				\
+  X(glFinish, OTHER)				\
+  X(glFenceSync, OTHER)				\
+  X(glClientWaitSync, OTHER)			\
+  X(glDeleteSync, OTHER)			\
+  X(glGenBuffers, OTHER)			\
+  X(glGenVertexArrays, OTHER)			\
+  X(glGenTextures, OTHER)			\
+  X(glGenFramebuffers, OTHER)			\
+  X(glDeleteBuffers, OTHER)			\
+  X(glDeleteVertexArrays, OTHER)		\
+  X(glDeleteTextures, OTHER)			\
+  X(glDeleteFramebuffers, OTHER)		\
+  X(glGetUniformLocation, OTHER)		\
+  X(glGetUniformBlockIndex, OTHER)		\
+  X(glGetError, OTHER)				\
+  X(glCreateShader, OTHER)			\
+  X(glShaderSource, OTHER)			\
+  X(glCompileShader, OTHER)			\
+  X(glDeleteShader, OTHER)			\
+  X(glCreateProgram, OTHER)			\
+  X(glAttachShader, OTHER)			\
+  X(glLinkProgram, OTHER)			\
+  X(glDeleteProgram, OTHER)			\
+  X(glGetShaderiv, OTHER)			\
+  X(glGetProgramiv, OTHER)
+
+namespace gl_intercept_detail {
+  enum Kind { DRAW, STATE, UNIFORM, UPLOAD, OTHER };
+
+#define GL_INTERCEPT_ID(name, kind) ID_##name,
+  enum Id { GL_INTERCEPT_FUNCTIONS(GL_INTERCEPT_ID) FUNCTION_COUNT };
+#undef GL_INTERCEPT_ID
+
+  inline const char* name(int id)
+  {
+#define GL_INTERCEPT_NAME(name, kind) #name,
+    static const char* names[] = { GL_INTERCEPT_FUNCTIONS(GL_INTERCEPT_NAME) };
+#undef GL_INTERCEPT_NAME
+    return names[id];
+  }
+
+  inline Kind kind(int id)
+  {
+#define GL_INTERCEPT_KIND(name, kind) kind,
+    static const Kind kinds[] = { GL_INTERCEPT_FUNCTIONS(GL_INTERCEPT_KIND) };
+#undef GL_INTERCEPT_KIND
+    return kinds[id];
+  }
+}
+
+// what one frame (or the sum of many) did through the layer
+struct GlInterceptStats
+{
+  unsigned long calls[gl_intercept_detail::FUNCTION_COUNT];
+  unsigned long redundant[gl_intercept_detail::FUNCTION_COUNT];
+  unsigned long long uploadBytes;
+
+  unsigned long total() const
+  {
+    return sum(calls, -1);
+  }
+  unsigned long draws() const
+  {
+    return sum(calls, gl_intercept_detail::DRAW);
+  }
+  unsigned long stateChanges() const
+  {
+    return sum(calls, gl_intercept_detail::STATE);
+  }
+  unsigned long uniformUploads() const
+  {
+    return sum(calls, gl_intercept_detail::UNIFORM);
+  }
+  unsigned long redundantCalls() const
+  {
+    return sum(redundant, -1);
+  }
+
+ private:
+  static unsigned long sum(const unsigned long* values, int kind)
+  {
+    unsigned long total = 0;
+    for (int i = 0; i < gl_intercept_detail::FUNCTION_COUNT; i++)
+      if (kind < 0 || gl_intercept_detail::kind(i) == kind)
+	total += values[i];
+    return total;
+  }
+};
+
+// the shadow of the GL state the wrappers compare against; -1 is
+// "not known yet"
+struct GlInterceptState
+{
+  static const int UNITS = 32;
+  static const int TEXTURE_TARGETS = 5;
+  static const int BUFFER_TARGETS = 10;
+  static const int INDEXED = 16;
+  static const int CAPS = 13;
+
+  bool installed;
+  GlInterceptStats frame;
+  GlInterceptStats last;
+  GlInterceptStats totals;
+  unsigned long frames;
+
+  long program;
+  long vertexArray;
+  long activeUnit;
+  long textures[UNITS][TEXTURE_TARGETS];
+  long buffers[BUFFER_TARGETS];
+  // indexed uniform and transform feedback bindings: buffer, offset, size
+  long long ranges[2][INDEXED][3];
+  long drawFramebuffer;
+  long readFramebuffer;
+  long renderbuffer;
+  int caps[CAPS];
+  long depthFunc;
+  int depthMask;
+  long cullFace;
+  long blend[2];
+  long viewport[4];
+  float clearColor[4];
+  bool clearColorKnown;
+
+  GlInterceptState()
+    : installed(false), frame(), last(), totals(), frames(0)
+  {
+    forget();
+  }
+
+  // marks every shadowed value unknown
+  void forget()
+  {
+    program = vertexArray = activeUnit = -1;
+    for (int u = 0; u < UNITS; u++)
+      for (int t = 0; t < TEXTURE_TARGETS; t++)
+	textures[u][t] = -1;
+    for (int i = 0; i < BUFFER_TARGETS; i++)
+      buffers[i] = -1;
+    for (int k = 0; k < 2; k++)
+      for (int i = 0; i < INDEXED; i++)
+	ranges[k][i][0] = ranges[k][i][1] = ranges[k][i][2] = -1;
+    drawFramebuffer = readFramebuffer = renderbuffer = -1;
+    for (int i = 0; i < CAPS; i++)
+      caps[i] = -1;
+    depthFunc = cullFace = -1;
+    depthMask = -1;
+    blend[0] = blend[1] = -1;
+    viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+    clearColorKnown = false;
+  }
+
+  static int textureTarget(GLenum target)
+  {
+    switch (target)
+      {
+      case GL_TEXTURE_2D: return 0;
+      case GL_TEXTURE_CUBE_MAP: return 1;
+      case GL_TEXTURE_2D_ARRAY: return 2;
+      case GL_TEXTURE_3D: return 3;
+      case GL_TEXTURE_BUFFER: return 4;
+      default: return -1;
+      }
+  }
+
+  static int bufferTarget(GLenum target)
+  {
+    switch (target)
+      {
+      case GL_ARRAY_BUFFER: return 0;
+      case GL_ELEMENT_ARRAY_BUFFER: return 1;
+      case GL_UNIFORM_BUFFER: return 2;
+      case GL_PIXEL_PACK_BUFFER: return 3;
+      case GL_PIXEL_UNPACK_BUFFER: return 4;
+      case GL_COPY_READ_BUFFER: return 5;
+      case GL_COPY_WRITE_BUFFER: return 6;
+      case GL_TEXTURE_BUFFER: return 7;
+      case GL_TRANSFORM_FEEDBACK_BUFFER: return 8;
+      case GL_DRAW_INDIRECT_BUFFER: return 9;
+      default: return -1;
+      }
+  }
+
+  static int indexedTarget(GLenum target)
+  {
+    switch (target)
+      {
+      case GL_UNIFORM_BUFFER: return 0;
+      case GL_TRANSFORM_FEEDBACK_BUFFER: return 1;
+      default: return -1;
+      }
+  }
+
+  static int cap(GLenum cap)
+  {
+    switch (cap)
+      {
+      case GL_DEPTH_TEST: return 0;
+      case GL_BLEND: return 1;
+      case GL_CULL_FACE: return 2;
+      case GL_STENCIL_TEST: return 3;
+      case GL_SCISSOR_TEST: return 4;
+      case GL_RASTERIZER_DISCARD: return 5;
+      case GL_PROGRAM_POINT_SIZE: return 6;
+      case GL_FRAMEBUFFER_SRGB: return 7;
+      case GL_MULTISAMPLE: return 8;
+      case GL_POLYGON_OFFSET_FILL: return 9;
+      case GL_DEPTH_CLAMP: return 10;
+      case GL_PRIMITIVE_RESTART: return 11;
+      case GL_TEXTURE_CUBE_MAP_SEAMLESS: return 12;
+      default: return -1;
+      }
+  }
+};
+
+class GlIntercept
+{
+ public:
+  typedef GlInterceptStats Stats;
+  typedef GlInterceptState State;
+
+  // swaps the glad pointers for the counting wrappers; call with the
+  // context current, after gladLoadGL
+  static void install();
+  // puts the driver's functions back
+  static void uninstall();
+
+  static bool installed()
+  {
+    return state().installed;
+  }
+
+  // the frame in progress
+  static Stats& frame()
+  {
+    return state().frame;
+  }
+
+  // the last frame ended
+  static const Stats& lastFrame()
+  {
+    return state().last;
+  }
+
+  // call once per frame, adds the frame to the totals and starts a new one
+  static void endFrame()
+  {
+    State &s = state();
+    s.last = s.frame;
+    for (int i = 0; i < gl_intercept_detail::FUNCTION_COUNT; i++)
+      {
+	s.totals.calls[i] += s.frame.calls[i];
+	s.totals.redundant[i] += s.frame.redundant[i];
+      }
+    s.totals.uploadBytes += s.frame.uploadBytes;
+    s.frames++;
+    s.frame = Stats();
+  }
+
+  // forgets the totals, e.g. after the warmup of a benchmark
+  static void resetTotals()
+  {
+    state().totals = Stats();
+    state().frames = 0;
+  }
+
+  // calls and redundant calls per frame since resetTotals(), most
+  // frequent first, as a JSON object
+  static std::string json()
+  {
+    const State &s = state();
+    std::vector<std::pair<double, int> > order = byCount(s.totals.calls);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << "{\n    \"frames\": "
+	<< s.frames << ",\n    \"calls_per_frame\": {";
+    for (size_t i = 0; i < order.size(); i++)
+      out << (i > 0 ? ", " : "") << "\"" << gl_intercept_detail::name
+	(order[i].second) << "\": " << order[i].first;
+    out << "},\n    \"redundant_per_frame\": {";
+    order = byCount(s.totals.redundant);
+    for (size_t i = 0; i < order.size(); i++)
+      out << (i > 0 ? ", " : "") << "\"" << gl_intercept_detail::name
+	(order[i].second) << "\": " << order[i].first;
+    out << "}\n  }";
+    return out.str();
+  }
+
+  // the same as text, for the console
+  static std::string report()
+  {
+    const State &s = state();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+	<< "GL calls per frame over " << s.frames << " frames: "
+	<< perFrame(s.totals.total()) << " ("
+	<< perFrame(s.totals.draws()) << " draws, "
+	<< perFrame(s.totals.stateChanges()) << " state, "
+	<< perFrame(s.totals.uniformUploads()) << " uniforms), "
+	<< perFrame(s.totals.redundantCalls()) << " redundant, "
+	<< perFrame(s.totals.uploadBytes) / 1024.0 << " KiB uploaded\n";
+    std::vector<std::pair<double, int> > calls = byCount(s.totals.calls);
+    for (size_t i = 0; i < calls.size(); i++)
+      {
+	double redundant = perFrame(s.totals.redundant[calls[i].second]);
+	out << "  " << std::setw(28) << std::left
+	    << gl_intercept_detail::name(calls[i].second) << std::right
+	    << std::setw(10) << calls[i].first;
+	if (redundant > 0.0)
+	  out << "  (" << redundant << " redundant)";
+	out << "\n";
+      }
+    return out.str();
+  }
+
+  // the counters and the shadow the wrappers update
+  static State& state()
+  {
+    static State instance;
+    return instance;
+  }
+
+ private:
+  static double perFrame(unsigned long long total)
+  {
+    return state().frames > 0 ? (double)total / state().frames : 0.0;
+  }
+
+  static std::vector<std::pair<double, int> >
+  byCount(const unsigned long* totals)
+  {
+    std::vector<std::pair<double, int> > order;
+    for (int i = 0; i < gl_intercept_detail::FUNCTION_COUNT; i++)
+      if (totals[i] > 0)
+	order.push_back(std::make_pair(perFrame(totals[i]), i));
+    std::sort(order.begin(), order.end(), moreFrequent);
+    return order;
+  }
+
+  static bool moreFrequent(const std::pair<double, int> &a,
+			   const std::pair<double, int> &b)
+  {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  }
+};
+
+namespace gl_intercept_detail {
+  // flags the call as redundant when the shadowed value already equals
+  // the new one, then stores it
+  template <typename T>
+  inline void set(int id, T &shadow, T value)
+  {
+    if (shadow == value)
+      GlIntercept::state().frame.redundant[id]++;
+    shadow = value;
+  }
+
+  // bytes of a w x h x d image in this format and type
+  inline unsigned long long imageBytes(GLsizei width, GLsizei height,
+				       GLsizei depth, GLenum format,
+				       GLenum type)
+  {
+    unsigned int components = 4;
+    switch (format)
+      {
+      case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT:
+      case GL_STENCIL_INDEX:
+	components = 1; break;
+      case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL:
+	components = 2; break;
+      case GL_RGB: case GL_BGR: case GL_RGB_INTEGER:
+	components = 3; break;
+      }
+    unsigned int size = 1;
+    switch (type)
+      {
+      case GL_UNSIGNED_BYTE: case GL_BYTE:
+	size = components; break;
+      case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+	size = 2 * components; break;
+      case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+	size = 4 * components; break;
+      case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+	size = 8; break;
+      default:
+	// packed types hold a whole pixel
+	size = 4; break;
+      }
+    return (unsigned long long)width * height * depth * size;
+  }
+
+  // per function bookkeeping before the call is forwarded, nothing by
+  // default
+  template <int ID>
+  struct Observe
+  {
+    template <typename... Args>
+    static void call(Args...)
+    {
+    }
+  };
+
+#define GL_INTERCEPT_OBSERVE(name, params)		\
+  template <>						\
+  struct Observe<ID_##name>				\
+  {							\
+    static const int id = ID_##name;			\
+    static void call params;				\
+  };							\
+  inline void Observe<ID_##name>::call params
+
+  GL_INTERCEPT_OBSERVE(glUseProgram, (GLuint program))
+  {
+    set<long>(id, GlIntercept::state().program, program);
+  }
+
+  GL_INTERCEPT_OBSERVE(glBindVertexArray, (GLuint array))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    if (s.vertexArray != (long)array)
+      // the element array binding belongs to the VAO
+      s.buffers[1] = -1;
+    set<long>(id, s.vertexArray, array);
+  }
+
+  GL_INTERCEPT_OBSERVE(glActiveTexture, (GLenum texture))
+  {
+    set<long>(id, GlIntercept::state().activeUnit, texture - GL_TEXTURE0);
+  }
+
+  GL_INTERCEPT_OBSERVE(glBindTexture, (GLenum target, GLuint texture))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    int t = GlInterceptState::textureTarget(target);
+    if (t < 0 || s.activeUnit < 0 || s.activeUnit >= GlInterceptState::UNITS)
+      return;
+    set<long>(id, s.textures[s.activeUnit][t], texture);
+  }
+
+  GL_INTERCEPT_OBSERVE(glBindBuffer, (GLenum target, GLuint buffer))
+  {
+    int t = GlInterceptState::bufferTarget(target);
+    if (t >= 0)
+      set<long>(id, GlIntercept::state().buffers[t], buffer);
+  }
+
+  GL_INTERCEPT_OBSERVE(glBindBufferBase,
+		       (GLenum target, GLuint index, GLuint buffer))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    int k = GlInterceptState::indexedTarget(target);
+    // binding a range binds the generic target too
+    int t = GlInterceptState::bufferTarget(target);
+    if (t >= 0)
+      s.buffers[t] = buffer;
+    if (k < 0 || index >= (GLuint)GlInterceptState::INDEXED)
+      return;
+    long long* range = s.ranges[k][index];
+    if (range[0] == buffer && range[1] == 0 && range[2] == 0)
+      s.frame.redundant[id]++;
+    range[0] = buffer;
+    range[1] = range[2] = 0;
+  }
+
+  GL_INTERCEPT_OBSERVE(glBindBufferRange,
+		       (GLenum target, GLuint index, GLuint buffer,
+			GLintptr offset, GLsizeiptr size))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    int k = GlInterceptState::indexedTarget(target);
+    int t = GlInterceptState::bufferTarget(target);
+    if (t >= 0)
+      s.buffers[t] = buffer;
+    if (k < 0 || index >= (GLuint)GlInterceptState::INDEXED)
+      return;
+    long long* range = s.ranges[k][index];
+    if (range[0] == buffer && range[1] == offset && range[2] == size)
+      s.frame.redundant[id]++;
+    range[0] = buffer;
+    range[1] = offset;
+    range[2] = size;
+  }
+
+  GL_INTERCEPT_OBSERVE(glBindFramebuffer, (GLenum target, GLuint framebuffer))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    if (target == GL_FRAMEBUFFER)
+      {
+	if (s.drawFramebuffer == (long)framebuffer &&
+	    s.readFramebuffer == (long)framebuffer)
+	  s.frame.redundant[id]++;
+	s.drawFramebuffer = s.readFramebuffer = framebuffer;
+      }
+    else if (target == GL_DRAW_FRAMEBUFFER)
+      set<long>(id, s.drawFramebuffer, framebuffer);
+    else if (target == GL_READ_FRAMEBUFFER)
+      set<long>(id, s.readFramebuffer, framebuffer);
+  }
+
+  GL_INTERCEPT_OBSERVE(glBindRenderbuffer,
+		       (GLenum target, GLuint renderbuffer))
+  {
+    set<long>(id, GlIntercept::state().renderbuffer, renderbuffer);
+  }
+
+  GL_INTERCEPT_OBSERVE(glEnable, (GLenum cap))
+  {
+    int c = GlInterceptState::cap(cap);
+    if (c >= 0)
+      set<int>(id, GlIntercept::state().caps[c], 1);
+  }
+
+  GL_INTERCEPT_OBSERVE(glDisable, (GLenum cap))
+  {
+    int c = GlInterceptState::cap(cap);
+    if (c >= 0)
+      set<int>(id, GlIntercept::state().caps[c], 0);
+  }
+
+  GL_INTERCEPT_OBSERVE(glDepthFunc, (GLenum func))
+  {
+    set<long>(id, GlIntercept::state().depthFunc, func);
+  }
+
+  GL_INTERCEPT_OBSERVE(glDepthMask, (GLboolean flag))
+  {
+    set<int>(id, GlIntercept::state().depthMask, flag);
+  }
+
+  GL_INTERCEPT_OBSERVE(glCullFace, (GLenum mode))
+  {
+    set<long>(id, GlIntercept::state().cullFace, mode);
+  }
+
+  GL_INTERCEPT_OBSERVE(glBlendFunc, (GLenum sfactor, GLenum dfactor))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    if (s.blend[0] == (long)sfactor && s.blend[1] == (long)dfactor)
+      s.frame.redundant[id]++;
+    s.blend[0] = sfactor;
+    s.blend[1] = dfactor;
+  }
+
+  GL_INTERCEPT_OBSERVE(glViewport,
+		       (GLint x, GLint y, GLsizei width, GLsizei height))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    if (s.viewport[0] == x && s.viewport[1] == y &&
+	s.viewport[2] == width && s.viewport[3] == height)
+      s.frame.redundant[id]++;
+    s.viewport[0] = x;
+    s.viewport[1] = y;
+    s.viewport[2] = width;
+    s.viewport[3] = height;
+  }
+
+  GL_INTERCEPT_OBSERVE(glClearColor,
+		       (GLfloat red, GLfloat green, GLfloat blue,
+			GLfloat alpha))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    if (s.clearColorKnown && s.clearColor[0] == red &&
+	s.clearColor[1] == green && s.clearColor[2] == blue &&
+	s.clearColor[3] == alpha)
+      s.frame.redundant[id]++;
+    s.clearColor[0] = red;
+    s.clearColor[1] = green;
+    s.clearColor[2] = blue;
+    s.clearColor[3] = alpha;
+    s.clearColorKnown = true;
+  }
+
+  GL_INTERCEPT_OBSERVE(glDeleteVertexArrays,
+		       (GLsizei n, const GLuint* arrays))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    for (GLsizei i = 0; i < n; i++)
+      if (s.vertexArray == (long)arrays[i])
+	s.vertexArray = 0;
+  }
+
+  GL_INTERCEPT_OBSERVE(glDeleteBuffers, (GLsizei n, const GLuint* buffers))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    for (GLsizei i = 0; i < n; i++)
+      {
+	for (int t = 0; t < GlInterceptState::BUFFER_TARGETS; t++)
+	  if (s.buffers[t] == (long)buffers[i])
+	    s.buffers[t] = 0;
+	for (int k = 0; k < 2; k++)
+	  for (int r = 0; r < GlInterceptState::INDEXED; r++)
+	    if (s.ranges[k][r][0] == buffers[i])
+	      s.ranges[k][r][0] = s.ranges[k][r][1] = s.ranges[k][r][2] = 0;
+      }
+  }
+
+  GL_INTERCEPT_OBSERVE(glDeleteTextures, (GLsizei n, const GLuint* textures))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    for (GLsizei i = 0; i < n; i++)
+      for (int u = 0; u < GlInterceptState::UNITS; u++)
+	for (int t = 0; t < GlInterceptState::TEXTURE_TARGETS; t++)
+	  if (s.textures[u][t] == (long)textures[i])
+	    s.textures[u][t] = 0;
+  }
+
+  GL_INTERCEPT_OBSERVE(glDeleteFramebuffers,
+		       (GLsizei n, const GLuint* framebuffers))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    for (GLsizei i = 0; i < n; i++)
+      {
+	if (s.drawFramebuffer == (long)framebuffers[i])
+	  s.drawFramebuffer = 0;
+	if (s.readFramebuffer == (long)framebuffers[i])
+	  s.readFramebuffer = 0;
+      }
+  }
+
+  GL_INTERCEPT_OBSERVE(glBufferData,
+		       (GLenum target, GLsizeiptr size, const void* data,
+			GLenum usage))
+  {
+    if (data != NULL)
+      GlIntercept::state().frame.uploadBytes += size;
+  }
+
+  GL_INTERCEPT_OBSERVE(glBufferSubData,
+		       (GLenum target, GLintptr offset, GLsizeiptr size,
+			const void* data))
+  {
+    GlIntercept::state().frame.uploadBytes += size;
+  }
+
+  GL_INTERCEPT_OBSERVE(glBufferStorage,
+		       (GLenum target, GLsizeiptr size, const void* data,
+			GLbitfield flags))
+  {
+    if (data != NULL)
+      GlIntercept::state().frame.uploadBytes += size;
+  }
+
+  GL_INTERCEPT_OBSERVE(glMapBufferRange,
+		       (GLenum target, GLintptr offset, GLsizeiptr length,
+			GLbitfield access))
+  {
+    // what is mapped for writing is taken as written
+    if (access & GL_MAP_WRITE_BIT)
+      GlIntercept::state().frame.uploadBytes += length;
+  }
+
+  GL_INTERCEPT_OBSERVE(glTexImage2D,
+		       (GLenum target, GLint level, GLint internalformat,
+			GLsizei width, GLsizei height, GLint border,
+			GLenum format, GLenum type, const void* pixels))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    // with a pixel unpack buffer bound the data comes from the GPU
+    if (pixels != NULL && s.buffers[4] <= 0)
+      s.frame.uploadBytes += imageBytes(width, height, 1, format, type);
+  }
+
+  GL_INTERCEPT_OBSERVE(glTexImage3D,
+		       (GLenum target, GLint level, GLint internalformat,
+			GLsizei width, GLsizei height, GLsizei depth,
+			GLint border, GLenum format, GLenum type,
+			const void* pixels))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    if (pixels != NULL && s.buffers[4] <= 0)
+      s.frame.uploadBytes += imageBytes(width, height, depth, format, type);
+  }
+
+  GL_INTERCEPT_OBSERVE(glTexSubImage2D,
+		       (GLenum target, GLint level, GLint xoffset,
+			GLint yoffset, GLsizei width, GLsizei height,
+			GLenum format, GLenum type, const void* pixels))
+  {
+    GlIntercept::State &s = GlIntercept::state();
+    if (s.buffers[4] <= 0)
+      s.frame.uploadBytes += imageBytes(width, height, 1, format, type);
+  }
+#undef GL_INTERCEPT_OBSERVE
+
+  // the wrapper of one function: count, observe, forward
+  template <int ID, typename F>
+  struct Hook;
+
+  template <int ID, typename R, typename... Args>
+  struct Hook<ID, R (APIENTRYP)(Args...)>
+  {
+    typedef R (APIENTRYP Function)(Args...);
+
+    static Function& real()
+    {
+      static Function function = NULL;
+      return function;
+    }
+
+    static R APIENTRY call(Args... args)
+    {
+      GlIntercept::state().frame.calls[ID]++;
+      Observe<ID>::call(args...);
+      return real()(args...);
+    }
+
+    static void install(Function &pointer)
+    {
+      if (pointer == NULL || pointer == &call)
+	return;
+      real() = pointer;
+      pointer = &call;
+    }
+
+    static void uninstall(Function &pointer)
+    {
+      if (pointer == &call)
+	pointer = real();
+    }
+  };
+}
+
+inline void GlIntercept::install()
+{
+  using namespace gl_intercept_detail;
+#define GL_INTERCEPT_INSTALL(name, kind)				\
+  Hook<ID_##name, decltype(glad_##name)>::install(glad_##name);
+  GL_INTERCEPT_FUNCTIONS(GL_INTERCEPT_INSTALL)
+#undef GL_INTERCEPT_INSTALL
+  state().forget();
+  state().installed = true;
+}
+
+inline void GlIntercept::uninstall()
+{
+  using namespace gl_intercept_detail;
+#define GL_INTERCEPT_UNINSTALL(name, kind)				\
+  Hook<ID_##name, decltype(glad_##name)>::uninstall(glad_##name);
+  GL_INTERCEPT_FUNCTIONS(GL_INTERCEPT_UNINSTALL)
+#undef GL_INTERCEPT_UNINSTALL
+  state().installed = false;
+}
+
+#endif
@@ -0,0 +1,353 @@
+/*
+ * A CPU shadow of the GL state the demos switch most: the program, the
+ * vertex array, the textures of each unit and the active unit, the
+ * framebuffers, the enabled capabilities, blend, depth, stencil and
+ * cull settings and the viewport. Each setter compares against the
+ * shadow and only calls GL when the value changes, so code can state
+ * what it needs before every draw without paying for it.
+ *
+ *   GlState::useProgram(shader.ID);
+ *   GlState::bindVertexArray(cubeVAO);
+ *   GlState::bindTexture(0, GL_TEXTURE_2D, cubeTexture);
+ *   GlState::enable(GL_DEPTH_TEST);
+ *
+ * The shadow starts out unknown, so the first call of each setter always
+ * goes through. It is only right while the state is changed through
+ * here: code that calls GL directly has to restore what it changed or
+ * call invalidate() afterwards. Deleting a bound object leaves a stale
+ * entry behind, forget() clears it.
+ *
+ * Like the uniform cache in Shader it counts the calls it issued and
+ * skipped, per frame (endFrame(), called by the platform after the
+ * swap) for the benchmark report.
+ *
+ */
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+class GlState
+{
+ public:
+  static const int UNITS = 32;
+  static const int TEXTURE_TARGETS = 4;
+  static const int CAPS = 8;
+
+  struct Stats {
+    unsigned int issued;
+    unsigned int skipped;
+  };
+  // counters of the frame in progress
+  static Stats& stats()
+  {
+    static Stats counters = {0, 0};
+    return counters;
+  }
+  // counters of the last completed frame
+  static Stats& lastFrameStats()
+  {
+    static Stats counters = {0, 0};
+    return counters;
+  }
+  // call once per frame to roll the counters over
+  static void endFrame()
+  {
+    lastFrameStats() = stats();
+    stats().issued = 0;
+    stats().skipped = 0;
+  }
+
+  static void useProgram(GLuint program)
+  {
+    if (changed(shadow().program, program))
+      glUseProgram(program);
+  }
+
+  static void bindVertexArray(GLuint array)
+  {
+    if (changed(shadow().vertexArray, array))
+      glBindVertexArray(array);
+  }
+
+  // unit is a number, 0 for GL_TEXTURE0
+  static void activeTexture(GLuint unit)
+  {
+    if (changed(shadow().activeUnit, unit))
+      glActiveTexture(GL_TEXTURE0 + unit);
+  }
+
+  // binds the texture to the unit, making the unit active only when the
+  // binding changes
+  static void bindTexture(GLuint unit, GLenum target, GLuint texture)
+  {
+    State &s = shadow();
+    int t = textureTarget(target);
+    if (t < 0 || unit >= (GLuint)UNITS)
+      {
+	activeTexture(unit);
+	glBindTexture(target, texture);
+	stats().issued++;
+	return;
+      }
+    if (changed(s.textures[unit][t], texture))
+      {
+	activeTexture(unit);
+	glBindTexture(target, texture);
+      }
+  }
+
+  // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+  static void bindFramebuffer(GLenum target, GLuint framebuffer)
+  {
+    State &s = shadow();
+    if (target == GL_FRAMEBUFFER)
+      {
+	if (s.drawFramebuffer == (long)framebuffer &&
+	    s.readFramebuffer == (long)framebuffer)
+	  {
+	    stats().skipped++;
+	    return;
+	  }
+	s.drawFramebuffer = s.readFramebuffer = framebuffer;
+	stats().issued++;
+	glBindFramebuffer(target, framebuffer);
+      }
+    else if ((target == GL_DRAW_FRAMEBUFFER &&
+	      changed(s.drawFramebuffer, framebuffer)) ||
+	     (target == GL_READ_FRAMEBUFFER &&
+	      changed(s.readFramebuffer, framebuffer)))
+      glBindFramebuffer(target, framebuffer);
+  }
+
+  static void enable(GLenum cap)
+  {
+    setCap(cap, true);
+  }
+
+  static void disable(GLenum cap)
+  {
+    setCap(cap, false);
+  }
+
+  static void setCap(GLenum cap, bool on)
+  {
+    int c = capIndex(cap);
+    if (c >= 0 && !changed(shadow().caps[c], on))
+      return;
+    if (c < 0)
+      stats().issued++;
+    if (on)
+      glEnable(cap);
+    else
+      glDisable(cap);
+  }
+
+  static void blendFunc(GLenum sfactor, GLenum dfactor)
+  {
+    State &s = shadow();
+    if (changed(s.blend, ((long)sfactor << 16) | dfactor))
+      glBlendFunc(sfactor, dfactor);
+  }
+
+  static void depthFunc(GLenum func)
+  {
+    if (changed(shadow().depthFunc, func))
+      glDepthFunc(func);
+  }
+
+  static void depthMask(GLboolean flag)
+  {
+    if (changed(shadow().depthMask, flag))
+      glDepthMask(flag);
+  }
+
+  static void stencilFunc(GLenum func, GLint ref, GLuint mask)
+  {
+    State &s = shadow();
+    if (s.stencilFunc[0] == (long)func && s.stencilFunc[1] == ref &&
+	s.stencilFunc[2] == (long)mask)
+      {
+	stats().skipped++;
+	return;
+      }
+    s.stencilFunc[0] = func;
+    s.stencilFunc[1] = ref;
+    s.stencilFunc[2] = mask;
+    stats().issued++;
+    glStencilFunc(func, ref, mask);
+  }
+
+  static void stencilOp(GLenum sfail, GLenum dpfail, GLenum dppass)
+  {
+    State &s = shadow();
+    if (s.stencilOp[0] == (long)sfail && s.stencilOp[1] == (long)dpfail &&
+	s.stencilOp[2] == (long)dppass)
+      {
+	stats().skipped++;
+	return;
+      }
+    s.stencilOp[0] = sfail;
+    s.stencilOp[1] = dpfail;
+    s.stencilOp[2] = dppass;
+    stats().issued++;
+    glStencilOp(sfail, dpfail, dppass);
+  }
+
+  static void stencilMask(GLuint mask)
+  {
+    if (changed(shadow().stencilMask, mask))
+      glStencilMask(mask);
+  }
+
+  static void cullFace(GLenum mode)
+  {
+    if (changed(shadow().cullFace, mode))
+      glCullFace(mode);
+  }
+
+  static void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+  {
+    State &s = shadow();
+    if (s.viewport[0] == x && s.viewport[1] == y &&
+	s.viewport[2] == width && s.viewport[3] == height)
+      {
+	stats().skipped++;
+	return;
+      }
+    s.viewport[0] = x;
+    s.viewport[1] = y;
+    s.viewport[2] = width;
+    s.viewport[3] = height;
+    stats().issued++;
+    glViewport(x, y, width, height);
+  }
+
+  // what the shadow holds for the program, the vertex array and a
+  // capability (0 or 1), -1 when it is not known
+  static long boundProgram()
+  {
+    return shadow().program;
+  }
+
+  static long boundVertexArray()
+  {
+    return shadow().vertexArray;
+  }
+
+  static long capability(GLenum cap)
+  {
+    int c = capIndex(cap);
+    return c < 0 ? -1 : shadow().caps[c];
+  }
+
+  // forgets everything, for after code that changed the state behind
+  // the cache's back
+  static void invalidate()
+  {
+    shadow() = State();
+  }
+
+  // forgets the bindings of a vertex array, texture or framebuffer about
+  // to be deleted, since GL reuses the names
+  static void forget(GLuint name)
+  {
+    State &s = shadow();
+    if (s.vertexArray == (long)name)
+      s.vertexArray = -1;
+    for (int u = 0; u < UNITS; u++)
+      for (int t = 0; t < TEXTURE_TARGETS; t++)
+	if (s.textures[u][t] == (long)name)
+	  s.textures[u][t] = -1;
+    if (s.drawFramebuffer == (long)name)
+      s.drawFramebuffer = -1;
+    if (s.readFramebuffer == (long)name)
+      s.readFramebuffer = -1;
+  }
+
+ private:
+  // -1 is "not known"
+  struct State
+  {
+    long program;
+    long vertexArray;
+    long activeUnit;
+    long textures[UNITS][TEXTURE_TARGETS];
+    long drawFramebuffer;
+    long readFramebuffer;
+    long caps[CAPS];
+    long blend;
+    long depthFunc;
+    long depthMask;
+    long stencilFunc[3];
+    long stencilOp[3];
+    long stencilMask;
+    long cullFace;
+    long viewport[4];
+
+    State()
+      : program(-1), vertexArray(-1), activeUnit(-1), drawFramebuffer(-1),
+	readFramebuffer(-1), blend(-1), depthFunc(-1), depthMask(-1),
+	stencilMask(-1), cullFace(-1)
+    {
+      for (int u = 0; u < UNITS; u++)
+	for (int t = 0; t < TEXTURE_TARGETS; t++)
+	  textures[u][t] = -1;
+      for (int i = 0; i < CAPS; i++)
+	caps[i] = -1;
+      for (int i = 0; i < 3; i++)
+	stencilFunc[i] = stencilOp[i] = -1;
+      for (int i = 0; i < 4; i++)
+	viewport[i] = -1;
+    }
+  };
+
+  static State& shadow()
+  {
+    static State state;
+    return state;
+  }
+
+  // counts the call and stores the value, true when GL has to be called
+  static bool changed(long &shadowed, long value)
+  {
+    if (shadowed == value)
+      {
+	stats().skipped++;
+	return false;
+      }
+    shadowed = value;
+    stats().issued++;
+    return true;
+  }
+
+  static int textureTarget(GLenum target)
+  {
+    switch (target)
+      {
+      case GL_TEXTURE_2D: return 0;
+      case GL_TEXTURE_CUBE_MAP: return 1;
+      case GL_TEXTURE_2D_ARRAY: return 2;
+      case GL_TEXTURE_3D: return 3;
+      default: return -1;
+      }
+  }
+
+  static int capIndex(GLenum cap)
+  {
+    switch (cap)
+      {
+      case GL_DEPTH_TEST: return 0;
+      case GL_BLEND: return 1;
+      case GL_CULL_FACE: return 2;
+      case GL_STENCIL_TEST: return 3;
+      case GL_SCISSOR_TEST: return 4;
+      case GL_PROGRAM_POINT_SIZE: return 5;
+      case GL_FRAMEBUFFER_SRGB: return 6;
+      case GL_RASTERIZER_DISCARD: return 7;
+      default: return -1;
+      }
+  }
+};
+
+#endif
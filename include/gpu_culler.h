@@ -0,0 +1,560 @@
+/*
+ * Culls static instances against the view frustum on the GPU and
+ * packs the model matrices of the visible ones into a buffer for
+ * Mesh::DrawInstanced, so the CPU cost of a frame does not grow with
+ * the number of instances.
+ *
+ *   GpuCuller culler;
+ *   for (...)
+ *     culler.add(model, low, high);   // the mesh's bounds, model space
+ *   culler.setCommands(model.indirectCommands());
+ *   ...
+ *   culler.cull(Frustum::fromMatrix(projection * view));
+ *   if (GpuCuller::indirect())
+ *     model.DrawInstancedIndirect(shader, culler.buffer(),
+ *                                 culler.commandBuffer());
+ *   else
+ *     model.DrawInstanced(shader, culler.buffer(), culler.count());
+ *   ...
+ *   culler.destroy();
+ *   platform.terminate();
+ *
+ * add() keeps a record per instance: the model matrix, the world space
+ * bounding sphere and the world space box (see Bounds). The first
+ * cull() uploads them, and every cull() draws them as points with
+ * GL_RASTERIZER_DISCARD on. The vertex shader (gpuCull.vs) tests the
+ * sphere and then the box against the six planes of the frustum, in a
+ * uniform, as FrustumCuller does; the geometry shader (gpuCull.gs)
+ * emits the matrix of the instances that pass, and transform feedback
+ * writes them one after the other into buffer(). A
+ * GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query counts them.
+ *
+ * With ARB_draw_indirect and ARB_query_buffer_object (core in GL 4.0
+ * and 4.4) the GPU writes the query's result into the instanceCount of
+ * every command of commandBuffer(), and the draw never comes back to
+ * the CPU. On plain GL 3.3 count() reads the query back, which waits
+ * for the cull to finish. The results of a frame's query are also read
+ * LATENCY frames later for the statistics, which the culler prints on
+ * exit; json() gives the same for a benchmark report.
+ *
+ * Given a DepthPyramid, the culler also leaves out the instances
+ * hidden behind others, in two passes a frame:
+ *
+ *   culler.cull(frustum, pyramid, lastViewProjection);
+ *   ...draw buffer(VISIBLE) into pyramid.framebuffer()...
+ *   pyramid.build();
+ *   culler.cullOccluded(pyramid, viewProjection);
+ *   ...draw buffer(REVEALED)...
+ *
+ * The first pass tests the boxes in the frustum against the pyramid of
+ * the last frame, seen from the last frame's camera. The instances in
+ * front of it go to buffer(VISIBLE); those behind it are captured,
+ * whole records, for the second pass. That one tests them again
+ * against the pyramid of what the first pass drew, from this frame's
+ * camera, and writes those that came into view to buffer(REVEALED).
+ * The last frame only guesses what hides what: an instance it wrongly
+ * hides is still drawn by the second pass, in the same frame, so
+ * nothing pops in when the camera moves. With ARB_transform_feedback2
+ * (core in GL 4.0) the second pass draws the captured records with
+ * glDrawTransformFeedback; without it the CPU reads their count back.
+ *
+ */
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cpu_profiler.h>
+#include <depth_pyramid.h>
+#include <frustum_culler.h>
+#include <gl_state.h>
+#include <mesh.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class GpuCuller
+{
+ public:
+  // frames between a cull and reading its query for the statistics
+  static const unsigned int LATENCY = 3;
+
+  // the instances a pass writes: those in view, and with occlusion
+  // culling those the second pass found hidden no longer
+  enum Pass { VISIBLE, REVEALED, PASSES };
+
+  GpuCuller()
+    : vao(0), records(0), occludedVao(0), occludedRecords(0), feedback(0),
+      commandCount(0), uploaded(0), slot(0), frames(0), statisticsFrames(0),
+      seconds(0.0), occlusion(false)
+  {
+    for (int pass = 0; pass < PASSES; pass++)
+      {
+	output[pass] = 0;
+	commands[pass] = 0;
+      }
+    for (int q = 0; q < QUERIES; q++)
+      {
+	for (unsigned int i = 0; i < LATENCY; i++)
+	  {
+	    queries[q][i] = 0;
+	    issued[q][i] = false;
+	  }
+	totals[q] = 0;
+      }
+    build(FRUSTUM, std::vector<std::string>(),
+	  std::vector<const char*>(1, "instanceModel"));
+  }
+
+  ~GpuCuller()
+  {
+    destroy();
+  }
+
+  // whether the GPU writes the instance count of the indirect draws
+  static bool indirect()
+  {
+    return GLAD_GL_ARB_draw_indirect && GLAD_GL_ARB_query_buffer_object;
+  }
+
+  // an instance, with the box [low, high] of its mesh in model space
+  void add(const glm::mat4 &transform, const glm::vec3 &low,
+	   const glm::vec3 &high)
+  {
+    Bounds bounds(transform, low, high);
+    Record record;
+    record.transform = transform;
+    record.sphere = glm::vec4(bounds.centre, bounds.radius);
+    record.low = bounds.low;
+    record.high = bounds.high;
+    staged.push_back(record);
+  }
+
+  size_t size() const
+  {
+    return staged.size();
+  }
+
+  // the draws commandBuffer() holds; the culls set their instanceCount
+  void setCommands(const std::vector<DrawElementsIndirectCommand> &list)
+  {
+    if (!indirect() || list.empty())
+      return;
+    for (int pass = 0; pass < PASSES; pass++)
+      {
+	if (commands[pass] == 0)
+	  glGenBuffers(1, &commands[pass]);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands[pass]);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER,
+		     list.size() * sizeof(DrawElementsIndirectCommand),
+		     &list[0], GL_DYNAMIC_DRAW);
+      }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    commandCount = list.size();
+  }
+
+  // writes the matrices of the instances inside the frustum to buffer()
+  // and, on the indirect path, their count to the commands
+  void cull(const Frustum &frustum)
+  {
+    PROFILE_ZONE("GpuCuller::cull");
+    beginFrame();
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+
+    use(FRUSTUM, frustum);
+    capture(vao, 0, uploaded, output[VISIBLE], 0, VISIBLE);
+    writeCount(VISIBLE);
+
+    frames++;
+    seconds += std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - begin).count();
+  }
+
+  // the first pass of occlusion culling: the instances inside the
+  // frustum and in front of the pyramid, seen through viewProjection,
+  // go to buffer(VISIBLE), the others in the frustum to cullOccluded()
+  void cull(const Frustum &frustum, const DepthPyramid &pyramid,
+	    const glm::mat4 &viewProjection)
+  {
+    PROFILE_ZONE("GpuCuller::cull");
+    if (!occlusion)
+      startOcclusion();
+    beginFrame();
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+
+    use(OCCLUSION, frustum);
+    usePyramid(programs[OCCLUSION], pyramid, viewProjection);
+    capture(vao, 0, uploaded, output[VISIBLE], 0, VISIBLE);
+    writeCount(VISIBLE);
+
+    use(OCCLUDED_RECORDS, frustum);
+    usePyramid(programs[OCCLUDED_RECORDS], pyramid, viewProjection);
+    capture(vao, 0, uploaded, occludedRecords, feedback, OCCLUDED);
+
+    frames++;
+    seconds += std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - begin).count();
+  }
+
+  // the second pass: the instances the first found hidden that are in
+  // front of the pyramid now, seen through viewProjection, go to
+  // buffer(REVEALED)
+  void cullOccluded(const DepthPyramid &pyramid,
+		    const glm::mat4 &viewProjection)
+  {
+    PROFILE_ZONE("GpuCuller::cullOccluded");
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+
+    // the planes are still those of the first pass
+    programs[OCCLUSION].use();
+    usePyramid(programs[OCCLUSION], pyramid, viewProjection);
+    if (feedback != 0)
+      capture(occludedVao, feedback, 0, output[REVEALED], 0, REVEALED);
+    else
+      capture(occludedVao, 0, written(OCCLUDED), output[REVEALED], 0,
+	      REVEALED);
+    writeCount(REVEALED);
+
+    seconds += std::chrono::duration<double>
+      (std::chrono::steady_clock::now() - begin).count();
+  }
+
+  // the number of instances the pass wrote this frame. This waits for
+  // the GPU to finish the cull, the indirect path does not need it
+  GLsizei count(Pass pass = VISIBLE)
+  {
+    return written(pass);
+  }
+
+  // the packed model matrices, for Mesh::DrawInstanced
+  GLuint buffer(Pass pass = VISIBLE) const
+  {
+    return output[pass];
+  }
+
+  // the commands given to setCommands(), with the count of the pass;
+  // 0 without the indirect path
+  GLuint commandBuffer(Pass pass = VISIBLE) const
+  {
+    return commands[pass];
+  }
+
+  // instances tested per millisecond of CPU time in the culls
+  double instancesPerMs() const
+  {
+    return seconds > 0.0 ? (double)uploaded * frames / (seconds * 1000.0)
+      : 0.0;
+  }
+
+  // the instances drawn per frame
+  unsigned long long visible() const
+  {
+    return average(VISIBLE) + average(REVEALED);
+  }
+
+  // the instances in the frustum left out as hidden per frame
+  unsigned long long occluded() const
+  {
+    return average(OCCLUDED) - average(REVEALED);
+  }
+
+  // what the culler did per frame, as a JSON object
+  std::string json() const
+  {
+    std::ostringstream out;
+    out << "{\"method\": \"gpu\", \"indirect\": "
+	<< (indirect() ? "true" : "false")
+	<< ", \"occlusion\": " << (occlusion ? "true" : "false")
+	<< ", \"instances\": " << uploaded
+	<< ", \"visible\": " << visible();
+    if (occlusion)
+      out << ", \"occluded\": " << occluded()
+	  << ", \"revealed\": " << average(REVEALED);
+    out << ", \"cull_ms\": " << (frames > 0 ? seconds * 1000.0 / frames : 0.0)
+	<< ", \"instances_per_ms\": " << instancesPerMs() << "}";
+    return out.str();
+  }
+
+  // deletes the buffers, for before the context goes away
+  void destroy()
+  {
+    if (programs[FRUSTUM].ID == 0)
+      return;
+    if (frames > 0)
+      {
+	std::cout << "GPU culling (" << (indirect() ? "indirect" : "read back")
+		  << "): " << visible() << " of " << uploaded << " visible, ";
+	if (occlusion)
+	  std::cout << occluded() << " occluded, " << average(REVEALED)
+		    << " revealed by the second pass, ";
+	std::cout << seconds * 1000.0 / frames << " ms CPU per frame"
+		  << std::endl;
+      }
+    for (int program = 0; program < PROGRAMS; program++)
+      if (programs[program].ID != 0)
+	{
+	  glDeleteProgram(programs[program].ID);
+	  programs[program].ID = 0;
+	}
+    GlState::forget(vao);
+    GlState::forget(occludedVao);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteVertexArrays(1, &occludedVao);
+    glDeleteBuffers(1, &records);
+    glDeleteBuffers(1, &occludedRecords);
+    glDeleteBuffers(PASSES, output);
+    glDeleteBuffers(PASSES, commands);
+    if (feedback != 0)
+      glDeleteTransformFeedbacks(1, &feedback);
+    for (int q = 0; q < QUERIES; q++)
+      glDeleteQueries(LATENCY, queries[q]);
+  }
+
+ private:
+  // an instance as the vertex shader reads it, and as the first pass
+  // of occlusion culling captures it
+  struct Record
+  {
+    glm::mat4 transform;
+    glm::vec4 sphere;
+    glm::vec3 low;
+    glm::vec3 high;
+  };
+
+  // the permutations of gpuCull.vs and gpuCull.gs
+  enum Program { FRUSTUM, OCCLUSION, OCCLUDED_RECORDS, PROGRAMS };
+  // a query per pass, and one for the records captured for the second
+  static const int OCCLUDED = PASSES;
+  static const int QUERIES = PASSES + 1;
+
+  Shader programs[PROGRAMS];
+  GLint planeLocations[PROGRAMS];
+  GLuint vao;
+  GLuint records;
+  // the records the first pass of occlusion culling found hidden, and
+  // the transform feedback object that knows how many there are
+  GLuint occludedVao;
+  GLuint occludedRecords;
+  GLuint feedback;
+  GLuint output[PASSES];
+  GLuint commands[PASSES];
+  size_t commandCount;
+  std::vector<Record> staged;
+  size_t uploaded;
+  GLuint queries[QUERIES][LATENCY];
+  bool issued[QUERIES][LATENCY];
+  // this frame's queries
+  unsigned int slot;
+  // the frames culled, and those whose queries were read
+  unsigned long frames;
+  unsigned long statisticsFrames;
+  unsigned long long totals[QUERIES];
+  double seconds;
+  bool occlusion;
+
+  unsigned long long average(int query) const
+  {
+    return statisticsFrames > 0 ? totals[query] / statisticsFrames : 0;
+  }
+
+  void build(Program program, const std::vector<std::string> &defines,
+	     const std::vector<const char*> &varyings)
+  {
+    programs[program].captureVaryings(varyings);
+    programs[program].submit("./gpuCull.vs", "./gpuCull.fs", "./gpuCull.gs",
+			     defines);
+    programs[program].finish();
+    planeLocations[program] = glGetUniformLocation(programs[program].ID,
+						   "planes");
+  }
+
+  // uploads the records if add() was called since, and reads the
+  // queries about to be reused, written LATENCY frames ago
+  void beginFrame()
+  {
+    if (uploaded != staged.size())
+      upload();
+    slot = frames % LATENCY;
+    if (frames < LATENCY)
+      return;
+    for (int q = 0; q < QUERIES; q++)
+      if (issued[q][slot])
+	{
+	  GLuint value = 0;
+	  glGetQueryObjectuiv(queries[q][slot], GL_QUERY_RESULT, &value);
+	  totals[q] += value;
+	  issued[q][slot] = false;
+	}
+    statisticsFrames++;
+  }
+
+  // what the query wrote this frame, waiting for it
+  GLsizei written(int query)
+  {
+    GLuint value = 0;
+    glGetQueryObjectuiv(queries[query][slot], GL_QUERY_RESULT, &value);
+    return value;
+  }
+
+  void use(Program program, const Frustum &frustum)
+  {
+    programs[program].use();
+    glUniform4fv(planeLocations[program], 6, &frustum.planes[0].x);
+  }
+
+  static void usePyramid(Shader &shader, const DepthPyramid &pyramid,
+			 const glm::mat4 &viewProjection)
+  {
+    GlState::bindTexture(0, GL_TEXTURE_2D, pyramid.texture());
+    shader.setInt("pyramid", 0);
+    shader.setMat4("pyramidViewProjection", viewProjection);
+    shader.setVec2("depthSize", pyramid.targetWidth(),
+		   pyramid.targetHeight());
+    shader.setInt("pyramidLevels", pyramid.levels());
+  }
+
+  // draws records of vertexArray as points through the program in use
+  // (the first count, or as many as the transform feedback object from
+  // captured) and captures what the program emits into target, through
+  // the transform feedback object into (0 for the default one)
+  void capture(GLuint vertexArray, GLuint from, GLsizei count, GLuint target,
+	       GLuint into, int query)
+  {
+    GlState::bindVertexArray(vertexArray);
+    GlState::enable(GL_RASTERIZER_DISCARD);
+    if (into != 0)
+      glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, into);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, target);
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN,
+		 queries[query][slot]);
+    glBeginTransformFeedback(GL_POINTS);
+    if (from != 0)
+      glDrawTransformFeedback(GL_POINTS, from);
+    else
+      glDrawArrays(GL_POINTS, 0, count);
+    glEndTransformFeedback();
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    if (into != 0)
+      glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    GlState::disable(GL_RASTERIZER_DISCARD);
+    issued[query][slot] = true;
+  }
+
+  // on the indirect path, has the GPU copy the pass's count into the
+  // commands once it has it; the CPU goes on
+  void writeCount(Pass pass)
+  {
+    if (!indirect() || commands[pass] == 0)
+      return;
+    glBindBuffer(GL_QUERY_BUFFER, commands[pass]);
+    for (size_t i = 0; i < commandCount; i++)
+      glGetQueryObjectuiv(queries[pass][slot], GL_QUERY_RESULT, (GLuint*)
+			  (i * sizeof(DrawElementsIndirectCommand) +
+			   offsetof(DrawElementsIndirectCommand,
+				    instanceCount)));
+    glBindBuffer(GL_QUERY_BUFFER, 0);
+  }
+
+  // points attributes 0 to 6 of the bound vertex array at the records
+  // in buffer
+  static void bindRecords(GLuint buffer)
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column < 4; column++)
+      {
+	glEnableVertexAttribArray(column);
+	glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(Record),
+			      (void*)(offsetof(Record, transform) +
+				      column * sizeof(glm::vec4)));
+      }
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Record),
+			  (void*)offsetof(Record, sphere));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(Record),
+			  (void*)offsetof(Record, low));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(Record),
+			  (void*)offsetof(Record, high));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  // room for an element per instance in a buffer transform feedback
+  // writes to
+  void reserve(GLuint buffer, size_t element)
+  {
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, buffer);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER,
+		 std::max<size_t>(staged.size(), 1) * element, NULL,
+		 GL_DYNAMIC_COPY);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+  }
+
+  void upload()
+  {
+    if (vao == 0)
+      {
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &records);
+	glGenBuffers(PASSES, output);
+	for (int q = 0; q < QUERIES; q++)
+	  glGenQueries(LATENCY, queries[q]);
+      }
+    GlState::bindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, records);
+    glBufferData(GL_ARRAY_BUFFER, staged.size() * sizeof(Record),
+		 staged.empty() ? NULL : &staged[0], GL_STATIC_DRAW);
+    bindRecords(records);
+    reserve(output[VISIBLE], sizeof(glm::mat4));
+    if (occlusion)
+      {
+	reserve(output[REVEALED], sizeof(glm::mat4));
+	reserve(occludedRecords, sizeof(Record));
+      }
+    uploaded = staged.size();
+  }
+
+  // builds what only occlusion culling needs, before its first frame
+  void startOcclusion()
+  {
+    occlusion = true;
+    build(OCCLUSION, std::vector<std::string>(1, "OCCLUSION"),
+	  std::vector<const char*>(1, "instanceModel"));
+    std::vector<std::string> defines;
+    defines.push_back("OCCLUSION");
+    defines.push_back("OCCLUDED");
+    const char* record[] = {
+      "recordModel", "recordSphere", "recordLow", "recordHigh"
+    };
+    build(OCCLUDED_RECORDS, defines,
+	  std::vector<const char*>(record, record + 4));
+
+    glGenBuffers(1, &occludedRecords);
+    glGenVertexArrays(1, &occludedVao);
+    GlState::bindVertexArray(occludedVao);
+    bindRecords(occludedRecords);
+    if (GLAD_GL_ARB_transform_feedback2)
+      glGenTransformFeedbacks(1, &feedback);
+    if (vao != 0)
+      {
+	reserve(output[REVEALED], sizeof(glm::mat4));
+	reserve(occludedRecords, sizeof(Record));
+      }
+  }
+
+  GpuCuller(const GpuCuller&);
+  GpuCuller& operator=(const GpuCuller&);
+};
+
+#endif
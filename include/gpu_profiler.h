@@ -0,0 +1,460 @@
+/*
+ * GPU time per pass. A scope is a pair of GL_TIMESTAMP queries written
+ * around a stretch of GL commands; scopes nest, and the platform opens
+ * a "frame" scope around every frame so the passes of a demo show up
+ * under it:
+ *
+ *   GpuProfiler::push("scene");
+ *   ... draw calls ...
+ *   GpuProfiler::pop();
+ *
+ * or GPU_SCOPE("scene") for the rest of a block. Both do nothing unless
+ * the demo runs with --profile or --bench.
+ *
+ * The queries of a frame are read back LATENCY frames later, when the
+ * GPU has long finished them, so reading the results never waits on
+ * the GPU; stalls() counts the times it had to anyway. For every scope
+ * the profiler keeps the average and the maximum per frame and a
+ * smoothed value for GpuProfilerOverlay, which draws one bar per scope
+ * in the corner of the screen.
+ *
+ */
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <gl_state.h>
+#include <shader.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class GpuProfiler
+{
+ public:
+  // frames between writing the queries of a frame and reading them
+  static const unsigned int LATENCY = 4;
+
+  struct Scope
+  {
+    std::string name;
+    int parent;
+    int depth;
+    // frames the scope appeared in since the last reset()
+    unsigned int frames;
+    double totalMs;
+    double maxMs;
+    double lastMs;
+    // exponential average, steadier than lastMs for display
+    double smoothedMs;
+  };
+
+  GpuProfiler()
+    : frameIndex(0), firstFrame(0), stallCount(0)
+  {
+    for (unsigned int i = 0; i < LATENCY; i++)
+      {
+	slots[i].frame = -1;
+	slots[i].used = 0;
+      }
+  }
+
+  ~GpuProfiler()
+  {
+    if (current() == this)
+      current() = NULL;
+    for (unsigned int i = 0; i < LATENCY; i++)
+      if (!slots[i].pool.empty())
+	glDeleteQueries(slots[i].pool.size(), &slots[i].pool[0]);
+  }
+
+  // the profiler push() and pop() report to, NULL when profiling is off
+  static GpuProfiler*& current()
+  {
+    static GpuProfiler* profiler = NULL;
+    return profiler;
+  }
+
+  // opens a scope in the active profiler
+  static void push(const char* name)
+  {
+    if (current() != NULL)
+      current()->begin(name);
+  }
+
+  // closes the innermost scope of the active profiler
+  static void pop()
+  {
+    if (current() != NULL)
+      current()->end();
+  }
+
+  // reads back the frame that used this slot before and opens the
+  // "frame" scope of the next one
+  void beginFrame()
+  {
+    Slot &slot = slots[frameIndex % LATENCY];
+    collect(slot, true);
+    slot.frame = frameIndex;
+    slot.used = 0;
+    slot.queries.clear();
+    begin("frame");
+  }
+
+  // closes every scope still open, "frame" last
+  void endFrame()
+  {
+    while (!stack.empty())
+      end();
+    frameIndex++;
+  }
+
+  void begin(const char* name)
+  {
+    int parent = stack.empty() ? -1 : stack.back();
+    std::map<std::pair<int, std::string>, int>::iterator it =
+      scopeIds.find(std::make_pair(parent, std::string(name)));
+    int id;
+    if (it != scopeIds.end())
+      id = it->second;
+    else
+      {
+	Scope scope = {name, parent, (int)stack.size(), 0, 0.0, 0.0, 0.0, 0.0};
+	id = scopeList.size();
+	scopeList.push_back(scope);
+	scopeIds[std::make_pair(parent, std::string(name))] = id;
+      }
+
+    Slot &slot = slots[frameIndex % LATENCY];
+    Query query;
+    query.scope = id;
+    query.begin = nextQuery(slot);
+    query.end = nextQuery(slot);
+    glQueryCounter(query.begin, GL_TIMESTAMP);
+    openQueries.push_back(slot.queries.size());
+    slot.queries.push_back(query);
+    stack.push_back(id);
+  }
+
+  void end()
+  {
+    if (stack.empty())
+      return;
+    Slot &slot = slots[frameIndex % LATENCY];
+    glQueryCounter(slot.queries[openQueries.back()].end, GL_TIMESTAMP);
+    openQueries.pop_back();
+    stack.pop_back();
+  }
+
+  // forgets the statistics; frames already in flight are not counted
+  void reset()
+  {
+    firstFrame = frameIndex;
+    stallCount = 0;
+    for (unsigned int i = 0; i < scopeList.size(); i++)
+      {
+	scopeList[i].frames = 0;
+	scopeList[i].totalMs = 0.0;
+	scopeList[i].maxMs = 0.0;
+      }
+  }
+
+  // reads back every frame still in flight, waiting for the GPU
+  void flush()
+  {
+    if (!stack.empty())
+      endFrame();
+    for (unsigned int i = 0; i < LATENCY; i++)
+      collect(slots[i], false);
+  }
+
+  // scopes in the order they were first opened, children after parents
+  const std::vector<Scope>& scopes() const
+  {
+    return scopeList;
+  }
+
+  // read backs that found the GPU still busy with the frame
+  unsigned int stalls() const
+  {
+    return stallCount;
+  }
+
+  double averageMs(const Scope &scope) const
+  {
+    return scope.frames > 0 ? scope.totalMs / scope.frames : 0.0;
+  }
+
+  // "frame 1.20 ms, scene 0.80 ms, ..." from the smoothed times
+  std::string summary() const
+  {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (unsigned int i = 0; i < scopeList.size(); i++)
+      out << (i > 0 ? ", " : "") << scopeList[i].name << " "
+	  << scopeList[i].smoothedMs << " ms";
+    return out.str();
+  }
+
+  // the scopes as a JSON array for the benchmark report
+  std::string json() const
+  {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4) << "[";
+    for (unsigned int i = 0; i < scopeList.size(); i++)
+      {
+	const Scope &scope = scopeList[i];
+	out << (i > 0 ? "," : "") << "\n    {\"name\": \"" << scope.name
+	    << "\", \"parent\": ";
+	if (scope.parent < 0)
+	  out << "null";
+	else
+	  out << "\"" << scopeList[scope.parent].name << "\"";
+	out << ", \"depth\": " << scope.depth
+	    << ", \"frames\": " << scope.frames
+	    << ", \"avg_ms\": " << averageMs(scope)
+	    << ", \"max_ms\": " << scope.maxMs << "}";
+      }
+    out << "\n  ]";
+    return out.str();
+  }
+
+ private:
+  struct Query
+  {
+    GLuint begin;
+    GLuint end;
+    int scope;
+  };
+
+  // the queries of one frame in flight
+  struct Slot
+  {
+    long frame;
+    std::vector<GLuint> pool;
+    unsigned int used;
+    std::vector<Query> queries;
+  };
+
+  Slot slots[LATENCY];
+  unsigned int frameIndex;
+  unsigned int firstFrame;
+  unsigned int stallCount;
+  std::vector<Scope> scopeList;
+  std::map<std::pair<int, std::string>, int> scopeIds;
+  // scope ids and their query indices of the scopes open right now
+  std::vector<int> stack;
+  std::vector<unsigned int> openQueries;
+  // per scope time of the frame being collected
+  std::vector<double> frameMs;
+
+  GLuint nextQuery(Slot &slot)
+  {
+    if (slot.used == slot.pool.size())
+      {
+	// query objects are kept for the next frame using this slot
+	GLuint query;
+	glGenQueries(1, &query);
+	slot.pool.push_back(query);
+      }
+    return slot.pool[slot.used++];
+  }
+
+  void collect(Slot &slot, bool countStall)
+  {
+    if (slot.frame < 0 || slot.queries.empty())
+      {
+	slot.frame = -1;
+	return;
+      }
+    GLint available = 0;
+    glGetQueryObjectiv(slot.queries[0].end, GL_QUERY_RESULT_AVAILABLE,
+		       &available);
+    if (!available && countStall)
+      stallCount++;
+
+    frameMs.assign(scopeList.size(), -1.0);
+    for (unsigned int i = 0; i < slot.queries.size(); i++)
+      {
+	GLuint64 begin = 0, end = 0;
+	glGetQueryObjectui64v(slot.queries[i].begin, GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(slot.queries[i].end, GL_QUERY_RESULT, &end);
+	double &ms = frameMs[slot.queries[i].scope];
+	// a scope opened twice in a frame adds up
+	ms = std::max(ms, 0.0) + (end > begin ? (end - begin) / 1.0e6 : 0.0);
+      }
+
+    bool counted = slot.frame >= (long)firstFrame;
+    for (unsigned int i = 0; i < scopeList.size(); i++)
+      {
+	if (frameMs[i] < 0.0)
+	  continue;
+	Scope &scope = scopeList[i];
+	scope.lastMs = frameMs[i];
+	scope.smoothedMs = scope.smoothedMs == 0.0 ? frameMs[i] :
+	  0.9 * scope.smoothedMs + 0.1 * frameMs[i];
+	if (counted)
+	  {
+	    scope.frames++;
+	    scope.totalMs += frameMs[i];
+	    scope.maxMs = std::max(scope.maxMs, frameMs[i]);
+	  }
+      }
+    slot.frame = -1;
+  }
+};
+
+// a scope from here to the end of the enclosing block
+class GpuScope
+{
+ public:
+  GpuScope(const char* name)
+  {
+    GpuProfiler::push(name);
+  }
+
+  ~GpuScope()
+  {
+    GpuProfiler::pop();
+  }
+};
+
+#define GPU_SCOPE_CONCAT2(a, b) a##b
+#define GPU_SCOPE_CONCAT(a, b) GPU_SCOPE_CONCAT2(a, b)
+#define GPU_SCOPE(name) GpuScope GPU_SCOPE_CONCAT(gpuScope, __LINE__)(name)
+
+// bars for the scopes of a profiler in the top left corner: one row per
+// scope, indented by its depth, as long as its smoothed time against a
+// 60 Hz frame with a tick at its maximum
+class GpuProfilerOverlay
+{
+ public:
+  GpuProfilerOverlay()
+    : shader("./profiler.vs", "./profiler.fs", nullptr)
+  {
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    GlState::bindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
+			  (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
+			  (void*)(2 * sizeof(GLfloat)));
+    GlState::bindVertexArray(0);
+  }
+
+  ~GpuProfilerOverlay()
+  {
+    GlState::forget(VAO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteProgram(shader.ID);
+  }
+
+  // draws over whatever is in the framebuffer, leaving the GL state
+  // the demo set up as it was
+  void draw(const GpuProfiler &profiler)
+  {
+    const std::vector<GpuProfiler::Scope> &scopes = profiler.scopes();
+    if (scopes.empty())
+      return;
+
+    const float frameMs = 1000.0f / 60.0f;
+    const float left = -0.98f, top = 0.98f, width = 0.6f, row = 0.045f;
+    vertices.clear();
+    // the 60 Hz budget behind the bars
+    addQuad(left, top, width, row * scopes.size(), 0.1f, 0.1f, 0.1f);
+    for (unsigned int i = 0; i < scopes.size(); i++)
+      {
+	const GpuProfiler::Scope &scope = scopes[i];
+	float y = top - i * row;
+	float x = left + scope.depth * 0.02f;
+	float length = std::min((float)scope.smoothedMs / frameMs, 1.0f) *
+	  width;
+	// a color per scope that stays put from frame to frame
+	float hue = (i * 0.381966f) - (int)(i * 0.381966f);
+	addQuad(x, y - row * 0.15f, length, row * 0.7f,
+		0.4f + 0.6f * hue, 0.9f - 0.5f * hue, 0.3f + 0.4f * hue);
+	float tick = std::min((float)scope.maxMs / frameMs, 1.0f) * width;
+	addQuad(x + tick, y, 0.004f, row, 1.0f, 1.0f, 1.0f);
+      }
+
+    // what to put back comes from the GlState shadow; GL is only asked
+    // (a round trip on a threaded driver) for what the shadow does not
+    // know, and the restore below teaches it that for the next frame
+    GLuint program = known(GlState::boundProgram(), GL_CURRENT_PROGRAM);
+    GLuint vertexArray = known(GlState::boundVertexArray(),
+			       GL_VERTEX_ARRAY_BINDING);
+    bool depthTest = enabled(GL_DEPTH_TEST);
+    bool stencilTest = enabled(GL_STENCIL_TEST);
+    bool cullFace = enabled(GL_CULL_FACE);
+    bool blend = enabled(GL_BLEND);
+    // through the cache, whose shadow has to end up as GL is left
+    GlState::disable(GL_DEPTH_TEST);
+    GlState::disable(GL_STENCIL_TEST);
+    GlState::disable(GL_CULL_FACE);
+    GlState::disable(GL_BLEND);
+
+    shader.use();
+    GlState::bindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+		 &vertices[0], GL_STREAM_DRAW);
+    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 5);
+
+    GlState::useProgram(program);
+    GlState::bindVertexArray(vertexArray);
+    GlState::setCap(GL_DEPTH_TEST, depthTest);
+    GlState::setCap(GL_STENCIL_TEST, stencilTest);
+    GlState::setCap(GL_CULL_FACE, cullFace);
+    GlState::setCap(GL_BLEND, blend);
+  }
+
+ private:
+  Shader shader;
+  GLuint VAO;
+  GLuint VBO;
+  std::vector<GLfloat> vertices;
+
+  static GLuint known(long shadowed, GLenum name)
+  {
+    if (shadowed >= 0)
+      return shadowed;
+    GLint value;
+    glGetIntegerv(name, &value);
+    return value;
+  }
+
+  static bool enabled(GLenum cap)
+  {
+    long shadowed = GlState::capability(cap);
+    return shadowed >= 0 ? shadowed != 0 : glIsEnabled(cap) == GL_TRUE;
+  }
+
+  // two triangles from the top left corner (x, y) down and right
+  void addQuad(float x, float y, float w, float h, float r, float g, float b)
+  {
+    const float corners[6][2] = {
+      {x, y}, {x, y - h}, {x + w, y - h},
+      {x, y}, {x + w, y - h}, {x + w, y}
+    };
+    for (int i = 0; i < 6; i++)
+      {
+	vertices.push_back(corners[i][0]);
+	vertices.push_back(corners[i][1]);
+	vertices.push_back(r);
+	vertices.push_back(g);
+	vertices.push_back(b);
+      }
+  }
+};
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * Counts the heap allocations of the program per frame and per
+ * subsystem, so an allocation that creeps into a per-frame path shows
+ * up in the next run.
+ *
+ *   HEAP_SCOPE("Mesh::Draw");   // to the end of the block
+ *
+ * Built with MODERNOPENGL_TRACK_ALLOCATIONS (cmake -DTRACK_ALLOCATIONS=ON)
+ * every demo is linked with src/heap_tracker.cpp, which defines
+ * HEAP_TRACKER_IMPLEMENTATION and so the global operator new and delete
+ * below. They go to malloc and free and count each allocation and its
+ * bytes against the tag of the innermost HEAP_SCOPE on the calling
+ * thread. Outside every scope that is tag 0, "demo": the demo's own
+ * code. Each thread counts in its own slot, so threads do not contend.
+ * One shared counter of the bytes alive gives the peak.
+ *
+ * endFrame() (called by the platform after the swap) rolls the slots
+ * into lastFrame(): the allocations, bytes and peak bytes alive during
+ * the frame, in total and per tag. The platform prints a summary on
+ * exit, a benchmark reports the frames under heap_allocations,
+ * heap_bytes, heap_peak_bytes and heap_tags, and --trace adds them as
+ * counter tracks.
+ *
+ * Without the define the scopes compile to nothing and the counters
+ * stay 0.
+ *
+ */
+#ifndef HEAP_TRACKER_H
+#define HEAP_TRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+class HeapTracker
+{
+ public:
+  static const int MAX_TAGS = 16;
+  // threads past this share the last slot
+  static const int MAX_THREADS = 64;
+
+  struct Counters
+  {
+    unsigned long allocations;
+    unsigned long long bytes;
+  };
+
+  struct Frame
+  {
+    Counters total;
+    // the most bytes alive at once
+    unsigned long long peak;
+    Counters tags[MAX_TAGS];
+  };
+
+  // whether the allocations are tracked in this build
+  static bool enabled()
+  {
+#ifdef MODERNOPENGL_TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // the number of a tag, given out on first use
+  static int tag(const char* name)
+  {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (int i = 0; i < r.tagCount; i++)
+      if (strcmp(r.tags[i], name) == 0)
+	return i;
+    if (r.tagCount == MAX_TAGS)
+      return 0;
+    r.tags[r.tagCount] = name;
+    return r.tagCount++;
+  }
+
+  static int tagCount()
+  {
+    return registry().tagCount;
+  }
+
+  static const char* tagName(int tag)
+  {
+    return registry().tags[tag];
+  }
+
+  // makes the calling thread count against a tag until the end of the
+  // scope
+  class Scope
+  {
+   public:
+    explicit Scope(int tag) : previous(currentTag())
+    {
+      currentTag() = tag;
+    }
+
+    ~Scope()
+    {
+      currentTag() = previous;
+    }
+
+   private:
+    int previous;
+  };
+
+  // counted by operator new and delete
+  static void allocated(size_t size)
+  {
+    Registry &r = registry();
+    Slot &s = slot();
+    int t = currentTag();
+    s.allocations[t].fetch_add(1, std::memory_order_relaxed);
+    s.bytes[t].fetch_add(size, std::memory_order_relaxed);
+    unsigned long long live =
+      r.live.fetch_add(size, std::memory_order_relaxed) + size;
+    unsigned long long peak = r.peak.load(std::memory_order_relaxed);
+    while (live > peak &&
+	   !r.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+      ;
+  }
+
+  static void freed(size_t size)
+  {
+    registry().live.fetch_sub(size, std::memory_order_relaxed);
+  }
+
+  // what every thread allocated since the program started
+  static Counters total(int tag)
+  {
+    Registry &r = registry();
+    Counters counters = { 0, 0 };
+    for (int i = 0; i < MAX_THREADS; i++)
+      {
+	counters.allocations +=
+	  r.slots[i].allocations[tag].load(std::memory_order_relaxed);
+	counters.bytes += r.slots[i].bytes[tag].load(std::memory_order_relaxed);
+      }
+    return counters;
+  }
+
+  // rolls the counters over into lastFrame(), once per frame
+  static void endFrame()
+  {
+    Registry &r = registry();
+    Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (int t = 0; t < MAX_TAGS; t++)
+      {
+	Counters now = total(t);
+	frame.tags[t].allocations = now.allocations - r.seen[t].allocations;
+	frame.tags[t].bytes = now.bytes - r.seen[t].bytes;
+	frame.total.allocations += frame.tags[t].allocations;
+	frame.total.bytes += frame.tags[t].bytes;
+	r.seen[t] = now;
+      }
+    frame.peak = r.peak.exchange(r.live.load(std::memory_order_relaxed),
+				 std::memory_order_relaxed);
+    r.last = frame;
+  }
+
+  static const Frame& lastFrame()
+  {
+    return registry().last;
+  }
+
+ private:
+  struct Slot
+  {
+    std::atomic<unsigned long> allocations[MAX_TAGS];
+    std::atomic<unsigned long long> bytes[MAX_TAGS];
+  };
+
+  // nothing in here allocates, it is reached from operator new
+  struct Registry
+  {
+    std::mutex mutex;
+    const char* tags[MAX_TAGS];
+    int tagCount;
+    Slot slots[MAX_THREADS];
+    std::atomic<int> nextSlot;
+    std::atomic<unsigned long long> live;
+    std::atomic<unsigned long long> peak;
+    // totals at the last endFrame()
+    Counters seen[MAX_TAGS];
+    Frame last;
+
+    Registry() : tagCount(1), nextSlot(0), live(0), peak(0)
+    {
+      tags[0] = "demo";
+      for (int i = 0; i < MAX_THREADS; i++)
+	for (int t = 0; t < MAX_TAGS; t++)
+	  {
+	    slots[i].allocations[t].store(0, std::memory_order_relaxed);
+	    slots[i].bytes[t].store(0, std::memory_order_relaxed);
+	  }
+      memset(seen, 0, sizeof(seen));
+      memset(&last, 0, sizeof(last));
+    }
+  };
+
+  static Registry& registry()
+  {
+    static Registry instance;
+    return instance;
+  }
+
+  static int& currentTag()
+  {
+    static thread_local int tag = 0;
+    return tag;
+  }
+
+  static Slot& slot()
+  {
+    static thread_local int index = -1;
+    if (index < 0)
+      {
+	index = registry().nextSlot.fetch_add(1, std::memory_order_relaxed);
+	if (index >= MAX_THREADS)
+	  index = MAX_THREADS - 1;
+      }
+    return registry().slots[index];
+  }
+};
+
+#ifdef MODERNOPENGL_TRACK_ALLOCATIONS
+
+#define HEAP_SCOPE_CONCAT2(a, b) a##b
+#define HEAP_SCOPE_CONCAT(a, b) HEAP_SCOPE_CONCAT2(a, b)
+#define HEAP_SCOPE(name)						\
+  static const int HEAP_SCOPE_CONCAT(heapTag, __LINE__) =		\
+    HeapTracker::tag(name);						\
+  HeapTracker::Scope HEAP_SCOPE_CONCAT(heapScope, __LINE__)		\
+    (HEAP_SCOPE_CONCAT(heapTag, __LINE__))
+
+#ifdef HEAP_TRACKER_IMPLEMENTATION
+
+namespace heap_tracker_detail {
+  // each block starts with its size, padded to keep the alignment new
+  // promises
+  static const size_t HEADER = alignof(std::max_align_t);
+
+  inline void* allocate(size_t size)
+  {
+    char* base = (char*)malloc(size + HEADER);
+    if (base == NULL)
+      return NULL;
+    *(size_t*)base = size;
+    HeapTracker::allocated(size);
+    return base + HEADER;
+  }
+
+  inline void release(void* p)
+  {
+    if (p == NULL)
+      return;
+    char* base = (char*)p - HEADER;
+    HeapTracker::freed(*(size_t*)base);
+    free(base);
+  }
+}
+
+void* operator new(std::size_t size)
+{
+  void* p = heap_tracker_detail::allocate(size);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return heap_tracker_detail::allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return heap_tracker_detail::allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  heap_tracker_detail::release(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  heap_tracker_detail::release(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  heap_tracker_detail::release(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  heap_tracker_detail::release(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p, std::size_t) noexcept
+{
+  heap_tracker_detail::release(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  heap_tracker_detail::release(p);
+}
+#endif
+
+#endif
+
+#else
+
+#define HEAP_SCOPE(name)
+
+#endif
+
+#endif
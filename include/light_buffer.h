@@ -0,0 +1,320 @@
+/*
+ * All scene lights packed into one std140 uniform block (Lights in
+ * lights.glsl) that every lighting program reads from the same binding
+ * point. The CPU side fills plain structs and upload() sends them in
+ * one call per frame, instead of one glUniform per light member.
+ *
+ * Above MAX_UBO_POINT_LIGHTS the point lights move to a buffer texture
+ * (programs are then built with the LIGHTS_IN_TBO define, see defines())
+ * so the number of lights is only limited by memory.
+ *
+ */
+#ifndef LIGHT_BUFFER_H
+#define LIGHT_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <buffer_layout.h>
+#include <gl_state.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// CPU mirrors of the structs in lighting.glsl, padded to std140
+struct DirLight
+{
+  glm::vec3 direction;
+  float padding0;
+  glm::vec3 ambient;
+  float padding1;
+  glm::vec3 diffuse;
+  float padding2;
+  glm::vec3 specular;
+  float padding3;
+};
+typedef GpuBlock<Std140, glm::vec3, glm::vec3, glm::vec3, glm::vec3>
+DirLightLayout;
+GPU_LAYOUT_MEMBER(DirLight, direction, DirLightLayout, 0);
+GPU_LAYOUT_MEMBER(DirLight, ambient, DirLightLayout, 1);
+GPU_LAYOUT_MEMBER(DirLight, diffuse, DirLightLayout, 2);
+GPU_LAYOUT_MEMBER(DirLight, specular, DirLightLayout, 3);
+GPU_LAYOUT_SIZE(DirLight, DirLightLayout);
+
+struct PointLight
+{
+  glm::vec3 position;
+  float constant;
+  float linear;
+  float quadratic;
+  float padding0[2];
+  glm::vec3 ambient;
+  float padding1;
+  glm::vec3 diffuse;
+  float padding2;
+  glm::vec3 specular;
+  float padding3;
+};
+typedef GpuBlock<Std140, glm::vec3, float, float, float, glm::vec3, glm::vec3,
+		 glm::vec3> PointLightLayout;
+GPU_LAYOUT_MEMBER(PointLight, position, PointLightLayout, 0);
+GPU_LAYOUT_MEMBER(PointLight, constant, PointLightLayout, 1);
+GPU_LAYOUT_MEMBER(PointLight, linear, PointLightLayout, 2);
+GPU_LAYOUT_MEMBER(PointLight, quadratic, PointLightLayout, 3);
+GPU_LAYOUT_MEMBER(PointLight, ambient, PointLightLayout, 4);
+GPU_LAYOUT_MEMBER(PointLight, diffuse, PointLightLayout, 5);
+GPU_LAYOUT_MEMBER(PointLight, specular, PointLightLayout, 6);
+GPU_LAYOUT_SIZE(PointLight, PointLightLayout);
+
+struct SpotLight
+{
+  glm::vec3 position;
+  float padding0;
+  glm::vec3 direction;
+  float cutOff;
+  float outerCutOff;
+  float padding1[3];
+  glm::vec3 ambient;
+  float padding2;
+  glm::vec3 diffuse;
+  float padding3;
+  glm::vec3 specular;
+  float constant;
+  float linear;
+  float quadratic;
+  float padding4[2];
+};
+typedef GpuBlock<Std140, glm::vec3, glm::vec3, float, float, glm::vec3,
+		 glm::vec3, glm::vec3, float, float, float> SpotLightLayout;
+GPU_LAYOUT_MEMBER(SpotLight, position, SpotLightLayout, 0);
+GPU_LAYOUT_MEMBER(SpotLight, direction, SpotLightLayout, 1);
+GPU_LAYOUT_MEMBER(SpotLight, cutOff, SpotLightLayout, 2);
+GPU_LAYOUT_MEMBER(SpotLight, outerCutOff, SpotLightLayout, 3);
+GPU_LAYOUT_MEMBER(SpotLight, ambient, SpotLightLayout, 4);
+GPU_LAYOUT_MEMBER(SpotLight, diffuse, SpotLightLayout, 5);
+GPU_LAYOUT_MEMBER(SpotLight, specular, SpotLightLayout, 6);
+GPU_LAYOUT_MEMBER(SpotLight, constant, SpotLightLayout, 7);
+GPU_LAYOUT_MEMBER(SpotLight, linear, SpotLightLayout, 8);
+GPU_LAYOUT_MEMBER(SpotLight, quadratic, SpotLightLayout, 9);
+GPU_LAYOUT_SIZE(SpotLight, SpotLightLayout);
+
+// lights.glsl reads a point light as 5 RGBA32F texels (LIGHTS_IN_TBO)
+static_assert(sizeof(PointLight) == 5 * 4 * sizeof(float),
+	      "PointLight must be 5 texels long");
+
+// the part of the Lights block in front of the point light array
+struct LightHeader
+{
+  DirLight dirLight;
+  SpotLight spotLight;
+  int nrPointLights;
+  int padding[3];
+};
+typedef GpuBlock<Std140, DirLightLayout, SpotLightLayout, int>
+LightHeaderLayout;
+GPU_LAYOUT_MEMBER(LightHeader, dirLight, LightHeaderLayout, 0);
+GPU_LAYOUT_MEMBER(LightHeader, spotLight, LightHeaderLayout, 1);
+GPU_LAYOUT_MEMBER(LightHeader, nrPointLights, LightHeaderLayout, 2);
+GPU_LAYOUT_SIZE(LightHeader, LightHeaderLayout);
+
+// helpers to fill the light structs, value-initialized so the padding
+// going to the GPU is zero
+inline DirLight makeDirLight(glm::vec3 direction, glm::vec3 ambient,
+			     glm::vec3 diffuse, glm::vec3 specular)
+{
+  DirLight light = DirLight();
+  light.direction = direction;
+  light.ambient = ambient;
+  light.diffuse = diffuse;
+  light.specular = specular;
+  return light;
+}
+
+inline PointLight makePointLight(glm::vec3 position, glm::vec3 ambient,
+				 glm::vec3 diffuse, glm::vec3 specular,
+				 float constant = 1.0f, float linear = 0.0f,
+				 float quadratic = 0.0f)
+{
+  PointLight light = PointLight();
+  light.position = position;
+  light.ambient = ambient;
+  light.diffuse = diffuse;
+  light.specular = specular;
+  light.constant = constant;
+  light.linear = linear;
+  light.quadratic = quadratic;
+  return light;
+}
+
+inline SpotLight makeSpotLight(glm::vec3 position, glm::vec3 direction,
+			       float cutOff, float outerCutOff,
+			       glm::vec3 ambient, glm::vec3 diffuse,
+			       glm::vec3 specular, float constant = 1.0f,
+			       float linear = 0.0f, float quadratic = 0.0f)
+{
+  SpotLight light = SpotLight();
+  light.position = position;
+  light.direction = direction;
+  light.cutOff = cutOff;
+  light.outerCutOff = outerCutOff;
+  light.ambient = ambient;
+  light.diffuse = diffuse;
+  light.specular = specular;
+  light.constant = constant;
+  light.linear = linear;
+  light.quadratic = quadratic;
+  return light;
+}
+
+class LightBuffer
+{
+ public:
+  // uniform block binding point of Lights, shared by every program
+  static const GLuint BINDING = 1;
+  // texture unit of the point light buffer texture (LIGHTS_IN_TBO)
+  static const GLuint TEXTURE_UNIT = 15;
+  // size of the point light array in the block, as in lights.glsl
+  static const unsigned int MAX_UBO_POINT_LIGHTS = 64;
+
+  typedef GpuBlock<Std140, DirLightLayout, SpotLightLayout, int,
+		   GpuArray<PointLightLayout, MAX_UBO_POINT_LIGHTS> >
+  LightsLayout;
+  static_assert(LightsLayout::offset<3>() == sizeof(LightHeader),
+		"point lights must follow the header");
+
+  // scene lights, upload() sends them
+  DirLight dirLight;
+  SpotLight spotLight;
+  std::vector<PointLight> pointLights;
+
+  // maxPointLights is the most point lights the scene will ever use
+  LightBuffer(unsigned int maxPointLights = MAX_UBO_POINT_LIGHTS)
+    : capacity(maxPointLights), texture(0), texelBuffer(0)
+  {
+    dirLight = DirLight();
+    spotLight = SpotLight();
+
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    if (usesTexture())
+      glBufferData(GL_UNIFORM_BUFFER, LightHeaderLayout::size(), NULL,
+		   GL_DYNAMIC_DRAW);
+    else
+      glBufferData(GL_UNIFORM_BUFFER, LightsLayout::size(), NULL,
+		   GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+
+    if (usesTexture())
+      {
+	glGenBuffers(1, &texelBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, texelBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(PointLight), NULL,
+		     GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glGenTextures(1, &texture);
+	GlState::bindTexture(TEXTURE_UNIT, GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, texelBuffer);
+	GlState::activeTexture(0);
+      }
+
+    staging.resize(LightHeaderLayout::size() +
+		   (usesTexture() ? 0 : capacity * sizeof(PointLight)));
+  }
+
+  // true when point lights are stored in a buffer texture
+  bool usesTexture() const
+  {
+    return capacity > MAX_UBO_POINT_LIGHTS;
+  }
+
+  // defines the lighting programs have to be built with
+  std::vector<std::string> defines() const
+  {
+    std::vector<std::string> result;
+    if (usesTexture())
+      result.push_back("LIGHTS_IN_TBO");
+    return result;
+  }
+
+  // connects a program's Lights block (and point light texture) to
+  // this buffer and checks the block layout against the program
+  void attach(const Shader &shader) const
+  {
+    GLuint blockIndex = glGetUniformBlockIndex(shader.ID, "Lights");
+    if (blockIndex == GL_INVALID_INDEX)
+      {
+	std::cout << "ERROR::LIGHTS::NO_LIGHTS_BLOCK program " << shader.ID
+		  << std::endl;
+	return;
+      }
+    glUniformBlockBinding(shader.ID, blockIndex, BINDING);
+
+    std::vector<std::string> names;
+    names.push_back("dirLight.direction");
+    names.push_back("spotLight.position");
+    names.push_back("nrPointLights");
+    if (usesTexture())
+      {
+	checkBlockLayout<LightHeaderLayout>(shader.ID, "Lights", names);
+	GLint program;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	GlState::useProgram(shader.ID);
+	shader.setInt("pointLightTexels", TEXTURE_UNIT);
+	GlState::useProgram(program);
+      }
+    else
+      {
+	names.push_back("pointLights[0].position");
+	checkBlockLayout<LightsLayout>(shader.ID, "Lights", names);
+      }
+  }
+
+  // sends every light to the GPU, one upload per buffer
+  void upload()
+  {
+    unsigned int count = pointLights.size();
+    if (count > capacity)
+      {
+	std::cout << "ERROR::LIGHTS::TOO_MANY_POINT_LIGHTS " << count
+		  << " (max " << capacity << ")" << std::endl;
+	count = capacity;
+      }
+
+    LightHeader header = LightHeader();
+    header.dirLight = dirLight;
+    header.spotLight = spotLight;
+    header.nrPointLights = count;
+    memcpy(&staging[0], &header, sizeof(header));
+    unsigned int size = sizeof(header);
+    if (!usesTexture() && count > 0)
+      {
+	memcpy(&staging[size], &pointLights[0], count * sizeof(PointLight));
+	size += count * sizeof(PointLight);
+      }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, &staging[0]);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    if (usesTexture() && count > 0)
+      {
+	glBindBuffer(GL_TEXTURE_BUFFER, texelBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, count * sizeof(PointLight),
+			&pointLights[0]);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+      }
+  }
+
+ private:
+  unsigned int capacity;
+  GLuint ubo;
+  GLuint texture;
+  GLuint texelBuffer;
+  std::vector<unsigned char> staging;
+};
+
+#endif
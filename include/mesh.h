@@ -6,6 +6,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <frame_arena.h>
+#include <heap_tracker.h>
 #include <shader.h>
 
 #include <string>
@@ -25,6 +27,15 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// the layout glDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -53,54 +64,131 @@ public:
     // render the mesh
     void Draw(Shader &shader) 
     {
-        // bind appropriate textures
+        HEAP_SCOPE("Mesh::Draw");
+        bindTextures(shader);
+        
+        // draw mesh, the VAO stays bound so drawing the same mesh again
+        // binds nothing
+        GlState::bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+
+        // always good practice to set everything back to defaults once configured.
+        GlState::activeTexture(0);
+    }
+
+    // render count copies of the mesh in one draw. instanceBuffer holds a
+    // mat4 model matrix per instance from offset on, read through
+    // attributes 5 to 8 (layout (location = 5) in mat4 aInstanceModel;)
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, GLsizei count, GLintptr offset = 0)
+    {
+        HEAP_SCOPE("Mesh::Draw");
+        bindTextures(shader);
+
+        GlState::bindVertexArray(VAO);
+        bindInstances(instanceBuffer, offset);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, count);
+
+        GlState::activeTexture(0);
+    }
+
+    // the command that draws the whole mesh, instanceCount copies
+    DrawElementsIndirectCommand indirectCommand(GLuint instanceCount = 0) const
+    {
+        DrawElementsIndirectCommand command = { (GLuint)indices.size(), instanceCount, 0, 0, 0 };
+        return command;
+    }
+
+    // like DrawInstanced, but the draw is read from the
+    // DrawElementsIndirectCommand at command in indirectBuffer, so the
+    // GPU can write the instance count (needs ARB_draw_indirect)
+    void DrawInstancedIndirect(Shader &shader, unsigned int instanceBuffer, unsigned int indirectBuffer,
+                               GLintptr command)
+    {
+        HEAP_SCOPE("Mesh::Draw");
+        bindTextures(shader);
+
+        GlState::bindVertexArray(VAO);
+        bindInstances(instanceBuffer, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)command);
+
+        GlState::activeTexture(0);
+    }
+
+    // the first of the four attributes of the instance matrix
+    static const unsigned int INSTANCE_ATTRIBUTE = 5;
+
+private:
+    // render data 
+    unsigned int VBO, EBO;
+    // where the instance attributes point, 0 and -1 before DrawInstanced
+    unsigned int instanceBuffer;
+    GLintptr instanceOffset;
+
+    // points the instance attributes of the bound VAO at the model
+    // matrices from offset on in instanceBuffer. They are repointed only
+    // when the buffer or the offset changes, a streamed buffer moves
+    // every frame
+    void bindInstances(unsigned int instanceBuffer, GLintptr offset)
+    {
+        if (instanceBuffer == this->instanceBuffer && offset == instanceOffset)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + column);
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void*)(offset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE + column, 1);
+        }
+        this->instanceBuffer = instanceBuffer;
+        instanceOffset = offset;
+    }
+
+    // bind appropriate textures
+    void bindTextures(Shader &shader)
+    {
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        FrameArena &arena = FrameArena::frame();
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
+            unsigned int number = 0;
+            const string &name = textures[i].type;
             if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
+                number = diffuseNr++;
             else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
+                number = specularNr++;
             else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
+                number = normalNr++;
              else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+                number = heightNr++;
+
+            // now set the sampler to the correct texture unit, the name
+            // is built in the frame arena rather than on the heap
+            StringView uniform = number > 0 ?
+                arena.format("%s%u", name.c_str(), number) : StringView(name);
+            shader.setInt(uniform.c_str(), i);
+            // and finally bind the texture, the state cache skips it
+            // (and the unit switch) when the last mesh used the same one
+            GlState::bindTexture(i, GL_TEXTURE_2D, textures[i].id);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        instanceBuffer = 0;
+        instanceOffset = -1;
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GlState::bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -128,7 +216,7 @@ private:
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-        glBindVertexArray(0);
+        GlState::bindVertexArray(0);
     }
 };
 #endif
@@ -13,6 +13,8 @@
 
 #include <mesh.h>
 #include <shader.h>
+#include <cpu_profiler.h>
+#include <heap_tracker.h>
 
 #include <string>
 #include <fstream>
@@ -45,14 +47,44 @@ public:
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
+
+    // draws count instances of the model, one draw per mesh, with the
+    // model matrices read from instanceBuffer (see Mesh::DrawInstanced)
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, GLsizei count, GLintptr offset = 0)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instanceBuffer, count, offset);
+    }
+
+    // one indirect command per mesh, in the order DrawInstancedIndirect
+    // reads them
+    vector<DrawElementsIndirectCommand> indirectCommands(GLuint instanceCount = 0) const
+    {
+        vector<DrawElementsIndirectCommand> commands;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            commands.push_back(meshes[i].indirectCommand(instanceCount));
+        return commands;
+    }
+
+    // draws mesh i with command i of indirectBuffer (see indirectCommands)
+    void DrawInstancedIndirect(Shader &shader, unsigned int instanceBuffer, unsigned int indirectBuffer)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstancedIndirect(shader, instanceBuffer, indirectBuffer,
+                                            i * sizeof(DrawElementsIndirectCommand));
+    }
     
 private:
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        PROFILE_ZONE("Model::loadModel");
+        HEAP_SCOPE("Model::loadModel");
         // read file via ASSIMP
         Assimp::Importer importer;
+        PROFILE_BEGIN("Assimp import");
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        PROFILE_END();
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -87,6 +119,7 @@ private:
 
     Mesh processMesh(aiMesh *mesh, const aiScene *scene)
     {
+        PROFILE_ZONE("Model::processMesh");
         // data to fill
         vector<Vertex> vertices;
         vector<unsigned int> indices;
@@ -213,7 +246,9 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
+    PROFILE_BEGIN("stbi_load");
     unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    PROFILE_END();
     if (data)
     {
         GLenum format;
@@ -224,7 +259,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GlState::bindTexture(0, GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -0,0 +1,746 @@
+/*
+ * The window, GL context and main loop plumbing shared by every demo.
+ *
+ * By default a GLFW window is opened as before. With --headless the
+ * context comes from EGL on Mesa's surfaceless platform instead, so no
+ * display or X server is needed, and the demo renders into an
+ * offscreen framebuffer (framebuffer() replaces framebuffer 0).
+ * --frames N stops the main loop after N frames; a headless run does
+ * 100 frames unless told otherwise.
+ *
+ * --bench N turns the loop into a benchmark (bench.h): --warmup W
+ * frames (30 by default) are rendered first, then N frames are
+ * recorded with a fixed 60 Hz timestep, vsync off and the camera input
+ * replaced by a script, and the report is written to
+ * <demo>.bench.json or the file given with --bench-out.
+ *
+ * --profile times the GPU passes (gpu_profiler.h), draws them as bars
+ * over the frame, shows them in the window title and prints the
+ * averages on exit. A benchmark always times them for its report.
+ *
+ * --trace FILE writes the CPU zones (cpu_profiler.h) as a Chrome trace
+ * on exit, in builds with the CPU profiler compiled in.
+ *
+ * The loop runs as fast as the swap lets it unless told otherwise:
+ * --fps N paces it to N frames per second by sleeping out the rest of
+ * each frame, --uncapped also turns vsync off, and --on-demand draws a
+ * window only when something changed: an input event, a camera move
+ * (camera_recorder.h) or requestRedraw(), which a demo that animates
+ * calls every frame. In between it sleeps in
+ * glfwWaitEvents and time() stands still, so animations pause rather
+ * than jump. A benchmark always runs uncapped.
+ *
+ * --record-camera FILE and --replay-camera FILE save and play back the
+ * camera path (camera_recorder.h); a replay ignores the mouse and
+ * keyboard like a benchmark does.
+ *
+ * --capture PATH writes every frame as it was presented, to PNG files
+ * or a Y4M video depending on PATH (frame_capture.h), without waiting
+ * on the GPU.
+ *
+ * --gl-stats counts the GL calls of every frame (gl_intercept.h) and
+ * prints the calls per frame, the redundant ones and the uploaded bytes
+ * on exit. The first frame includes the demo's setup. A benchmark
+ * always counts them for its report.
+ *
+ * At the end of every frame the FrameArena (frame_arena.h) is reset.
+ * Built with -DTRACK_ALLOCATIONS=ON (heap_tracker.h) the platform also
+ * closes the heap counters of every frame, adds them to --trace as
+ * counter tracks and prints on exit what the frames and each tag
+ * allocated.
+ *
+ * --threads N sets how many threads demos that spread CPU work over
+ * cores use (threads()), all hardware threads by default.
+ *
+ * --optimized-shaders loads the copies of the shaders the build
+ * optimized (OPTIMIZE_SHADERS) where there are any.
+ *
+ * --instances N sets how many objects the instancing stress demos draw
+ * (instances()). What such a demo measures goes into the benchmark
+ * report through report().
+ *
+ *   Platform platform(argc, argv);
+ *   if (!platform.createWindow(800, 600, "LearnOpenGL"))
+ *     return -1;
+ *   while (platform.running())
+ *     {
+ *       ...
+ *       platform.endFrame();
+ *     }
+ *   platform.terminate();
+ *
+ */
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <bench.h>
+#include <cpu_profiler.h>
+#include <frame_arena.h>
+#include <frame_capture.h>
+#include <gl_intercept.h>
+#include <gpu_profiler.h>
+#include <heap_tracker.h>
+#include <shader.h>
+
+#ifdef MODERNOPENGL_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+class Platform
+{
+ public:
+  Platform(int argc, char* argv[])
+    : headlessMode(false), maxFrames(0), frames(0), closed(false),
+      terminated(false), handle(NULL), width(0), height(0), fbo(0),
+      colorBuffer(0), depthBuffer(0), bench(NULL), cursorCallback(NULL),
+      profileMode(false), profiler(NULL), overlay(NULL), glStats(false),
+      capture(NULL), loopMode(LOOP_DEFAULT), targetFps(0.0),
+      redrawRequested(true), idleSeconds(0.0),
+      workerThreads(0), instanceCount(0), steadyAllocations(0), peakBytes(0)
+  {
+#ifdef MODERNOPENGL_EGL
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+#endif
+    bool framesGiven = false;
+    unsigned int benchFrames = 0;
+    unsigned int warmup = 30;
+    const char* benchOutput = NULL;
+    for (int i = 1; i < argc; i++)
+      {
+	if (strcmp(argv[i], "--headless") == 0)
+	  headlessMode = true;
+	else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+	  {
+	    maxFrames = strtoul(argv[++i], NULL, 10);
+	    framesGiven = true;
+	  }
+	else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+	  benchFrames = strtoul(argv[++i], NULL, 10);
+	else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+	  warmup = strtoul(argv[++i], NULL, 10);
+	else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc)
+	  benchOutput = argv[++i];
+	else if (strcmp(argv[i], "--profile") == 0)
+	  profileMode = true;
+	else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+	  tracePath = argv[++i];
+	else if (strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc)
+	  cameraRecordPath = argv[++i];
+	else if (strcmp(argv[i], "--replay-camera") == 0 && i + 1 < argc)
+	  cameraReplayPath = argv[++i];
+	else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+	  capturePath = argv[++i];
+	else if (strcmp(argv[i], "--on-demand") == 0)
+	  loopMode = LOOP_ON_DEMAND;
+	else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+	  {
+	    loopMode = LOOP_PACED;
+	    targetFps = strtod(argv[++i], NULL);
+	  }
+	else if (strcmp(argv[i], "--uncapped") == 0)
+	  loopMode = LOOP_UNCAPPED;
+	else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+	  workerThreads = strtoul(argv[++i], NULL, 10);
+	else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+	  instanceCount = strtoul(argv[++i], NULL, 10);
+	else if (strcmp(argv[i], "--gl-stats") == 0)
+	  glStats = true;
+	else if (strcmp(argv[i], "--optimized-shaders") == 0)
+	  Shader::preferOptimized() = true;
+      }
+    // a headless run has nobody to close it
+    if (headlessMode && !framesGiven)
+      maxFrames = 100;
+
+    if (benchFrames > 0)
+      {
+	// the demo is named after its executable
+	std::string name = argc > 0 ? argv[0] : "demo";
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+	  name = name.substr(slash + 1);
+	bench = new Bench(name, benchFrames, warmup, 1.0 / 60.0);
+	if (benchOutput != NULL)
+	  bench->setOutput(benchOutput);
+	maxFrames = bench->totalFrames();
+	loopMode = LOOP_UNCAPPED;
+      }
+    if (loopMode == LOOP_PACED && targetFps <= 0.0)
+      loopMode = LOOP_DEFAULT;
+  }
+
+  ~Platform()
+  {
+    terminate();
+  }
+
+  // creates the window (or the offscreen framebuffer) with a current
+  // OpenGL 3.3 core context and loads the GL functions
+  bool createWindow(int width, int height, const char* title)
+  {
+    this->width = width;
+    this->height = height;
+    this->title = title;
+    start = std::chrono::steady_clock::now();
+    if (headlessMode)
+      {
+	if (!createHeadless())
+	  return false;
+	startFrames();
+	return true;
+      }
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    handle = glfwCreateWindow(width, height, title, NULL, NULL);
+    if (handle == NULL)
+      {
+	std::cout << "Failed to create GLFW window" << std::endl;
+	glfwTerminate();
+	return false;
+      }
+    glfwMakeContextCurrent(handle);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+      {
+	std::cout << "Failed to initialize GLAD" << std::endl;
+	return false;
+      }
+    // measure the frames, not the display's refresh rate
+    if (loopMode == LOOP_UNCAPPED)
+      glfwSwapInterval(0);
+    startFrames();
+    return true;
+  }
+
+  bool headless() const
+  {
+    return headlessMode;
+  }
+
+  // the GLFW window, NULL when headless
+  GLFWwindow* window() const
+  {
+    return handle;
+  }
+
+  // the framebuffer that stands for the screen: 0 with a window, the
+  // offscreen one when headless
+  GLuint framebuffer() const
+  {
+    return fbo;
+  }
+
+  // the size of framebuffer() in pixels, which a HiDPI screen makes
+  // larger than the window
+  void framebufferSize(int &width, int &height) const
+  {
+    width = this->width;
+    height = this->height;
+    if (handle != NULL)
+      glfwGetFramebufferSize(handle, &width, &height);
+  }
+
+  // input callbacks only exist with a window; a benchmark drives the
+  // cursor callback from its script instead, a camera replay ignores it
+  void setFramebufferSizeCallback(GLFWframebuffersizefun callback)
+  {
+    if (handle != NULL)
+      glfwSetFramebufferSizeCallback(handle, callback);
+  }
+
+  void setCursorPosCallback(GLFWcursorposfun callback)
+  {
+    cursorCallback = callback;
+    if (handle != NULL && !scriptedInput())
+      glfwSetCursorPosCallback(handle, callback);
+  }
+
+  void setScrollCallback(GLFWscrollfun callback)
+  {
+    if (handle != NULL && !scriptedInput())
+      glfwSetScrollCallback(handle, callback);
+  }
+
+  // hides the cursor and keeps it in the window, for mouse look
+  void captureCursor()
+  {
+    if (handle != NULL)
+      glfwSetInputMode(handle, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  }
+
+  // false once the window is closed or the frame limit is reached
+  bool running() const
+  {
+    if (closed || (maxFrames != 0 && frames >= maxFrames))
+      return false;
+    return handle == NULL || !glfwWindowShouldClose(handle);
+  }
+
+  // presents the frame and processes window events
+  void endFrame()
+  {
+    HEAP_SCOPE("Platform::endFrame");
+    frames++;
+    if (profiler != NULL)
+      {
+	profiler->endFrame();
+	if (capture != NULL)
+	  capture->capture(fbo);
+	if (overlay != NULL)
+	  overlay->draw(*profiler);
+      }
+    else if (capture != NULL)
+      capture->capture(fbo);
+    if (bench != NULL)
+      bench->endFrame();
+    PROFILE_BEGIN("swap");
+    if (handle != NULL)
+      glfwSwapBuffers(handle);
+    else
+      glFlush();
+    PROFILE_END();
+    waitForNextFrame();
+    // the frame ends with the swap
+    PROFILE_END();
+    if (GlIntercept::installed())
+      GlIntercept::endFrame();
+    GlState::endFrame();
+    Shader::endFrame();
+    FrameArena::frame().reset();
+    if (HeapTracker::enabled())
+      trackAllocations();
+
+    if (bench != NULL)
+      {
+	if (cursorCallback != NULL && cameraReplayPath.empty())
+	  {
+	    double x, y;
+	    bench->cursor(time(), width, height, x, y);
+	    cursorCallback(handle, x, y);
+	  }
+	bench->beginFrame();
+      }
+
+    if (profiler != NULL)
+      {
+	if (profileMode && handle != NULL && frames % 30 == 0)
+	  glfwSetWindowTitle(handle,
+			     (title + " | " + profiler->summary()).c_str());
+	if (running())
+	  profiler->beginFrame();
+      }
+    if (running())
+      PROFILE_BEGIN("frame");
+  }
+
+  // makes an --on-demand loop draw the next frame, for changes it cannot
+  // see by itself
+  void requestRedraw()
+  {
+    redrawRequested = true;
+  }
+
+  // the frame count --frames or --bench stops at, 0 when unbounded
+  unsigned int frameLimit() const
+  {
+    return maxFrames;
+  }
+
+  // threads to spread the CPU work of a frame over, --threads or the
+  // number of hardware threads
+  unsigned int threads() const
+  {
+    if (workerThreads > 0)
+      return workerThreads;
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+  }
+
+  // objects a stress demo draws, --instances or the demo's default
+  unsigned int instances(unsigned int fallback) const
+  {
+    return instanceCount > 0 ? instanceCount : fallback;
+  }
+
+  // adds "key": json to the benchmark report, nothing outside a
+  // benchmark; call it before terminate()
+  void report(const std::string &key, const std::string &json)
+  {
+    if (bench != NULL)
+      bench->addSection(key, json);
+  }
+
+  // number of frames ended so far
+  unsigned int frame() const
+  {
+    return frames;
+  }
+
+  // seconds since the window was created, advancing by a fixed step
+  // per frame in a benchmark and not at all while --on-demand sleeps
+  double time() const
+  {
+    if (bench != NULL)
+      return bench->time(frames);
+    if (handle != NULL)
+      return glfwGetTime() - idleSeconds;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()
+					 - start).count();
+  }
+
+  // true while the key is held down; there is no keyboard headless, a
+  // camera replay only listens to escape and so does a benchmark, its
+  // script presses the rest
+  bool keyPressed(int key) const
+  {
+    if (!cameraReplayPath.empty() && key != GLFW_KEY_ESCAPE)
+      return false;
+    if (bench != NULL && key != GLFW_KEY_ESCAPE)
+      return bench->keyPressed(key, time());
+    return handle != NULL && glfwGetKey(handle, key) == GLFW_PRESS;
+  }
+
+  // the files given with --record-camera and --replay-camera, empty
+  // without them
+  const std::string& cameraRecording() const
+  {
+    return cameraRecordPath;
+  }
+
+  const std::string& cameraReplay() const
+  {
+    return cameraReplayPath;
+  }
+
+  // makes running() return false
+  void close()
+  {
+    closed = true;
+    if (handle != NULL)
+      glfwSetWindowShouldClose(handle, true);
+  }
+
+  // releases the window or the headless context
+  void terminate()
+  {
+    if (terminated)
+      return;
+    terminated = true;
+    if (!tracePath.empty())
+      writeTrace();
+    if (capture != NULL)
+      {
+	capture->finish();
+	delete capture;
+	capture = NULL;
+      }
+    if (bench != NULL)
+      {
+	bench->finish();
+	delete bench;
+	bench = NULL;
+      }
+    if (HeapTracker::enabled() && frames > 0)
+      printAllocations();
+    if (GlIntercept::installed())
+      {
+	if (glStats)
+	  std::cout << GlIntercept::report();
+	GlIntercept::uninstall();
+      }
+    if (profiler != NULL)
+      {
+	if (profileMode)
+	  printProfile();
+	delete overlay;
+	delete profiler;
+	overlay = NULL;
+	profiler = NULL;
+      }
+    if (headlessMode)
+      {
+#ifdef MODERNOPENGL_EGL
+	if (context != EGL_NO_CONTEXT)
+	  {
+	    glFinish();
+	    std::cout << "rendered " << frames << " frames headless in "
+		      << time() << " s" << std::endl;
+	    glDeleteFramebuffers(1, &fbo);
+	    glDeleteRenderbuffers(1, &colorBuffer);
+	    glDeleteRenderbuffers(1, &depthBuffer);
+	    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			   EGL_NO_CONTEXT);
+	    eglDestroyContext(display, context);
+	  }
+	if (display != EGL_NO_DISPLAY)
+	  eglTerminate(display);
+#endif
+      }
+    else
+      glfwTerminate();
+  }
+
+ private:
+  bool headlessMode;
+  unsigned int maxFrames;
+  unsigned int frames;
+  bool closed;
+  bool terminated;
+  GLFWwindow* handle;
+  int width;
+  int height;
+  GLuint fbo;
+  GLuint colorBuffer;
+  GLuint depthBuffer;
+  std::chrono::steady_clock::time_point start;
+  Bench* bench;
+  GLFWcursorposfun cursorCallback;
+  bool profileMode;
+  GpuProfiler* profiler;
+  GpuProfilerOverlay* overlay;
+  bool glStats;
+  std::string capturePath;
+  FrameCapture* capture;
+
+  enum LoopMode { LOOP_DEFAULT, LOOP_UNCAPPED, LOOP_PACED, LOOP_ON_DEMAND };
+  LoopMode loopMode;
+  double targetFps;
+  std::chrono::steady_clock::time_point deadline;
+  bool redrawRequested;
+  double idleSeconds;
+  unsigned int workerThreads;
+  unsigned int instanceCount;
+  // the most heap allocations (heap_tracker.h) in a frame once the demo
+  // settled, and the most bytes alive at once
+  enum { SETTLE_FRAMES = 10 };
+  unsigned long steadyAllocations;
+  unsigned long long peakBytes;
+  std::string title;
+  std::string tracePath;
+  std::string cameraRecordPath;
+  std::string cameraReplayPath;
+#ifdef MODERNOPENGL_EGL
+  EGLDisplay display;
+  EGLContext context;
+#endif
+
+  void trackAllocations()
+  {
+    HeapTracker::endFrame();
+    const HeapTracker::Frame &frame = HeapTracker::lastFrame();
+    if (frames > SETTLE_FRAMES &&
+	frame.total.allocations > steadyAllocations)
+      steadyAllocations = frame.total.allocations;
+    if (frame.peak > peakBytes)
+      peakBytes = frame.peak;
+    PROFILE_COUNTER("heap allocations", frame.total.allocations);
+    PROFILE_COUNTER("heap bytes", frame.total.bytes);
+    PROFILE_COUNTER("heap peak bytes", frame.peak);
+  }
+
+  void printAllocations()
+  {
+    const HeapTracker::Frame &frame = HeapTracker::lastFrame();
+    std::cout << "heap allocations: " << frame.total.allocations
+	      << " in the last frame, at most " << steadyAllocations
+	      << " per frame after frame " << SETTLE_FRAMES << "; peak "
+	      << peakBytes << " bytes alive; frame arena high water "
+	      << FrameArena::frame().highWater() << " bytes" << std::endl;
+    for (int t = 0; t < HeapTracker::tagCount(); t++)
+      {
+	HeapTracker::Counters total = HeapTracker::total(t);
+	std::cout << "  " << HeapTracker::tagName(t) << ": "
+		  << total.allocations << " allocations, " << total.bytes
+		  << " bytes in all" << std::endl;
+      }
+  }
+
+  // processes the window events, and sleeps first if the loop policy
+  // says so
+  void waitForNextFrame()
+  {
+    if (loopMode == LOOP_PACED)
+      {
+	std::chrono::steady_clock::time_point now =
+	  std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration period =
+	  std::chrono::duration_cast<std::chrono::steady_clock::duration>
+	  (std::chrono::duration<double>(1.0 / targetFps));
+	// the deadlines follow a fixed grid so the rate does not drift, but
+	// a frame that ran over starts the grid again
+	deadline += period;
+	if (deadline < now)
+	  deadline = now;
+	else
+	  std::this_thread::sleep_until(deadline);
+      }
+    if (handle == NULL)
+      return;
+
+    if (loopMode == LOOP_ON_DEMAND && !redrawRequested && running())
+      {
+	double before = glfwGetTime();
+	glfwWaitEvents();
+	idleSeconds += glfwGetTime() - before;
+      }
+    else
+      glfwPollEvents();
+    redrawRequested = false;
+  }
+
+  // the mouse and keyboard are replaced by a script or a recording
+  bool scriptedInput() const
+  {
+    return bench != NULL || !cameraReplayPath.empty();
+  }
+
+  // sets up the benchmark, the profilers and the GL call counts once the
+  // context exists
+  void startFrames()
+  {
+    deadline = std::chrono::steady_clock::now();
+    if (glStats)
+      GlIntercept::install();
+    if (!capturePath.empty())
+      {
+	int captureWidth, captureHeight;
+	framebufferSize(captureWidth, captureHeight);
+	capture = new FrameCapture(capturePath, captureWidth, captureHeight);
+      }
+    if (bench != NULL || profileMode)
+      {
+	profiler = new GpuProfiler();
+	GpuProfiler::current() = profiler;
+      }
+    if (profileMode)
+      overlay = new GpuProfilerOverlay();
+    if (bench != NULL)
+      {
+	bench->setProfiler(profiler);
+	bench->start(width, height, headlessMode);
+      }
+    if (profiler != NULL)
+      profiler->beginFrame();
+    PROFILE_BEGIN("frame");
+  }
+
+  void writeTrace()
+  {
+#ifdef MODERNOPENGL_PROFILE
+    // the frame left open by the last endFrame()
+    PROFILE_END();
+    if (CpuProfiler::writeTrace(tracePath))
+      std::cout << "CPU trace written to " << tracePath << std::endl;
+    else
+      std::cout << "ERROR::PLATFORM::TRACE_NOT_WRITTEN " << tracePath
+		<< std::endl;
+#else
+    std::cout << "Built without MODERNOPENGL_PROFILE, --trace is not "
+	      << "available" << std::endl;
+#endif
+  }
+
+  void printProfile()
+  {
+    profiler->flush();
+    const std::vector<GpuProfiler::Scope> &scopes = profiler->scopes();
+    std::cout << "GPU time per frame:" << std::endl;
+    for (unsigned int i = 0; i < scopes.size(); i++)
+      std::cout << std::string(2 + 2 * scopes[i].depth, ' ')
+		<< scopes[i].name << ": avg " << profiler->averageMs(scopes[i])
+		<< " ms, max " << scopes[i].maxMs << " ms" << std::endl;
+  }
+
+  bool createHeadless()
+  {
+#ifdef MODERNOPENGL_EGL
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+      eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL)
+      display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+				   EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+      {
+	std::cout << "Failed to open the EGL surfaceless display" << std::endl;
+	return false;
+      }
+    // no config and no surface, everything is drawn into the fbo
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (extensions == NULL ||
+	strstr(extensions, "EGL_KHR_surfaceless_context") == NULL ||
+	strstr(extensions, "EGL_KHR_no_config_context") == NULL)
+      {
+	std::cout << "EGL has no surfaceless contexts" << std::endl;
+	return false;
+      }
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint attributes[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 3,
+      EGL_CONTEXT_MINOR_VERSION, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE
+    };
+    context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT,
+			       attributes);
+    if (context == EGL_NO_CONTEXT ||
+	!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+      {
+	std::cout << "Failed to create the EGL context" << std::endl;
+	return false;
+      }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+      {
+	std::cout << "Failed to initialize GLAD" << std::endl;
+	return false;
+      }
+
+    // the offscreen stand-in for the window's framebuffer
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			      GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+			      GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      {
+	std::cout << "ERROR::PLATFORM:: offscreen framebuffer is not complete"
+		  << std::endl;
+	return false;
+      }
+    // with no surface the viewport starts out empty
+    glViewport(0, 0, width, height);
+    return true;
+#else
+    std::cout << "Built without EGL, --headless is not available"
+	      << std::endl;
+    return false;
+#endif
+  }
+};
+
+#endif
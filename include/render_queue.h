@@ -0,0 +1,266 @@
+/*
+ * Collects the draws of a frame and submits them in an order that keeps
+ * state changes down, instead of the order the code happens to issue
+ * them in.
+ *
+ *   RenderQueue queue;
+ *   queue.setEye(camera.Position);
+ *   DrawPacket cube;
+ *   cube.shader = &shader;
+ *   cube.vao = cubeVAO;
+ *   cube.addTexture(cubeTexture);
+ *   cube.count = 36;
+ *   cube.model = model;
+ *   queue.submit(cube);
+ *   ...
+ *   queue.execute();
+ *
+ * Every packet gets a 64 bit key, most significant field first:
+ *
+ *   opaque       pass | program | material | VAO   | depth
+ *   transparent  pass | far to near depth  | program | material | VAO
+ *
+ * The material is a small number given to each distinct set of textures.
+ * The depth is the distance from the eye to the origin of the packet's
+ * model matrix, quantized over setDepthRange(). Opaque draws sort by
+ * state and go front to back within a state, so early depth rejection
+ * still works. Transparent draws sort back to front first, which is what
+ * blending needs.
+ *
+ * execute() radix sorts the keys (8 bits per pass, and a pass whose
+ * digit is the same for every key is skipped), then draws through
+ * GlState. It sets the pass state (blending for TRANSPARENT), the
+ * program, the VAO, the textures and the "model" uniform. The Shader
+ * uniform cache and the state cache drop what did not change, so after
+ * sorting only real changes reach GL. Uniforms shared by every draw,
+ * such as view and projection, are set on the shaders before execute().
+ * The queue keeps its buffers from frame to frame and does not allocate
+ * once the draw count has settled.
+ *
+ */
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <gl_state.h>
+#include <shader.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// one draw call and the state it needs
+struct DrawPacket
+{
+  static const unsigned int MAX_TEXTURES = 4;
+
+  unsigned int pass;
+  Shader* shader;
+  GLuint vao;
+  // bound to units 0, 1, ... as GL_TEXTURE_2D
+  GLuint textures[MAX_TEXTURES];
+  unsigned int textureCount;
+  GLenum mode;
+  GLint first;
+  GLsizei count;
+  // 0 for glDrawArrays, else the index type of glDrawElements
+  GLenum indexType;
+  const void* indices;
+  glm::mat4 model;
+
+  DrawPacket()
+    : pass(0), shader(NULL), vao(0), textureCount(0), mode(GL_TRIANGLES),
+      first(0), count(0), indexType(0), indices(NULL), model(1.0f)
+  {
+  }
+
+  void addTexture(GLuint texture)
+  {
+    if (textureCount < MAX_TEXTURES)
+      textures[textureCount++] = texture;
+  }
+};
+
+class RenderQueue
+{
+ public:
+  // passes run in this order
+  enum Pass { OPAQUE = 0, TRANSPARENT = 1 };
+
+  RenderQueue()
+    : eye(0.0f), nearDepth(0.0f), farDepth(100.0f)
+  {
+  }
+
+  // where the depth of the packets is measured from
+  void setEye(const glm::vec3 &eye)
+  {
+    this->eye = eye;
+  }
+
+  // the distances the depth keys are spread over, anything outside is
+  // clamped
+  void setDepthRange(float nearDepth, float farDepth)
+  {
+    this->nearDepth = nearDepth;
+    this->farDepth = farDepth;
+  }
+
+  void submit(const DrawPacket &packet)
+  {
+    packets.push_back(packet);
+    Item item;
+    item.key = key(packet);
+    item.index = packets.size() - 1;
+    items.push_back(item);
+  }
+
+  // number of packets submitted since the last execute()
+  size_t size() const
+  {
+    return packets.size();
+  }
+
+  // sorts and draws the packets, and empties the queue
+  void execute()
+  {
+    sort();
+    long pass = -1;
+    for (size_t i = 0; i < items.size(); i++)
+      {
+	const DrawPacket &packet = packets[items[i].index];
+	if ((long)packet.pass != pass)
+	  {
+	    pass = packet.pass;
+	    applyPass(packet.pass);
+	  }
+	packet.shader->use();
+	GlState::bindVertexArray(packet.vao);
+	for (unsigned int t = 0; t < packet.textureCount; t++)
+	  GlState::bindTexture(t, GL_TEXTURE_2D, packet.textures[t]);
+	packet.shader->setMat4("model", packet.model);
+	if (packet.indexType == 0)
+	  glDrawArrays(packet.mode, packet.first, packet.count);
+	else
+	  glDrawElements(packet.mode, packet.count, packet.indexType,
+			 packet.indices);
+      }
+    packets.clear();
+    items.clear();
+  }
+
+ private:
+  struct Item
+  {
+    uint64_t key;
+    uint32_t index;
+  };
+
+  static const int PASS_BITS = 2;
+  static const int PROGRAM_BITS = 10;
+  static const int MATERIAL_BITS = 14;
+  static const int VAO_BITS = 14;
+  static const int DEPTH_BITS = 24;
+
+  std::vector<DrawPacket> packets;
+  std::vector<Item> items;
+  std::vector<Item> scratch;
+  // texture sets to material numbers, kept for the life of the queue so
+  // a material keeps its place in the order
+  std::unordered_map<uint64_t, uint32_t> materials;
+  glm::vec3 eye;
+  float nearDepth;
+  float farDepth;
+
+  static uint64_t field(uint64_t value, int bits)
+  {
+    return value & ((1ull << bits) - 1);
+  }
+
+  uint64_t key(const DrawPacket &packet)
+  {
+    uint64_t pass = field(packet.pass, PASS_BITS);
+    uint64_t program = field(packet.shader->ID, PROGRAM_BITS);
+    uint64_t material = field(materialOf(packet), MATERIAL_BITS);
+    uint64_t vao = field(packet.vao, VAO_BITS);
+
+    float distance = glm::length(glm::vec3(packet.model[3]) - eye);
+    float range = farDepth > nearDepth ? farDepth - nearDepth : 1.0f;
+    float unit = (distance - nearDepth) / range;
+    unit = unit < 0.0f ? 0.0f : unit > 1.0f ? 1.0f : unit;
+    uint64_t maxDepth = (1ull << DEPTH_BITS) - 1;
+    uint64_t depth = (uint64_t)(unit * maxDepth);
+
+    uint64_t key = pass;
+    if (packet.pass == TRANSPARENT)
+      {
+	key = (key << DEPTH_BITS) | (maxDepth - depth);
+	key = (key << PROGRAM_BITS) | program;
+	key = (key << MATERIAL_BITS) | material;
+	key = (key << VAO_BITS) | vao;
+      }
+    else
+      {
+	key = (key << PROGRAM_BITS) | program;
+	key = (key << MATERIAL_BITS) | material;
+	key = (key << VAO_BITS) | vao;
+	key = (key << DEPTH_BITS) | depth;
+      }
+    return key;
+  }
+
+  uint32_t materialOf(const DrawPacket &packet)
+  {
+    uint64_t set = 0;
+    for (unsigned int t = 0; t < packet.textureCount; t++)
+      set = (set << 16) ^ (packet.textures[t] + 1);
+    std::unordered_map<uint64_t, uint32_t>::iterator it = materials.find(set);
+    if (it != materials.end())
+      return it->second;
+    uint32_t material = materials.size();
+    materials[set] = material;
+    return material;
+  }
+
+  // least significant digit radix sort of the items by key; stable, so
+  // equal keys keep their submission order
+  void sort()
+  {
+    scratch.resize(items.size());
+    for (int shift = 0; shift < 64; shift += 8)
+      {
+	size_t counts[256] = { 0 };
+	for (size_t i = 0; i < items.size(); i++)
+	  counts[(items[i].key >> shift) & 0xff]++;
+	// every key has the same digit here, the pass would change nothing
+	if (items.empty() ||
+	    counts[(items[0].key >> shift) & 0xff] == items.size())
+	  continue;
+	size_t offset = 0;
+	for (int d = 0; d < 256; d++)
+	  {
+	    size_t count = counts[d];
+	    counts[d] = offset;
+	    offset += count;
+	  }
+	for (size_t i = 0; i < items.size(); i++)
+	  scratch[counts[(items[i].key >> shift) & 0xff]++] = items[i];
+	items.swap(scratch);
+      }
+  }
+
+  static void applyPass(unsigned int pass)
+  {
+    if (pass == TRANSPARENT)
+      {
+	GlState::enable(GL_BLEND);
+	GlState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      }
+    else
+      GlState::disable(GL_BLEND);
+  }
+};
+
+#endif
@@ -4,10 +4,18 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <cpu_profiler.h>
+#include <gl_state.h>
+#include <heap_tracker.h>
+
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 class Shader
 {
@@ -15,161 +23,515 @@ class Shader
   // the program ID
   unsigned int ID;
 
+  // default constructor, the program is built later with submit()
+  Shader() : ID(0), vertex(0), fragment(0), geometry(0)
+  {
+  }
+
   // constructor
   Shader(const char* vertexPath, const char* fragmentPath,
 	 const char* geometryPath)
+    : ID(0), vertex(0), fragment(0), geometry(0)
   {
-    // 1. retrieve the vertex/fragement source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::string geometryCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    std::ifstream gShaderFile;
+    submit(vertexPath, fragmentPath, geometryPath);
+    finish();
+  }
 
-    // ensure ifstream objects can throw exceptions
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    try
-      {
-	// open files
-	vShaderFile.open(vertexPath);
-	fShaderFile.open(fragmentPath);
-	// read file's buffer contents into streams
-	std::stringstream vShaderStream, fShaderStream;
-	vShaderStream << vShaderFile.rdbuf();
-	fShaderStream << fShaderFile.rdbuf();
-	// close file handlers
-	vShaderFile.close();
-	fShaderFile.close();
-	// convert stream into string
-	vertexCode = vShaderStream.str();
-	fragmentCode = fShaderStream.str();
-	// if geometry shader is present
-	if(geometryPath != nullptr)
-	  {
-	    gShaderFile.open(geometryPath);
-	    std::stringstream gShaderStream;
-	    gShaderStream << gShaderFile.rdbuf();
-	    gShaderFile.close();
-	    geometryCode = gShaderStream.str();
-	  }
-      }
-    catch(std::ifstream::failure e)
+  // constructor for a permutation, each define is "NAME" or
+  // "NAME=VALUE" and is injected right after the #version line
+  Shader(const char* vertexPath, const char* fragmentPath,
+	 const char* geometryPath, const std::vector<std::string> &defines)
+    : ID(0), vertex(0), fragment(0), geometry(0)
+  {
+    submit(vertexPath, fragmentPath, geometryPath, defines);
+    finish();
+  }
+
+  // reads the sources and hands compiling and linking to the driver
+  // without asking for the result, so several programs can be built
+  // at once; call finish() before the program is used
+  void submit(const char* vertexPath, const char* fragmentPath,
+	      const char* geometryPath,
+	      const std::vector<std::string> &defines =
+	      std::vector<std::string>())
+  {
+    PROFILE_ZONE("Shader::submit");
+    // 0. prefer the copies the build optimized, they only exist for
+    // the default permutation and are used when every stage has one
+    std::string vertexFile = vertexPath;
+    std::string fragmentFile = fragmentPath;
+    std::string geometryFile = geometryPath != nullptr ? geometryPath : "";
+    // (the optimizer may rename or drop the outputs a transform
+    // feedback captures, so those programs always use the sources)
+    if (defines.empty() && feedbackVaryings.empty() && preferOptimized() &&
+	exists(optimizedPath(vertexFile)) &&
+	exists(optimizedPath(fragmentFile)) &&
+	(geometryPath == nullptr || exists(optimizedPath(geometryFile))))
       {
-	std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ"
-		  << std::endl;
+	vertexFile = optimizedPath(vertexFile);
+	fragmentFile = optimizedPath(fragmentFile);
+	if (geometryPath != nullptr)
+	  geometryFile = optimizedPath(geometryFile);
       }
+
+    // 1. retrieve the vertex/fragment source code from filePath,
+    // expanding #include lines and adding the defines
+    std::string vertexCode = preprocess(vertexFile, defines);
+    std::string fragmentCode = preprocess(fragmentFile, defines);
+    std::string geometryCode;
+    if(geometryPath != nullptr)
+      geometryCode = preprocess(geometryFile, defines);
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
 
-    // compile shaders
-    unsigned int vertex, fragment;
-    int success;
-    char infoLog[512];
-
+    // compile shaders, the status is checked in finish()
     // vertex shader
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
 
     // fragment shader
     fragment = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment, 1, &fShaderCode, NULL);
     glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
     
     // geometry shader if present
-    GLuint geometry;
     if(geometryPath != nullptr)
       {
 	const char* gShaderCode = geometryCode.c_str();
 	geometry = glCreateShader(GL_GEOMETRY_SHADER);
 	glShaderSource(geometry, 1, &gShaderCode, NULL);
 	glCompileShader(geometry);
-	checkCompileErrors(geometry, "GEOMETRY");
       }
     
-    // Shader program
+    // Shader program, a new program starts with no shadowed uniforms
+    uniforms.clear();
+    uniformIndex.clear();
     ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
-    if(geometryPath != nullptr)
+    if(geometry != 0)
       glAttachShader(ID, geometry);
+    if (!feedbackVaryings.empty())
+      glTransformFeedbackVaryings(ID, feedbackVaryings.size(),
+				  &feedbackVaryings[0], GL_INTERLEAVED_ATTRIBS);
     glLinkProgram(ID);
+  }
+
+  // outputs of the last stage before rasterization to capture with
+  // transform feedback, interleaved in one buffer; call before submit()
+  void captureVaryings(const std::vector<const char*> &varyings)
+  {
+    feedbackVaryings = varyings;
+  }
+
+  // returns true once the driver is done compiling and linking.
+  // With KHR_parallel_shader_compile this never blocks; without it
+  // the program is always reported ready and finish() waits instead
+  bool isReady() const
+  {
+    if (!GLAD_GL_KHR_parallel_shader_compile &&
+	!GLAD_GL_ARB_parallel_shader_compile)
+      return true;
+    GLint completed = GL_FALSE;
+    glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+  }
+
+  // reports compile/link errors and releases the shader objects
+  void finish()
+  {
+    PROFILE_ZONE("Shader::finish");
+    checkCompileErrors(vertex, "VERTEX");
+    checkCompileErrors(fragment, "FRAGMENT");
+    if (geometry != 0)
+      checkCompileErrors(geometry, "GEOMETRY");
     checkCompileErrors(ID, "PROGRAM");
 
     // delete shaders, no longer needed
     glDeleteShader(vertex);
     glDeleteShader(fragment);
-    if (geometryPath != nullptr)
+    if (geometry != 0)
       glDeleteShader(geometry);
+    vertex = fragment = geometry = 0;
   }
 
 
-  // use/activate the shader
+  // whether submit() loads the build-time optimized shaders from
+  // optimized/ (see cmake/OptimizeShader.cmake), off unless asked for
+  // (--optimized-shaders): spirv-cross may rename the block instances
+  // and struct members that the uniform lookups go by name
+  static bool& preferOptimized()
+  {
+    static bool prefer = false;
+    return prefer;
+  }
+
+  // path of the optimized copy of a shader file
+  static std::string optimizedPath(const std::string &path)
+  {
+    std::string::size_type slash = path.find_last_of('/');
+    if (slash == std::string::npos)
+      return "optimized/" + path;
+    return path.substr(0, slash + 1) + "optimized/" + path.substr(slash + 1);
+  }
+
+  // returns the source of a shader file with every
+  // #include "file" replaced by that file (paths are relative to the
+  // including file, each file is included once) and the defines
+  // inserted after #version. #line directives keep the line numbers
+  // of compile errors pointing into the original files
+  static std::string preprocess(const std::string &path,
+				const std::vector<std::string> &defines)
+  {
+    std::set<std::string> included;
+    std::vector<std::string> files;
+    std::string source = expand(path, included, files);
+
+    std::string header;
+    for (unsigned int i = 0; i < defines.size(); i++)
+      {
+	std::string define = defines[i];
+	std::string::size_type equals = define.find('=');
+	if (equals != std::string::npos)
+	  define[equals] = ' ';
+	header += "#define " + define + "\n";
+      }
+    if (header.empty())
+      return source;
+
+    // #version has to stay the first statement
+    std::string::size_type version = source.find("#version");
+    std::string::size_type insertAt = 0;
+    if (version != std::string::npos)
+      {
+	insertAt = source.find('\n', version);
+	insertAt = insertAt == std::string::npos ? source.size() : insertAt + 1;
+	header += "#line 2 0\n";
+      }
+    else
+      header += "#line 1 0\n";
+    return source.insert(insertAt, header);
+  }
+
+  // use/activate the shader, a no-op when it is already in use
   void use()
   {
-    glUseProgram(ID);
+    GlState::useProgram(ID);
+  }
+
+  // uniform upload counters, shared by every program. The values set
+  // on a program are shadowed on the CPU and a setter whose value did
+  // not change since the last call never reaches GL
+  struct UniformStats {
+    unsigned int issued;
+    unsigned int skipped;
+  };
+  // counters of the frame in progress
+  static UniformStats& stats()
+  {
+    static UniformStats counters = {0, 0};
+    return counters;
+  }
+  // counters of the last completed frame
+  static UniformStats& lastFrameStats()
+  {
+    static UniformStats counters = {0, 0};
+    return counters;
+  }
+  // rolls the counters over, Platform::endFrame calls it after the swap
+  static void endFrame()
+  {
+    lastFrameStats() = stats();
+    stats().issued = 0;
+    stats().skipped = 0;
   }
+
   // utility uniform functions
+  void setBool(const char* name, bool value) const
+  {
+    setInt(name, (int)value);
+  }
+  void setInt(const char* name, int value) const
+  {
+    PROFILE_ZONE("Shader::setInt");
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, &value, sizeof(value)))
+      glUniform1i(uniform.location, value);
+  }
+  void setFloat(const char* name, float value) const
+  {
+    PROFILE_ZONE("Shader::setFloat");
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, &value, sizeof(value)))
+      glUniform1f(uniform.location, value);
+  }
+  void setVec2(const char* name, const glm::vec2 &value) const
+  {
+    setVec2(name, value[0], value[1]);
+  }
+  void setVec2(const char* name, float x, float y) const
+  {
+    PROFILE_ZONE("Shader::setVec2");
+    float value[] = { x, y };
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, value, sizeof(value)))
+      glUniform2fv(uniform.location, 1, value);
+  }
+  void setVec3(const char* name, const glm::vec3 &value) const
+  {
+    setVec3(name, value[0], value[1], value[2]);
+  }
+  void setVec3(const char* name, float x, float y, float z) const
+  {
+    PROFILE_ZONE("Shader::setVec3");
+    float value[] = { x, y, z };
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, value, sizeof(value)))
+      glUniform3fv(uniform.location, 1, value);
+  }
+  void setVec4(const char* name, const glm::vec4 &value) const
+  {
+    setVec4(name, value[0], value[1], value[2], value[3]);
+  }
+  void setVec4(const char* name, float x, float y, float z, float w) const
+  {
+    PROFILE_ZONE("Shader::setVec4");
+    float value[] = { x, y, z, w };
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, value, sizeof(value)))
+      glUniform4fv(uniform.location, 1, value);
+  }
+  void setMat2(const char* name, const glm::mat2 &mat) const
+  {
+    PROFILE_ZONE("Shader::setMat2");
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, &mat[0][0], 4 * sizeof(float)))
+      glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+  }
+  void setMat3(const char* name, const glm::mat3 &mat) const
+  {
+    PROFILE_ZONE("Shader::setMat3");
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, &mat[0][0], 9 * sizeof(float)))
+      glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+  }
+  void setMat4(const char* name, const glm::mat4 &mat) const
+  {
+    PROFILE_ZONE("Shader::setMat4");
+    Uniform &uniform = lookup(name);
+    if (changed(uniform, &mat[0][0], 16 * sizeof(float)))
+      glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+  }
+
+  // the same for names built at run time; a literal picks the overloads
+  // above and builds no std::string
   void setBool(const std::string &name, bool value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    setBool(name.c_str(), value);
   }
   void setInt(const std::string &name, int value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setInt(name.c_str(), value);
   }
   void setFloat(const std::string &name, float value) const
   {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setFloat(name.c_str(), value);
   }
-  void setVec2(const std::string &name, glm::vec2 &value) const
+  void setVec2(const std::string &name, const glm::vec2 &value) const
   {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1,
-		 &value[0]);
+    setVec2(name.c_str(), value);
   }
   void setVec2(const std::string &name, float x, float y) const
   {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    setVec2(name.c_str(), x, y);
   }
-  void setVec3(const std::string &name, glm::vec3 &value) const
+  void setVec3(const std::string &name, const glm::vec3 &value) const
   {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setVec3(name.c_str(), value);
   }
   void setVec3(const std::string &name, float x, float y, float z) const
   {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    setVec3(name.c_str(), x, y, z);
   }
   void setVec4(const std::string &name, const glm::vec4 &value) const
   {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setVec4(name.c_str(), value);
   }
   void setVec4(const std::string &name, float x, float y, float z, float w) const
   {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    setVec4(name.c_str(), x, y, z, w);
   }
   void setMat2(const std::string &name, const glm::mat2 &mat) const
   {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-		 &mat[0][0]);
+    setMat2(name.c_str(), mat);
   }
   void setMat3(const std::string &name, const glm::mat3 &mat) const
   {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-		       &mat[0][0]);
+    setMat3(name.c_str(), mat);
   }
   void setMat4(const std::string &name, const glm::mat4 &mat) const
   {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-		       &mat[0][0]);
+    setMat4(name.c_str(), mat);
+  }
+
+  // the location of a uniform, for code that sends it without the
+  // setters (command_list.h). The cache does not see those values, so a
+  // uniform is set one way or the other, not both
+  GLint uniformLocation(const char* name) const
+  {
+    return lookup(name).location;
   }
 
 private:
+  // shader objects kept alive between submit() and finish()
+  unsigned int vertex, fragment, geometry;
+  // see captureVaryings()
+  std::vector<const char*> feedbackVaryings;
+
+  // a uniform's location and the last value sent to it
+  struct Uniform {
+    std::string name;
+    GLint location;
+    unsigned int size; // bytes of the shadowed value, 0 until set
+    unsigned char value[16 * sizeof(float)];
+  };
+  mutable std::vector<Uniform> uniforms;
+  // name hash -> index into uniforms
+  mutable std::unordered_map<unsigned long long, unsigned int> uniformIndex;
+
+  static unsigned long long hashName(const char* name)
+  {
+    // 64-bit FNV-1a
+    unsigned long long hash = 14695981039346656037ULL;
+    for (; *name; name++)
+      hash = (hash ^ (unsigned char)*name) * 1099511628211ULL;
+    return hash;
+  }
+
+  // returns the cached entry for a uniform, asking GL for its location
+  // only the first time the name is seen
+  Uniform& lookup(const char* name) const
+  {
+    HEAP_SCOPE("Shader setters");
+    unsigned long long hash = hashName(name);
+    std::unordered_map<unsigned long long, unsigned int>::iterator it =
+      uniformIndex.find(hash);
+    if (it != uniformIndex.end())
+      {
+	if (uniforms[it->second].name == name)
+	  return uniforms[it->second];
+	// hash collision, fall back to a search
+	for (unsigned int i = 0; i < uniforms.size(); i++)
+	  if (uniforms[i].name == name)
+	    return uniforms[i];
+      }
+
+    Uniform uniform;
+    uniform.name = name;
+    uniform.location = glGetUniformLocation(ID, name);
+    uniform.size = 0;
+    uniforms.push_back(uniform);
+    if (it == uniformIndex.end())
+      uniformIndex[hash] = uniforms.size() - 1;
+    return uniforms.back();
+  }
+
+  // returns true (and updates the shadow) when the value has to be sent.
+  // Uniforms the linker removed (location -1) are never sent, nor counted
+  // as skipped, since no call was saved
+  bool changed(Uniform &uniform, const void* value, unsigned int size) const
+  {
+    if (uniform.location < 0)
+      return false;
+    if (uniform.size == size && memcmp(uniform.value, value, size) == 0)
+      {
+	stats().skipped++;
+	return false;
+      }
+    memcpy(uniform.value, value, size);
+    uniform.size = size;
+    stats().issued++;
+    return true;
+  }
+
+  static bool exists(const std::string &path)
+  {
+    std::ifstream file(path.c_str());
+    return file.good();
+  }
+
+  // reads one file and recursively expands its #include lines
+  static std::string expand(const std::string &path,
+			    std::set<std::string> &included,
+			    std::vector<std::string> &files)
+  {
+    std::string code;
+    std::ifstream shaderFile;
+    // ensure ifstream objects can throw exceptions
+    shaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    try
+      {
+	shaderFile.open(path.c_str());
+	std::stringstream shaderStream;
+	shaderStream << shaderFile.rdbuf();
+	shaderFile.close();
+	code = shaderStream.str();
+      }
+    catch(std::ifstream::failure e)
+      {
+	std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path
+		  << std::endl;
+	return code;
+      }
+    included.insert(path);
+    files.push_back(path);
+    unsigned int sourceNumber = files.size() - 1;
+
+    std::string directory;
+    std::string::size_type slash = path.find_last_of('/');
+    if (slash != std::string::npos)
+      directory = path.substr(0, slash + 1);
+
+    std::string result;
+    std::istringstream lines(code);
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(lines, line))
+      {
+	lineNumber++;
+	std::string::size_type start = line.find_first_not_of(" \t");
+	if (start == std::string::npos ||
+	    line.compare(start, 8, "#include") != 0)
+	  {
+	    result += line + "\n";
+	    continue;
+	  }
+	std::string::size_type open = line.find('"', start);
+	std::string::size_type close = line.find('"', open + 1);
+	if (open == std::string::npos || close == std::string::npos)
+	  {
+	    std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ":"
+		      << lineNumber << std::endl;
+	    continue;
+	  }
+	std::string includePath = directory +
+	  line.substr(open + 1, close - open - 1);
+	if (included.count(includePath) == 0)
+	  {
+	    std::stringstream marker;
+	    marker << "#line 1 " << files.size() << "\n";
+	    result += marker.str();
+	    result += expand(includePath, included, files);
+	  }
+	std::stringstream marker;
+	marker << "#line " << lineNumber + 1 << " " << sourceNumber << "\n";
+	result += marker.str();
+      }
+    return result;
+  }
+
   void checkCompileErrors(GLuint shader, std::string type)
   {
     GLint success;
@@ -184,16 +546,16 @@ private:
 		      << type << "\n" << infoLog << "---------------"
 		      << std::endl;
 	  }
-	else
+      }
+    else
+      {
+	glGetProgramiv(shader, GL_LINK_STATUS, &success);
+	if(!success)
 	  {
-	    glGetProgramiv(shader, GL_LINK_STATUS, &success);
-	    if(!success)
-	      {
-		glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-		std::cout << "ERROR::PROGRAM_LINKING_ERROR type "
+	    glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+	    std::cout << "ERROR::PROGRAM_LINKING_ERROR type "
 		      << type << "\n" << infoLog << "---------------"
 		      << std::endl;
-	      }
 	  }
       }
   }
@@ -0,0 +1,68 @@
+/*
+ * A cache of shader permutations. The same source files built with
+ * different define sets (light counts, optional maps, ...) give
+ * different programs; each one is built the first time it is asked
+ * for and shared afterwards.
+ *
+ */
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+
+#include <shader.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+class ShaderCache
+{
+ public:
+  // returns the program for these files and defines, building it on
+  // first use. The order and duplicates of the defines do not matter
+  Shader& get(const char* vertexPath, const char* fragmentPath,
+	      const char* geometryPath,
+	      const std::vector<std::string> &defines =
+	      std::vector<std::string>())
+  {
+    std::vector<std::string> sorted(defines);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    std::string key = std::string(vertexPath) + "|" + fragmentPath + "|" +
+      (geometryPath != nullptr ? geometryPath : "");
+    for (unsigned int i = 0; i < sorted.size(); i++)
+      key += "|" + sorted[i];
+
+    std::map<std::string, Shader>::iterator it = programs.find(key);
+    if (it != programs.end())
+      return it->second;
+
+    Shader &shader = programs[key];
+    shader.submit(vertexPath, fragmentPath, geometryPath, sorted);
+    shader.finish();
+    return shader;
+  }
+
+  // number of distinct programs built so far
+  unsigned int size() const
+  {
+    return programs.size();
+  }
+
+  // deletes every program in the cache
+  void clear()
+  {
+    for (std::map<std::string, Shader>::iterator it = programs.begin();
+	 it != programs.end(); ++it)
+      glDeleteProgram(it->second.ID);
+    programs.clear();
+  }
+
+ private:
+  std::map<std::string, Shader> programs;
+};
+
+#endif
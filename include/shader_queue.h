@@ -0,0 +1,112 @@
+/*
+ * A queue that builds many shader programs at once. Every program is
+ * submitted up front, the driver compiles them in parallel
+ * (KHR_parallel_shader_compile) and the render loop polls for the
+ * ones that are ready without blocking, drawing with a fallback
+ * program in the meantime.
+ *
+ */
+#ifndef SHADER_QUEUE_H
+#define SHADER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <shader.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class ShaderQueue
+{
+ public:
+  ShaderQueue() : pending(0)
+  {
+    // let the driver use as many compiler threads as it wants
+    if (GLAD_GL_KHR_parallel_shader_compile)
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLAD_GL_ARB_parallel_shader_compile)
+      glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  }
+
+  // starts building the program, onReady runs once it has linked
+  // (e.g. to set sampler units or uniform block bindings)
+  void submit(Shader &shader, const char* vertexPath,
+	      const char* fragmentPath, const char* geometryPath,
+	      std::function<void(Shader&)> onReady = nullptr,
+	      const std::vector<std::string> &defines =
+	      std::vector<std::string>())
+  {
+    shader.submit(vertexPath, fragmentPath, geometryPath, defines);
+    Entry entry;
+    entry.shader = &shader;
+    entry.onReady = onReady;
+    entry.ready = false;
+    entries.push_back(entry);
+    pending++;
+  }
+
+  // finishes every program the driver is done with and returns true if
+  // any became ready. Without the extension there is no way to ask
+  // without waiting, so at most one program is finished per call to
+  // keep the frame loop responsive
+  bool poll()
+  {
+    bool parallel = GLAD_GL_KHR_parallel_shader_compile ||
+      GLAD_GL_ARB_parallel_shader_compile;
+    bool any = false;
+    for (unsigned int i = 0; i < entries.size(); i++)
+      {
+	if (entries[i].ready || !entries[i].shader->isReady())
+	  continue;
+	complete(entries[i]);
+	any = true;
+	if (!parallel)
+	  break;
+      }
+    return any;
+  }
+
+  // blocks until every submitted program is built
+  void finish()
+  {
+    for (unsigned int i = 0; i < entries.size(); i++)
+      if (!entries[i].ready)
+	complete(entries[i]);
+  }
+
+  bool ready(const Shader &shader) const
+  {
+    for (unsigned int i = 0; i < entries.size(); i++)
+      if (entries[i].shader == &shader)
+	return entries[i].ready;
+    // not submitted here, so it was built synchronously
+    return true;
+  }
+
+  // true when nothing is left compiling
+  bool done() const
+  {
+    return pending == 0;
+  }
+
+ private:
+  struct Entry {
+    Shader* shader;
+    std::function<void(Shader&)> onReady;
+    bool ready;
+  };
+  std::vector<Entry> entries;
+  unsigned int pending;
+
+  void complete(Entry &entry)
+  {
+    entry.shader->finish();
+    if (entry.onReady)
+      entry.onReady(*entry.shader);
+    entry.ready = true;
+    pending--;
+  }
+};
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * A buffer for data written by the CPU every frame (uniform blocks,
+ * instance attributes, vertices) that never makes the driver wait for
+ * the GPU to finish with the previous frame's data.
+ *
+ *   StreamBuffer stream(64 * 1024);
+ *   ...
+ *   stream.beginFrame();
+ *   StreamBuffer::Range range = stream.allocate(sizeof(Matrices),
+ *                                               stream.uniformAlignment());
+ *   memcpy(range.pointer, &matrices, sizeof(Matrices));
+ *   stream.commit();
+ *   glBindBufferRange(GL_UNIFORM_BUFFER, 0, stream.buffer(), range.offset,
+ *                     range.size);
+ *   ...draw...
+ *   stream.endFrame();
+ *   ...
+ *   stream.destroy();
+ *   platform.terminate();
+ *
+ * With ARB_buffer_storage (core in GL 4.4) the buffer holds REGIONS
+ * regions of the given size, created with glBufferStorage and mapped
+ * once, persistent and coherent. Each frame writes into the next region
+ * through the mapping. endFrame() puts a fence after the frame's
+ * commands and beginFrame() checks the fence of the region it is about
+ * to reuse. By then the GPU is normally two frames past it, so nothing
+ * waits. waits() counts the times it had to.
+ *
+ * Without buffer storage (plain GL 3.3) the writes go to a CPU copy.
+ * beginFrame() orphans the buffer with glBufferData(NULL), so the driver
+ * hands out fresh memory instead of synchronizing, and commit() uploads
+ * what was written since the last commit with glBufferSubData. On the
+ * persistent path commit() does nothing, but call it between writing
+ * and drawing on either path.
+ *
+ * allocate() bumps an offset in the frame's region. A frame that
+ * asks for more than the region holds gets a null pointer and an error
+ * message. The buffer is bound only to GL_COPY_WRITE_BUFFER here, so
+ * creating and uploading leaves the vertex array and uniform buffer
+ * bindings alone.
+ *
+ */
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+class StreamBuffer
+{
+ public:
+  static const unsigned int REGIONS = 3;
+
+  // a piece of the frame's region
+  struct Range
+  {
+    // where to write, valid until commit()
+    void* pointer;
+    // where the data is in buffer()
+    GLintptr offset;
+    GLsizeiptr size;
+  };
+
+  // whether buffers use glBufferStorage when the context has it, for
+  // trying the orphaning path; on by default
+  static bool& preferPersistent()
+  {
+    static bool prefer = true;
+    return prefer;
+  }
+
+  explicit StreamBuffer(GLsizeiptr regionSize)
+    : regionSize(regionSize), id(0), mapped(NULL), region(0), used(0),
+      committed(0), frames(0), waitCount(0), bytes(0)
+  {
+    for (unsigned int i = 0; i < REGIONS; i++)
+      fences[i] = 0;
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    if (preferPersistent() && GLAD_GL_ARB_buffer_storage)
+      {
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+	  GL_MAP_COHERENT_BIT;
+	glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * REGIONS, NULL,
+			flags);
+	mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+					 regionSize * REGIONS, flags);
+      }
+    if (mapped == NULL)
+      {
+	// the CPU copy holds one frame, the buffer is orphaned every frame
+	shadow.resize(regionSize);
+	glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+      }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    // the first beginFrame() moves on to region 0
+    region = REGIONS - 1;
+  }
+
+  ~StreamBuffer()
+  {
+    destroy();
+  }
+
+  // deletes the buffer, for before the context goes away
+  void destroy()
+  {
+    if (id == 0)
+      return;
+    const char* path = persistent() ? "persistent" : "orphaned";
+    for (unsigned int i = 0; i < REGIONS; i++)
+      if (fences[i] != 0)
+	glDeleteSync(fences[i]);
+    if (mapped != NULL)
+      {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      }
+    glDeleteBuffers(1, &id);
+    id = 0;
+    mapped = NULL;
+    if (frames > 0)
+      std::cout << "stream buffer (" << path << "): "
+		<< bytes / frames << " bytes per frame, " << waitCount
+		<< " waits in " << frames << " frames" << std::endl;
+  }
+
+  GLuint buffer() const
+  {
+    return id;
+  }
+
+  // whether the buffer is persistently mapped, false on the orphaning
+  // path
+  bool persistent() const
+  {
+    return mapped != NULL;
+  }
+
+  // the alignment glBindBufferRange needs for GL_UNIFORM_BUFFER
+  static GLsizeiptr uniformAlignment()
+  {
+    static GLint alignment = 0;
+    if (alignment == 0)
+      {
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment <= 0)
+	  alignment = 256;
+      }
+    return alignment;
+  }
+
+  // moves on to the next region, waiting only if the GPU still reads it
+  void beginFrame()
+  {
+    region = (region + 1) % REGIONS;
+    used = committed = 0;
+    if (mapped == NULL)
+      {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+	glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return;
+      }
+    GLsync fence = fences[region];
+    if (fence == 0)
+      return;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+      {
+	waitCount++;
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(fence, flags, 1000000000) ==
+	       GL_TIMEOUT_EXPIRED)
+	  flags = 0;
+      }
+    glDeleteSync(fence);
+    fences[region] = 0;
+  }
+
+  // size bytes at an offset that is a multiple of align
+  Range allocate(GLsizeiptr size, GLsizeiptr align = 16)
+  {
+    Range range = { NULL, 0, size };
+    GLsizeiptr start = (used + align - 1) / align * align;
+    if (start + size > regionSize)
+      {
+	std::cout << "ERROR::STREAM_BUFFER::REGION_FULL " << start + size
+		  << " of " << regionSize << " bytes" << std::endl;
+	return range;
+      }
+    used = start + size;
+    bytes += size;
+    if (mapped != NULL)
+      {
+	range.offset = region * regionSize + start;
+	range.pointer = mapped + range.offset;
+      }
+    else
+      {
+	range.offset = start;
+	range.pointer = &shadow[start];
+      }
+    return range;
+  }
+
+  // makes what was written so far visible to GL
+  void commit()
+  {
+    if (mapped == NULL && used > committed)
+      {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, committed, used - committed,
+			&shadow[committed]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      }
+    committed = used;
+  }
+
+  // fences the region, after the frame's last command that reads it
+  void endFrame()
+  {
+    commit();
+    frames++;
+    if (mapped != NULL)
+      fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  // times beginFrame() had to wait for the GPU
+  unsigned long waits() const
+  {
+    return waitCount;
+  }
+
+ private:
+  GLsizeiptr regionSize;
+  GLuint id;
+  char* mapped;
+  std::vector<char> shadow;
+  GLsync fences[REGIONS];
+  unsigned int region;
+  GLsizeiptr used;
+  GLsizeiptr committed;
+  unsigned long frames;
+  unsigned long waitCount;
+  unsigned long long bytes;
+
+  StreamBuffer(const StreamBuffer&);
+  StreamBuffer& operator=(const StreamBuffer&);
+};
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * Per-object transforms computed once on the CPU instead of once per
+ * vertex. Every object of the frame gets a slot in one uniform buffer
+ * holding its model, model-view-projection and normal matrix (the
+ * Transform block in transform.glsl); upload() fills and sends all of
+ * them at once and bind() points the block at one object before its
+ * draw call.
+ *
+ * The normal matrix is the inverse transpose of the model's upper 3x3,
+ * which for columns a, b, c is (b x c, c x a, a x b) / det, so no
+ * general inverse is needed. With SSE the batch works on whole columns
+ * at a time.
+ *
+ */
+#ifndef TRANSFORM_BUFFER_H
+#define TRANSFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <buffer_layout.h>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRANSFORM_BUFFER_SSE
+#endif
+
+// CPU mirror of the Transform block, std140
+struct ObjectTransform
+{
+  glm::mat4 model;
+  glm::mat4 modelViewProjection;
+  // mat3 in the block, every column padded to a vec4
+  glm::vec4 normalMatrix[3];
+};
+typedef GpuBlock<Std140, glm::mat4, glm::mat4, glm::mat3> ObjectTransformLayout;
+GPU_LAYOUT_MEMBER(ObjectTransform, model, ObjectTransformLayout, 0);
+GPU_LAYOUT_MEMBER(ObjectTransform, modelViewProjection,
+		  ObjectTransformLayout, 1);
+GPU_LAYOUT_MEMBER(ObjectTransform, normalMatrix, ObjectTransformLayout, 2);
+GPU_LAYOUT_SIZE(ObjectTransform, ObjectTransformLayout);
+
+// fills one transform, the reference the batch path has to match
+inline void computeTransform(const glm::mat4 &viewProjection,
+			     const glm::mat4 &model, ObjectTransform &out)
+{
+  out.model = model;
+  out.modelViewProjection = viewProjection * model;
+  glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+  glm::vec3 bc = glm::cross(b, c);
+  float det = glm::dot(a, bc);
+  float scale = det != 0.0f ? 1.0f / det : 1.0f;
+  out.normalMatrix[0] = glm::vec4(bc * scale, 0.0f);
+  out.normalMatrix[1] = glm::vec4(glm::cross(c, a) * scale, 0.0f);
+  out.normalMatrix[2] = glm::vec4(glm::cross(a, b) * scale, 0.0f);
+}
+
+#ifdef TRANSFORM_BUFFER_SSE
+namespace transform_detail {
+  // (y, z, x, w) of a vector
+  inline __m128 yzx(__m128 v)
+  {
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+  }
+
+  // cross product of the xyz parts, w comes out 0
+  inline __m128 cross(__m128 a, __m128 b)
+  {
+    __m128 r = _mm_sub_ps(_mm_mul_ps(a, yzx(b)), _mm_mul_ps(yzx(a), b));
+    return yzx(r);
+  }
+}
+#endif
+
+// fills count transforms, vectorized when SSE is available
+inline void computeTransforms(const glm::mat4 &viewProjection,
+			      const glm::mat4* models, ObjectTransform* out,
+			      unsigned int count)
+{
+#ifdef TRANSFORM_BUFFER_SSE
+  using namespace transform_detail;
+  __m128 vp[4];
+  for (int i = 0; i < 4; i++)
+    vp[i] = _mm_loadu_ps(&viewProjection[i][0]);
+  const __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+  for (unsigned int n = 0; n < count; n++)
+    {
+      const float* m = &models[n][0][0];
+      __m128 column[4];
+      for (int i = 0; i < 4; i++)
+	column[i] = _mm_loadu_ps(m + 4 * i);
+
+      // model-view-projection, one column at a time
+      float* mvp = &out[n].modelViewProjection[0][0];
+      for (int i = 0; i < 4; i++)
+	{
+	  __m128 r = _mm_mul_ps(vp[0], _mm_shuffle_ps(column[i], column[i],
+						      _MM_SHUFFLE(0, 0, 0, 0)));
+	  r = _mm_add_ps(r, _mm_mul_ps(vp[1], _mm_shuffle_ps(column[i], column[i],
+						      _MM_SHUFFLE(1, 1, 1, 1))));
+	  r = _mm_add_ps(r, _mm_mul_ps(vp[2], _mm_shuffle_ps(column[i], column[i],
+						      _MM_SHUFFLE(2, 2, 2, 2))));
+	  r = _mm_add_ps(r, _mm_mul_ps(vp[3], _mm_shuffle_ps(column[i], column[i],
+						      _MM_SHUFFLE(3, 3, 3, 3))));
+	  _mm_storeu_ps(mvp + 4 * i, r);
+	}
+
+      // normal matrix from cross products of the 3x3 columns
+      __m128 a = _mm_and_ps(column[0], xyz);
+      __m128 b = _mm_and_ps(column[1], xyz);
+      __m128 c = _mm_and_ps(column[2], xyz);
+      __m128 bc = cross(b, c);
+      __m128 ca = cross(c, a);
+      __m128 ab = cross(a, b);
+      __m128 d = _mm_mul_ps(a, bc);
+      float det = _mm_cvtss_f32(d) + _mm_cvtss_f32(_mm_shuffle_ps(d, d, 1)) +
+	_mm_cvtss_f32(_mm_shuffle_ps(d, d, 2));
+      __m128 scale = _mm_set1_ps(det != 0.0f ? 1.0f / det : 1.0f);
+      _mm_storeu_ps(&out[n].normalMatrix[0][0], _mm_mul_ps(bc, scale));
+      _mm_storeu_ps(&out[n].normalMatrix[1][0], _mm_mul_ps(ca, scale));
+      _mm_storeu_ps(&out[n].normalMatrix[2][0], _mm_mul_ps(ab, scale));
+
+      for (int i = 0; i < 4; i++)
+	_mm_storeu_ps(&out[n].model[i][0], column[i]);
+    }
+#else
+  for (unsigned int n = 0; n < count; n++)
+    computeTransform(viewProjection, models[n], out[n]);
+#endif
+}
+
+class TransformBuffer
+{
+ public:
+  // uniform block binding point of Transform
+  static const GLuint BINDING = 2;
+
+  // maxObjects is the most objects drawn with it in one frame
+  TransformBuffer(unsigned int maxObjects = 64)
+    : capacity(maxObjects)
+  {
+    // every slot has to start at an offset glBindBufferRange accepts
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    stride = (sizeof(ObjectTransform) + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, capacity * stride, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    models.reserve(capacity);
+    transforms.resize(capacity);
+    staging.resize(capacity * stride);
+  }
+
+  // connects a program's Transform block to this buffer and checks
+  // the block layout against the program
+  void attach(const Shader &shader) const
+  {
+    GLuint blockIndex = glGetUniformBlockIndex(shader.ID, "Transform");
+    if (blockIndex == GL_INVALID_INDEX)
+      {
+	std::cout << "ERROR::TRANSFORM::NO_TRANSFORM_BLOCK program "
+		  << shader.ID << std::endl;
+	return;
+      }
+    glUniformBlockBinding(shader.ID, blockIndex, BINDING);
+
+    std::vector<std::string> names;
+    names.push_back("model");
+    names.push_back("modelViewProjection");
+    names.push_back("normalMatrix");
+    checkBlockLayout<ObjectTransformLayout>(shader.ID, "Transform", names);
+  }
+
+  // forgets the objects of the last frame
+  void clear()
+  {
+    models.clear();
+  }
+
+  // adds an object and returns its slot for bind()
+  unsigned int add(const glm::mat4 &model)
+  {
+    if (models.size() == capacity)
+      {
+	std::cout << "ERROR::TRANSFORM::TOO_MANY_OBJECTS (max " << capacity
+		  << ")" << std::endl;
+	return capacity - 1;
+      }
+    models.push_back(model);
+    return models.size() - 1;
+  }
+
+  // computes every transform and sends them in one upload
+  void upload(const glm::mat4 &projection, const glm::mat4 &view)
+  {
+    if (models.empty())
+      return;
+    computeTransforms(projection * view, &models[0], &transforms[0],
+		      models.size());
+    for (unsigned int i = 0; i < models.size(); i++)
+      memcpy(&staging[i * stride], &transforms[i], sizeof(ObjectTransform));
+
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, models.size() * stride, &staging[0]);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  // makes the Transform block read the object in slot
+  void bind(unsigned int slot) const
+  {
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, ubo, slot * stride,
+		      sizeof(ObjectTransform));
+  }
+
+ private:
+  unsigned int capacity;
+  unsigned int stride;
+  GLuint ubo;
+  std::vector<glm::mat4> models;
+  std::vector<ObjectTransform> transforms;
+  std::vector<unsigned char> staging;
+};
+
+#endif
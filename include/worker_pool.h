@@ -0,0 +1,119 @@
+/*
+ * Threads kept for the life of the pool, to spread the CPU work of a
+ * frame over cores without starting a thread per frame.
+ *
+ *   WorkerPool pool(platform.threads());
+ *   ...
+ *   pool.run([&](unsigned int index)
+ *     {
+ *       size_t begin = items * index / pool.threads();
+ *       size_t end = items * (index + 1) / pool.threads();
+ *       ...
+ *     });
+ *
+ * run() calls the job once on every thread with the thread's index,
+ * the calling thread taking index 0, and returns when all are done.
+ * The job is called through a pointer rather than a std::function,
+ * which would allocate for a lambda with more than a couple of
+ * captures.
+ *
+ */
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+ public:
+  explicit WorkerPool(unsigned int threads)
+    : count(threads > 0 ? threads : 1), job(NULL), invoke(NULL),
+      generation(0), pending(0), stopping(false)
+  {
+    for (unsigned int i = 1; i < count; i++)
+      workers.push_back(std::thread(&WorkerPool::work, this, i));
+  }
+
+  ~WorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    start.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+      workers[i].join();
+  }
+
+  unsigned int threads() const
+  {
+    return count;
+  }
+
+  // calls job(index) on every thread and waits for them
+  template <class Job>
+  void run(const Job &job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      this->job = &job;
+      invoke = &call<Job>;
+      pending = workers.size();
+      generation++;
+    }
+    start.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+    this->job = NULL;
+  }
+
+ private:
+  unsigned int count;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start;
+  std::condition_variable done;
+  // the run() in progress
+  const void* job;
+  void (*invoke)(const void*, unsigned int);
+  unsigned long generation;
+  size_t pending;
+  bool stopping;
+
+  template <class Job>
+  static void call(const void* job, unsigned int index)
+  {
+    (*(const Job*)job)(index);
+  }
+
+  void work(unsigned int index)
+  {
+    unsigned long seen = 0;
+    for (;;)
+      {
+	{
+	  std::unique_lock<std::mutex> lock(mutex);
+	  start.wait(lock, [this, seen]
+		     { return stopping || generation != seen; });
+	  if (stopping)
+	    return;
+	  seen = generation;
+	}
+	invoke(job, index);
+	{
+	  std::lock_guard<std::mutex> lock(mutex);
+	  if (--pending == 0)
+	    done.notify_one();
+	}
+      }
+  }
+
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif
@@ -6,8 +6,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "platform.h"
 #include "shader.h"
 #include "camera.h"
+#include "camera_recorder.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
@@ -15,7 +17,7 @@
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 GLuint loadTexture(const char* path);
@@ -42,35 +44,18 @@ float fov = 45.0f;
 float deltaTime = 0.0f; // Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
 
   // tell gflw to capture our mouse
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.captureCursor();
 
   // configure global opengl state
   glEnable(GL_DEPTH_TEST);
@@ -215,13 +200,16 @@ int main()
   shader.setInt("texture1", 0);
 
 
-  while(!glfwWindowShouldClose(window))
+  CameraRecorder cameraRecorder(platform, camera);
+
+  while(platform.running())
     {
-      float currentFrame = glfwGetTime();
+      float currentFrame = platform.time();
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
 
-      processInput(window);
+      processInput(platform);
+      cameraRecorder.update();
       
       glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -265,11 +253,10 @@ int main()
 	glDrawArrays(GL_TRIANGLES, 0, 6);
       }
       
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      platform.endFrame();
     }
 
-  glfwTerminate();
+  platform.terminate();
   
   
   return 0;
@@ -280,27 +267,27 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
   glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
   const float cameraSpeed = 2.5f * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
 
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_W))
     {
       camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_S))
     {
       camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_A))
     {
       camera.ProcessKeyboard(LEFT, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_D))
     {
       camera.ProcessKeyboard(RIGHT, deltaTime);
     }
@@ -336,7 +323,9 @@ GLuint loadTexture(const char* path)
   glGenTextures(1, &textureID);
 
   GLint width, height, nrComponents;
+  PROFILE_BEGIN("stbi_load");
   unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+  PROFILE_END();
   if (data)
     {
       GLenum format;
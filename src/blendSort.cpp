@@ -6,15 +6,17 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "platform.h"
 #include "shader.h"
 #include "camera.h"
+#include "camera_recorder.h"
+#include "render_queue.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
-#include <map>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 GLuint loadTexture(const char* path);
@@ -41,40 +43,21 @@ float fov = 45.0f;
 float deltaTime = 0.0f; // Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
 
   // tell gflw to capture our mouse
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.captureCursor();
 
   // configure global opengl state
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  GlState::enable(GL_DEPTH_TEST);
   
   Shader shader("./blendSort.vs", "./blendSort.fs", nullptr);
   
@@ -167,7 +150,7 @@ int main()
   glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices),
 	       cubeVertices, GL_STATIC_DRAW); 
   glGenVertexArrays(1, &cubeVAO);
-  glBindVertexArray(cubeVAO);
+  GlState::bindVertexArray(cubeVAO);
   glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
 			(void*)0);
@@ -183,7 +166,7 @@ int main()
   glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices),
 	       planeVertices, GL_STATIC_DRAW); 
   glGenVertexArrays(1, &planeVAO);
-  glBindVertexArray(planeVAO);
+  GlState::bindVertexArray(planeVAO);
   glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
 			(void*)0);
@@ -195,7 +178,7 @@ int main()
   GLuint transparentVAO, transparentVBO;
   glGenVertexArrays(1, &transparentVAO);
   glGenBuffers(1, &transparentVBO);
-  glBindVertexArray(transparentVAO);
+  GlState::bindVertexArray(transparentVAO);
   glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices),
 	       transparentVertices, GL_STATIC_DRAW);
@@ -206,7 +189,7 @@ int main()
   glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
 			(void*)(3 * sizeof(GLfloat)));
 
-  glBindVertexArray(0);
+  GlState::bindVertexArray(0);
 
   // load textures
   GLuint cubeTexture = loadTexture("./marble.jpg");
@@ -217,69 +200,73 @@ int main()
   shader.setInt("texture1", 0);
 
 
-  while(!glfwWindowShouldClose(window))
+  RenderQueue queue;
+  CameraRecorder cameraRecorder(platform, camera);
+
+  while(platform.running())
     {
-      float currentFrame = glfwGetTime();
+      float currentFrame = platform.time();
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
 
-      processInput(window);
+      processInput(platform);
+      cameraRecorder.update();
 
-      // sort transparent windows before rendering
-      std::map<GLfloat, glm::vec3> sorted;
-      for (GLuint i = 0; i < windowPane.size(); i++) {
-	GLfloat distance = glm::length(camera.Position - windowPane[i]);
-	sorted[distance] = windowPane[i];
-      }
-      
       glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-      shader.use();
-
-      glm::mat4 model = glm::mat4(1.0f);
       glm::mat4 view = camera.GetViewMatrix();
       glm::mat4 projection = glm::mat4(1.0f);
       projection = glm::perspective(glm::radians(camera.Zoom),
 				    (float)SCR_WIDTH / (float) SCR_HEIGHT,
 				    0.1f, 100.0f);
+      shader.use();
       shader.setMat4("view", view);
       shader.setMat4("projection", projection);
 
-      // render cubes
-      glBindVertexArray(cubeVAO);
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, cubeTexture);
-      model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
-      shader.setMat4("model", model);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
-      model = glm::mat4(1.0f);
-      model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
-      shader.setMat4("model", model);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+      // the queue puts the opaque draws first and the windows back to
+      // front
+      queue.setEye(camera.Position);
+
+      // cubes
+      DrawPacket cube;
+      cube.shader = &shader;
+      cube.vao = cubeVAO;
+      cube.addTexture(cubeTexture);
+      cube.count = 36;
+      cube.model = glm::translate(glm::mat4(1.0f),
+				  glm::vec3(-1.0f, 0.0f, -1.0f));
+      queue.submit(cube);
+      cube.model = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f));
+      queue.submit(cube);
 
       // floor
-      glBindVertexArray(planeVAO);
-      glBindTexture(GL_TEXTURE_2D, floorTexture);
-      shader.setMat4("model", glm::mat4(1.0f));
-      glDrawArrays(GL_TRIANGLES, 0, 36);
-
-      // window
-      glBindVertexArray(transparentVAO);
-      glBindTexture(GL_TEXTURE_2D, transparentTexture);
-      for (std::map<GLfloat, glm::vec3>::reverse_iterator
-	     it = sorted.rbegin(); it != sorted.rend(); ++it) {
-	model = glm::mat4(1.0f);
-	model = glm::translate(model, it->second);
-	shader.setMat4("model", model);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-      }
-
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      DrawPacket floor;
+      floor.shader = &shader;
+      floor.vao = planeVAO;
+      floor.addTexture(floorTexture);
+      floor.count = 6;
+      queue.submit(floor);
+
+      // windows
+      DrawPacket window;
+      window.pass = RenderQueue::TRANSPARENT;
+      window.shader = &shader;
+      window.vao = transparentVAO;
+      window.addTexture(transparentTexture);
+      window.count = 6;
+      for (GLuint i = 0; i < windowPane.size(); i++)
+	{
+	  window.model = glm::translate(glm::mat4(1.0f), windowPane[i]);
+	  queue.submit(window);
+	}
+
+      queue.execute();
+
+      platform.endFrame();
     }
 
-  glfwTerminate();
+  platform.terminate();
   
   
   return 0;
@@ -287,30 +274,30 @@ int main()
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-  glViewport(0, 0, width, height);
+  GlState::viewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
   const float cameraSpeed = 2.5f * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
 
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_W))
     {
       camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_S))
     {
       camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_A))
     {
       camera.ProcessKeyboard(LEFT, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_D))
     {
       camera.ProcessKeyboard(RIGHT, deltaTime);
     }
@@ -346,7 +333,9 @@ GLuint loadTexture(const char* path)
   glGenTextures(1, &textureID);
 
   GLint width, height, nrComponents;
+  PROFILE_BEGIN("stbi_load");
   unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+  PROFILE_END();
   if (data)
     {
       GLenum format;
@@ -357,7 +346,7 @@ GLuint loadTexture(const char* path)
       else if (nrComponents == 4)
 	format = GL_RGBA;
 
-      glBindTexture(GL_TEXTURE_2D, textureID);
+      GlState::bindTexture(0, GL_TEXTURE_2D, textureID);
       glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
 		   GL_UNSIGNED_BYTE, data);
       glGenerateMipmap(GL_TEXTURE_2D);
@@ -6,43 +6,26 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "platform.h"
 #include "shader.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 
 // screen size
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
-
-  glfwMakeContextCurrent(window);
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
 
   // configure global opengl state
   glEnable(GL_DEPTH_TEST);
@@ -59,8 +42,10 @@ int main()
 
   int width, height, nrChannels;
   stbi_set_flip_vertically_on_load(true);
+  PROFILE_BEGIN("stbi_load");
   unsigned char *data = stbi_load("container.jpg", &width, &height,
 				  &nrChannels, 0);
+  PROFILE_END();
   if (data)
     {
       glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
@@ -83,8 +68,10 @@ int main()
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+  PROFILE_BEGIN("stbi_load");
   data = stbi_load("awesomeface.png", &width, &height,
 				  &nrChannels, 0);
+  PROFILE_END();
   if (data)
     {
       // .png has transparancy thus an alpha channel GL_RGBA
@@ -195,7 +182,7 @@ int main()
   ourShader.setInt("texture1", 0);
   ourShader.setInt("texture2", 1);
 
-  while(!glfwWindowShouldClose(window))
+  while(platform.running())
     {
       glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
       // also clear the depth buffer
@@ -219,8 +206,8 @@ int main()
       // move camera backwards on z-axis (negative towards the front)
       //view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
       const float radius = 10.0f;
-      float camX = sin(glfwGetTime()) * radius;
-      float camZ = cos(glfwGetTime()) * radius;
+      float camX = sin(platform.time()) * radius;
+      float camZ = cos(platform.time()) * radius;
       view = glm::lookAt(glm::vec3(camX, 0.0, camZ), glm::vec3(0.0, 0.0, 0.0),
 			 glm::vec3(0.0, 1.0, 0.0));
       // standard setting for projection
@@ -247,13 +234,14 @@ int main()
 	  glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
       
-      processInput(window);
+      processInput(platform);
+      // the animation runs on time(), --on-demand has to keep drawing
+      platform.requestRedraw();
       
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      platform.endFrame();
     }
 
-  glfwTerminate();
+  platform.terminate();
   
   
   return 0;
@@ -264,10 +252,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
   glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
 }
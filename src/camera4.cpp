@@ -7,13 +7,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "platform.h"
 #include "shader.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
@@ -42,32 +43,15 @@ float fov = 45.0f;
 float deltaTime = 0.0f; // Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
-
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
 
   // configure global opengl state
   glEnable(GL_DEPTH_TEST);
@@ -84,8 +68,10 @@ int main()
 
   int width, height, nrChannels;
   stbi_set_flip_vertically_on_load(true);
+  PROFILE_BEGIN("stbi_load");
   unsigned char *data = stbi_load("container.jpg", &width, &height,
 				  &nrChannels, 0);
+  PROFILE_END();
   if (data)
     {
       glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
@@ -108,8 +94,10 @@ int main()
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+  PROFILE_BEGIN("stbi_load");
   data = stbi_load("awesomeface.png", &width, &height,
 				  &nrChannels, 0);
+  PROFILE_END();
   if (data)
     {
       // .png has transparancy thus an alpha channel GL_RGBA
@@ -220,13 +208,13 @@ int main()
   ourShader.setInt("texture1", 0);
   ourShader.setInt("texture2", 1);
 
-  while(!glfwWindowShouldClose(window))
+  while(platform.running())
     {
       glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
       // also clear the depth buffer
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-      float currentFrame = glfwGetTime();
+      float currentFrame = platform.time();
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
       
@@ -270,13 +258,12 @@ int main()
 	  glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
       
-      processInput(window);
+      processInput(platform);
       
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      platform.endFrame();
     }
 
-  glfwTerminate();
+  platform.terminate();
   
   
   return 0;
@@ -287,33 +274,37 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
   glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
   const float cameraSpeed = 2.5f * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  glm::vec3 lastPos = cameraPos;
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
 
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_W))
     {
       cameraPos += cameraSpeed * cameraFront;
     }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_S))
     {
       cameraPos -= cameraSpeed * cameraFront;
     }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_A))
     {
       cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp))
 	* cameraSpeed;
     }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_D))
     {
       cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp))
 	* cameraSpeed;
     }
-				  
+  // a held key moves the camera without new events, keep --on-demand
+  // drawing until it is let go
+  if (cameraPos != lastPos)
+    platform.requestRedraw();
 }
 
 // glfw: whenever the mouse mves, this callback is called
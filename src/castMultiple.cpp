@@ -8,13 +8,20 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "platform.h"
 #include "shader.h"
+#include "shader_cache.h"
+#include "light_buffer.h"
+#include "transform_buffer.h"
 #include "camera.h"
+#include "camera_recorder.h"
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, GLint width, GLint height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 void mouse_callback(GLFWwindow* window, GLdouble xpos, GLdouble ypos);
 void scroll_callback(GLFWwindow* window,GLdouble xoffset, GLdouble yoffset);
 GLuint loadTexture(const char* path);
@@ -35,39 +42,30 @@ GLfloat lastFrame = 0.0f; // Time of last frame
 
 // light position
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
-
-  glfwMakeContextCurrent(window);
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
 
   // configure global opengl state
   glEnable(GL_DEPTH_TEST);
   
-  Shader lightingShader("./mapMultiple.vs",
-			"./mapMultiple.fs", nullptr);
+  // every light of the scene lives in one uniform buffer
+  LightBuffer lights;
+
+  // specialize the lighting shader to exactly what this scene uses
+  ShaderCache shaderCache;
+  std::vector<std::string> lightingDefines = lights.defines();
+  lightingDefines.push_back("NR_POINT_LIGHTS=4");
+  lightingDefines.push_back("HAS_SPECULAR_MAP");
+  Shader &lightingShader = shaderCache.get("./mapMultiple.vs",
+					   "./mapMultiple.fs", nullptr,
+					   lightingDefines);
   Shader lightCubeShader("./lightCubeSpot.vs",
 			 "./lightCubeSpot.fs", nullptr);
   
@@ -184,13 +182,32 @@ int main()
   lightingShader.use();
   lightingShader.setInt("material.diffuse", 0);
   lightingShader.setInt("material.specular", 1);
+  lights.attach(lightingShader);
+
+  // directional light
+  lights.dirLight = makeDirLight(glm::vec3(-0.2f, -1.0f, -0.3f),
+				 glm::vec3(0.05f), glm::vec3(0.4f),
+				 glm::vec3(0.5f));
+  // point lights
+  for (GLuint i = 0; i < 4; i++)
+    lights.pointLights.push_back(makePointLight(pointLightPositions[i],
+						glm::vec3(0.05f),
+						glm::vec3(0.8f),
+						glm::vec3(1.0f),
+						1.0f, 0.08f, 0.032f));
+
+  // per-object transforms, the vertex stage reads them from a block
+  TransformBuffer transforms;
+  transforms.attach(lightingShader);
 
 
   
-  while(!glfwWindowShouldClose(window))
+  CameraRecorder cameraRecorder(platform, camera);
+
+  while(platform.running())
     {
       //per-frame time logic
-      GLfloat currentFrame = glfwGetTime();
+      GLfloat currentFrame = platform.time();
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
 
@@ -203,66 +220,14 @@ int main()
       lightingShader.setFloat("material.shininess", 32.0f);
       lightingShader.setVec3("viewPos", camera.Position);
 
-      
-      lightingShader.setVec3("light.position", camera.Position);
-      lightingShader.setVec3("light.direction", camera.Front);
-      lightingShader.setFloat("light.cutOff",
-			      glm::cos(glm::radians(12.5f)));
-      lightingShader.setFloat("light.outerCutOff",
-			      glm::cos(glm::radians(17.5f)));
-
-
-      // directional light
-      lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-      lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-      lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-      lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-
-      // point light 1
-      lightingShader.setVec3("pointLights[0].position",
-			     pointLightPositions[0]);
-      lightingShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-      lightingShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-      lightingShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-      lightingShader.setFloat("pointLights[0].constant", 1.0f);
-      lightingShader.setFloat("pointLights[0].linear", 0.08f);
-      lightingShader.setFloat("pointLights[0].quadratic", 0.032);
-      // point light 2
-      lightingShader.setVec3("pointLights[1].position",
-			     pointLightPositions[0]);
-      lightingShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-      lightingShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-      lightingShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-      lightingShader.setFloat("pointLights[1].constant", 1.0f);
-      lightingShader.setFloat("pointLights[1].linear", 0.08f);
-      lightingShader.setFloat("pointLights[1].quadratic", 0.032);
-      // point light 3
-      lightingShader.setVec3("pointLights[2].position",
-			     pointLightPositions[0]);
-      lightingShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-      lightingShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-      lightingShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-      lightingShader.setFloat("pointLights[2].constant", 1.0f);
-      lightingShader.setFloat("pointLights[2].linear", 0.08f);
-      lightingShader.setFloat("pointLights[2].quadratic", 0.032);
-      // point light 4
-      lightingShader.setVec3("pointLights[3].position",
-			     pointLightPositions[0]);
-      lightingShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-      lightingShader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-      lightingShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-      lightingShader.setFloat("pointLights[3].constant", 1.0f);
-      lightingShader.setFloat("pointLights[3].linear", 0.08f);
-      lightingShader.setFloat("pointLights[3].quadratic", 0.032);
-      
-
-      // spotLight
-      lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-      lightingShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-      lightingShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-      lightingShader.setFloat("spotLight.constant", 1.0f);
-      lightingShader.setFloat("spotLight.linear", 0.09f);
-      lightingShader.setFloat("spotLight.quadratic", 0.032f);
+      // spot light follows the camera, the rest of the lights are static
+      // but still go out with it in the same upload
+      lights.spotLight = makeSpotLight(camera.Position, camera.Front,
+				       glm::cos(glm::radians(12.5f)),
+				       glm::cos(glm::radians(17.5f)),
+				       glm::vec3(0.0f), glm::vec3(1.0f),
+				       glm::vec3(1.0f), 1.0f, 0.09f, 0.032f);
+      lights.upload();
 
 
       // view projection transformations
@@ -270,8 +235,6 @@ int main()
       glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
 		    (GLfloat)SCR_WIDTH / (GLfloat)SCR_HEIGHT, 0.1f, 100.0f);
       glm::mat4 view = camera.GetViewMatrix();
-      lightingShader.setMat4("projection", projection);
-      lightingShader.setMat4("view", view);
 
 
       // bind diffuse map
@@ -282,19 +245,25 @@ int main()
       glBindTexture(GL_TEXTURE_2D, specularMap);
 
 
-      // render the containers
-      glBindVertexArray(cubeVAO);
+      // world transformations of every cube, computed in one batch
+      transforms.clear();
       for (GLuint i = 0; i < 10; i++)
-	{ 
+	{
 	  model = glm::mat4(1.0f);
 	  // world transformation
 	  model = glm::translate(model, cubePositions[i]);
 	  float angle = 20.0f * i;
 	  model = glm::rotate(model, glm::radians(angle),
 			      glm::vec3(1.0f, 0.3f, 0.5f));
-	  
-	  lightingShader.setMat4("model", model);
+	  transforms.add(model);
+	}
+      transforms.upload(projection, view);
 
+      // render the containers
+      glBindVertexArray(cubeVAO);
+      for (GLuint i = 0; i < 10; i++)
+	{
+	  transforms.bind(i);
 	  glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
 
@@ -314,19 +283,24 @@ int main()
           glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
       
-      processInput(window);
+      processInput(platform);
+      cameraRecorder.update();
       
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      platform.endFrame();
     }
 
+  // unchanged light and material values are not sent again
+  std::cout << "uniform uploads last frame: "
+	    << Shader::lastFrameStats().issued << " issued, "
+	    << Shader::lastFrameStats().skipped << " skipped" << std::endl;
+
   // deallocate all resources (optional)
   glDeleteVertexArrays(1, &cubeVAO);
   glDeleteVertexArrays(1, &lightCubeVAO);
   glDeleteBuffers(1, &VBO);
 
-  // terminate clearing all previously allocated GLFW resources
-  glfwTerminate();
+  // terminate clearing all previously allocated window resources
+  platform.terminate();
   
   
   return 0;
@@ -337,26 +311,26 @@ void framebuffer_size_callback(GLFWwindow* window, GLint width, GLint height)
   glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
   const GLfloat cameraSpeed = 2.5f * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (platform.keyPressed(GLFW_KEY_W))
     {
       camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_S))
     {
       camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_A))
     {
       camera.ProcessKeyboard(LEFT, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_D))
     {
       camera.ProcessKeyboard(RIGHT, deltaTime);
     }
@@ -392,7 +366,9 @@ GLuint loadTexture(const char* path)
   glGenTextures(1, &textureID);
 
   GLint width, height, nrComponents;
+  PROFILE_BEGIN("stbi_load");
   unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+  PROFILE_END();
   if (data)
     {
       GLenum format;
@@ -8,13 +8,17 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "platform.h"
 #include "shader.h"
+#include "light_buffer.h"
+#include "transform_buffer.h"
 #include "camera.h"
+#include "camera_recorder.h"
 
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow* window, GLint width, GLint height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 void mouse_callback(GLFWwindow* window, GLdouble xpos, GLdouble ypos);
 void scroll_callback(GLFWwindow* window,GLdouble xoffset, GLdouble yoffset);
 GLuint loadTexture(const char* path);
@@ -35,33 +39,15 @@ GLfloat lastFrame = 0.0f; // Time of last frame
 
 // light position
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
-
-  glfwMakeContextCurrent(window);
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
 
   // configure global opengl state
   glEnable(GL_DEPTH_TEST);
@@ -177,12 +163,26 @@ int main()
   lightingShader.setInt("material.diffuse", 0);
   lightingShader.setInt("material.specular", 1);
 
+  // the light never moves, so it is uploaded once
+  LightBuffer lights;
+  lights.attach(lightingShader);
+  lights.pointLights.push_back(makePointLight(lightPos, glm::vec3(0.2f),
+					      glm::vec3(0.5f), glm::vec3(1.0f),
+					      1.0f, 0.09f, 0.032f));
+  lights.upload();
+
+  // per-object transforms, the vertex stage reads them from a block
+  TransformBuffer transforms;
+  transforms.attach(lightingShader);
+
 
   
-  while(!glfwWindowShouldClose(window))
+  CameraRecorder cameraRecorder(platform, camera);
+
+  while(platform.running())
     {
       //per-frame time logic
-      GLfloat currentFrame = glfwGetTime();
+      GLfloat currentFrame = platform.time();
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
 
@@ -192,28 +192,15 @@ int main()
 
       // be sure to activate shader when setting uniforms/drawign objects
       lightingShader.use();
-      lightingShader.setVec3("light.position", lightPos);
       lightingShader.setVec3("viewPos", camera.Position);
 
       // material properties
       lightingShader.setFloat("material.shininess", 64.0f);
 
-      // set the intensities for light properties
-      lightingShader.setVec3("light.ambient", 0.2f, 0.2f, 0.2f);
-      lightingShader.setVec3("light.diffuse", 0.5f, 0.5f, 0.5f);
-      lightingShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-      // attentuation constants
-      lightingShader.setFloat("light.constant", 1.0f);
-      lightingShader.setFloat("light.linear", 0.09f);
-      lightingShader.setFloat("light.quadratic", 0.032f);
-
       // view projection transformations
       glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
 		    (GLfloat)SCR_WIDTH / (GLfloat)SCR_HEIGHT, 0.1f, 100.0f);
       glm::mat4 view = camera.GetViewMatrix();
-      lightingShader.setMat4("projection", projection);
-      lightingShader.setMat4("view", view);
 
 
       // bind diffuse map
@@ -223,18 +210,24 @@ int main()
       glActiveTexture(GL_TEXTURE1);
       glBindTexture(GL_TEXTURE_2D, specularMap);
       glm::mat4 model = glm::mat4(1.0f);
-      // render the cube
-      glBindVertexArray(cubeVAO);
+      // world transformations of every cube, computed in one batch
+      transforms.clear();
       for (GLuint i = 0; i < 10; i++)
-	{ 
+	{
 	  // world transformation
 	  model = glm::translate(model, cubePositions[i]);
 	  float angle = 20.0f * i;
 	  model = glm::rotate(model, glm::radians(angle),
 			      glm::vec3(1.0f, 0.3f, 0.5f));
-	  
-	  lightingShader.setMat4("model", model);
+	  transforms.add(model);
+	}
+      transforms.upload(projection, view);
 
+      // render the cube
+      glBindVertexArray(cubeVAO);
+      for (GLuint i = 0; i < 10; i++)
+	{
+	  transforms.bind(i);
 	  glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
 
@@ -251,10 +244,10 @@ int main()
       glBindVertexArray(lightCubeVAO);
       glDrawArrays(GL_TRIANGLES, 0, 36);
       
-      processInput(window);
+      processInput(platform);
+      cameraRecorder.update();
       
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      platform.endFrame();
     }
 
   // deallocate all resources (optional)
@@ -262,8 +255,8 @@ int main()
   glDeleteVertexArrays(1, &lightCubeVAO);
   glDeleteBuffers(1, &VBO);
 
-  // terminate clearing all previously allocated GLFW resources
-  glfwTerminate();
+  // terminate clearing all previously allocated window resources
+  platform.terminate();
   
   
   return 0;
@@ -274,26 +267,26 @@ void framebuffer_size_callback(GLFWwindow* window, GLint width, GLint height)
   glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
   const GLfloat cameraSpeed = 2.5f * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (platform.keyPressed(GLFW_KEY_W))
     {
       camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_S))
     {
       camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_A))
     {
       camera.ProcessKeyboard(LEFT, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_D))
     {
       camera.ProcessKeyboard(RIGHT, deltaTime);
     }
@@ -329,7 +322,9 @@ GLuint loadTexture(const char* path)
   glGenTextures(1, &textureID);
 
   GLint width, height, nrComponents;
+  PROFILE_BEGIN("stbi_load");
   unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+  PROFILE_END();
   if (data)
     {
       GLenum format;
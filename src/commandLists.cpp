@@ -0,0 +1,304 @@
+/* a field of spinning cubes, recorded into command lists on every core
+   and drawn from the context thread; --threads 1 records on one */
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "platform.h"
+#include "shader.h"
+#include "camera.h"
+#include "camera_recorder.h"
+#include "command_list.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void processInput(Platform &platform);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+GLuint loadTexture(const char* path);
+
+// screen size
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+
+// cubes along each side of the field
+const int FIELD = 24;
+
+// Camera
+Camera camera(glm::vec3(0.0f, 0.0f, 40.0f));
+bool firstMouse = true;
+float lastX = 800.0f / 2.0; // half of width of window
+float lastY = 600.0f / 2.0; // half of height of window
+
+// frame delta time
+float deltaTime = 0.0f; // Time between current frame and last frame
+float lastFrame = 0.0f; // Time of last frame
+
+// a cube of the field
+struct Cube
+{
+  glm::vec3 position;
+  glm::vec3 axis;
+  float speed;
+};
+
+int main(int argc, char* argv[])
+{
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
+
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
+
+  // tell gflw to capture our mouse
+  platform.captureCursor();
+
+  // configure global opengl state
+  GlState::enable(GL_DEPTH_TEST);
+
+  Shader shader("./commandLists.vs", "./commandLists.fs", nullptr);
+
+  float cubeVertices[] = {
+	  // positions      texture coords
+	  -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
+	   0.5f, -0.5f, -0.5f, 1.0f, 0.0f,
+	   0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
+	   0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
+	  -0.5f,  0.5f, -0.5f, 0.0f, 1.0f,
+	  -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
+
+	  -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
+	   0.5f, -0.5f,  0.5f, 1.0f, 0.0f,
+	   0.5f,  0.5f,  0.5f, 1.0f, 1.0f,
+	   0.5f,  0.5f,  0.5f, 1.0f, 1.0f,
+	  -0.5f,  0.5f,  0.5f, 0.0f, 1.0f,
+	  -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
+
+	  -0.5f,  0.5f,  0.5f, 1.0f, 0.0f,
+	  -0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
+	  -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+	  -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+	  -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
+	  -0.5f,  0.5f,  0.5f, 1.0f, 0.0f,
+
+	   0.5f,  0.5f,  0.5f, 1.0f, 0.0f,
+	   0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
+	   0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+	   0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+	   0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
+	   0.5f,  0.5f,  0.5f, 1.0f, 0.0f,
+
+	  -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+	   0.5f, -0.5f, -0.5f, 1.0f, 1.0f,
+	   0.5f, -0.5f,  0.5f, 1.0f, 0.0f,
+	   0.5f, -0.5f,  0.5f, 1.0f, 0.0f,
+	  -0.5f, -0.5f,  0.5f, 0.0f, 0.0f,
+	  -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+
+	  -0.5f,  0.5f, -0.5f, 0.0f, 1.0f,
+	   0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
+	   0.5f,  0.5f,  0.5f, 1.0f, 0.0f,
+	   0.5f,  0.5f,  0.5f, 1.0f, 0.0f,
+	  -0.5f,  0.5f,  0.5f, 0.0f, 0.0f,
+	  -0.5f,  0.5f, -0.5f, 0.0f, 1.0f
+  };
+
+  // cube VBO, VAO
+  GLuint cubeVAO, cubeVBO;
+  glGenBuffers(1, &cubeVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices),
+	       cubeVertices, GL_STATIC_DRAW);
+  glGenVertexArrays(1, &cubeVAO);
+  GlState::bindVertexArray(cubeVAO);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
+			(void*)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
+			(void*)(3 * sizeof(GLfloat)));
+  glEnableVertexAttribArray(1);
+  GlState::bindVertexArray(0);
+
+  // load textures
+  GLuint textures[2];
+  textures[0] = loadTexture("./marble.jpg");
+  textures[1] = loadTexture("./container.jpg");
+
+  shader.use();
+  shader.setInt("texture1", 0);
+  // the model matrix is sent by the command lists
+  GLint modelLocation = shader.uniformLocation("model");
+
+  // the field, in slabs of equal z so each slab has one texture
+  std::vector<Cube> cubes;
+  for (int z = 0; z < FIELD; z++)
+    for (int y = 0; y < FIELD; y++)
+      for (int x = 0; x < FIELD; x++)
+	{
+	  Cube cube;
+	  cube.position = 1.5f * glm::vec3(x - FIELD / 2, y - FIELD / 2,
+					   z - FIELD / 2);
+	  cube.axis = glm::normalize(glm::vec3(1.0f + x % 3, 1.0f + y % 5,
+					       1.0f + z % 7));
+	  cube.speed = 0.5f + (x * 7 + y * 13 + z * 17) % 10 / 5.0f;
+	  cubes.push_back(cube);
+	}
+
+  CommandRecorder recorder(platform.threads());
+  CameraRecorder cameraRecorder(platform, camera);
+
+  while(platform.running())
+    {
+      float currentFrame = platform.time();
+      deltaTime = currentFrame - lastFrame;
+      lastFrame = currentFrame;
+
+      processInput(platform);
+      cameraRecorder.update();
+      // the cubes spin through recorded glUniform calls, which an
+      // --on-demand loop cannot see
+      platform.requestRedraw();
+
+      // the matrices and the draws, on every thread
+      recorder.record(cubes.size(), [&](CommandList &list, size_t begin,
+					size_t end)
+	{
+	  list.useProgram(shader.ID);
+	  list.bindVertexArray(cubeVAO);
+	  for (size_t i = begin; i < end; i++)
+	    {
+	      const Cube &cube = cubes[i];
+	      int slab = i / (FIELD * FIELD);
+	      list.bindTexture(0, GL_TEXTURE_2D, textures[slab % 2]);
+	      glm::mat4 model = glm::translate(glm::mat4(1.0f), cube.position);
+	      model = glm::rotate(model, currentFrame * cube.speed, cube.axis);
+	      float scale = 0.75f + 0.25f * sinf(currentFrame + i);
+	      model = glm::scale(model, glm::vec3(scale));
+	      list.uniformMat4(modelLocation, model);
+	      list.drawArrays(GL_TRIANGLES, 0, 36);
+	    }
+	});
+
+      glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      glm::mat4 view = camera.GetViewMatrix();
+      glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
+					      (float)SCR_WIDTH /
+					      (float)SCR_HEIGHT, 0.1f, 200.0f);
+      shader.use();
+      shader.setMat4("view", view);
+      shader.setMat4("projection", projection);
+
+      recorder.replay();
+
+      platform.endFrame();
+    }
+
+  platform.terminate();
+
+  return 0;
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+  GlState::viewport(0, 0, width, height);
+}
+
+void processInput(Platform &platform)
+{
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
+    {
+      platform.close();
+    }
+
+  if (platform.keyPressed(GLFW_KEY_W))
+    {
+      camera.ProcessKeyboard(FORWARD, deltaTime);
+    }
+  if (platform.keyPressed(GLFW_KEY_S))
+    {
+      camera.ProcessKeyboard(BACKWARD, deltaTime);
+    }
+  if (platform.keyPressed(GLFW_KEY_A))
+    {
+      camera.ProcessKeyboard(LEFT, deltaTime);
+    }
+  if (platform.keyPressed(GLFW_KEY_D))
+    {
+      camera.ProcessKeyboard(RIGHT, deltaTime);
+    }
+}
+
+// glfw: whenever the mouse mves, this callback is called
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+  if (firstMouse)
+    {
+      lastX = xpos;
+      lastY = ypos;
+      firstMouse = false;
+    }
+
+  float xoffset = xpos - lastX;
+  float yoffset = lastY - ypos; // reversed since y-coord go from bottom to top
+  lastX = xpos;
+  lastY = ypos;
+
+  camera.ProcessMouseMovement(xoffset, yoffset);
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+  camera.ProcessMouseScroll(yoffset);
+}
+
+GLuint loadTexture(const char* path)
+{
+  GLuint textureID;
+  glGenTextures(1, &textureID);
+
+  GLint width, height, nrComponents;
+  PROFILE_BEGIN("stbi_load");
+  unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+  PROFILE_END();
+  if (data)
+    {
+      GLenum format;
+      if (nrComponents == 1)
+	format = GL_RED;
+      else if (nrComponents == 3)
+	format = GL_RGB;
+      else if (nrComponents == 4)
+	format = GL_RGBA;
+
+      GlState::bindTexture(0, GL_TEXTURE_2D, textureID);
+      glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
+		   GL_UNSIGNED_BYTE, data);
+      glGenerateMipmap(GL_TEXTURE_2D);
+
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+		     GL_LINEAR_MIPMAP_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+      stbi_image_free(data);
+    }
+  else
+    {
+      std::cout << "Texture failed to load at path: " << path << std::endl;
+      stbi_image_free(data);
+    }
+
+  return textureID;
+}
@@ -7,14 +7,12 @@ layout (location = 2) in vec2 aTexCoords;
 out vec3 Normal;
 out vec3 Position;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "transform.glsl"
 
 void main()
 {
   //TexCoords = aTexCoords;
-  Normal = mat3(transpose(inverse(model))) * aNormal;
+  Normal = normalMatrix * aNormal;
   Position = vec3(model * vec4(aPos, 1.0));
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
+  gl_Position = modelViewProjection * vec4(aPos, 1.0);
 }
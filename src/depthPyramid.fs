@@ -0,0 +1,23 @@
+#version 330 core
+// a texel of a level of the depth pyramid: the farthest depth of the
+// 2 x 2 texels under it in the level below (or the depth buffer)
+out float depth;
+
+uniform sampler2D source;
+uniform vec2 sourceSize;
+
+void main()
+{
+  ivec2 first = ivec2(gl_FragCoord.xy) * 2;
+  ivec2 last = ivec2(sourceSize) - 1;
+  // a level of odd size leaves a row or column over, the texels at the
+  // edge take it in as well
+  int columns = first.x + 2 == last.x ? 3 : 2;
+  int rows = first.y + 2 == last.y ? 3 : 2;
+  float farthest = 0.0;
+  for (int y = 0; y < rows; y++)
+    for (int x = 0; x < columns; x++)
+      farthest = max(farthest,
+		     texelFetch(source, min(first + ivec2(x, y), last), 0).r);
+  depth = farthest;
+}
@@ -0,0 +1,7 @@
+#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+  FragColor = vec4(0.5, 0.5, 0.5, 1.0);
+}
\ No newline at end of file
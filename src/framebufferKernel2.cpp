@@ -6,14 +6,17 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "platform.h"
+#include "gpu_profiler.h"
 #include "shader.h"
 #include "camera.h"
+#include "camera_recorder.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow* window, GLint width, GLint height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 void mouse_callback(GLFWwindow* window, GLdouble xpos, GLdouble ypos);
 void scroll_callback(GLFWwindow* window, GLdouble xoffset, GLdouble yoffset);
 GLuint loadTexture(const char* path);
@@ -40,38 +43,21 @@ GLfloat fov = 45.0f;
 GLfloat deltaTime = 0.0f; // Time between current frame and last frame
 GLfloat lastFrame = 0.0f; // Time of last frame
 
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
 
   // tell gflw to capture our mouse
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.captureCursor();
 
   // configure global opengl state
-  glEnable(GL_DEPTH_TEST);
+  GlState::enable(GL_DEPTH_TEST);
   
   Shader shader("./framebufferPost.vs",
 		"./framebufferPost.fs", nullptr);
@@ -161,7 +147,7 @@ int main()
   glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices),
 	       cubeVertices, GL_STATIC_DRAW); 
   glGenVertexArrays(1, &cubeVAO);
-  glBindVertexArray(cubeVAO);
+  GlState::bindVertexArray(cubeVAO);
   glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
 			(void*)0);
@@ -177,7 +163,7 @@ int main()
   glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices),
 	       planeVertices, GL_STATIC_DRAW); 
   glGenVertexArrays(1, &planeVAO);
-  glBindVertexArray(planeVAO);
+  GlState::bindVertexArray(planeVAO);
   glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
 			(void*)0);
@@ -191,7 +177,7 @@ int main()
   GLuint quadVAO, quadVBO;
   glGenVertexArrays(1, &quadVAO);
   glGenBuffers(1, &quadVBO);
-  glBindVertexArray(quadVBO);
+  GlState::bindVertexArray(quadVAO);
   glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices,
 	       GL_STATIC_DRAW);
@@ -215,11 +201,11 @@ int main()
   // framebuffer configuration
   GLuint framebuffer;
   glGenFramebuffers(1, &framebuffer);
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  GlState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
   // create a color attachment texture
   GLuint textureColorbuffer;
   glGenTextures(1, &textureColorbuffer);
-  glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
+  GlState::bindTexture(0, GL_TEXTURE_2D, textureColorbuffer);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT,
 	       0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -239,22 +225,26 @@ int main()
     std::cout << "ERROR::FRAMEBUFFER::Framebuffer is not complete!" <<
       std::endl;
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  GlState::bindFramebuffer(GL_FRAMEBUFFER, platform.framebuffer());
 
-  while(!glfwWindowShouldClose(window))
+  CameraRecorder cameraRecorder(platform, camera);
+
+  while(platform.running())
     {
-      float currentFrame = glfwGetTime();
+      float currentFrame = platform.time();
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
 
-      processInput(window);
+      processInput(platform);
+      cameraRecorder.update();
 
       // render
       // bind to framebuffer and draw scene
-      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-      glEnable(GL_DEPTH_TEST); // enable depth testing
-                               // it is disabled in rendering screen->space
-                               // quad
+      GpuProfiler::push("rear view");
+      GlState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+      GlState::enable(GL_DEPTH_TEST); // enable depth testing
+                                      // it is disabled in rendering
+                                      // screen->space quad
       
       glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -277,9 +267,8 @@ int main()
       shader.setMat4("projection", projection);
 
       // render cubes
-      glBindVertexArray(cubeVAO);
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, cubeTexture);
+      GlState::bindVertexArray(cubeVAO);
+      GlState::bindTexture(0, GL_TEXTURE_2D, cubeTexture);
       model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
       shader.setMat4("model", model);
       glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -289,17 +278,20 @@ int main()
       glDrawArrays(GL_TRIANGLES, 0, 36);
 
       // floor
-      glBindVertexArray(planeVAO);
-      glBindTexture(GL_TEXTURE_2D, floorTexture);
+      GlState::bindVertexArray(planeVAO);
+      GlState::bindTexture(0, GL_TEXTURE_2D, floorTexture);
       shader.setMat4("model", glm::mat4(1.0f));
       glDrawArrays(GL_TRIANGLES, 0, 36);
-      glBindVertexArray(0);
+
+      GpuProfiler::pop();
 
       // now back to the default framebuffer and draw a quad plane with
       // the attached framebuffer color texture
-      glBindFramebuffer(GL_FRAMEBUFFER, 0);
-      glDisable(GL_DEPTH_TEST); // disable depth test so screen-space quad
-                                // is not discarded due to depth test
+      GpuProfiler::push("scene");
+      GlState::bindFramebuffer(GL_FRAMEBUFFER, platform.framebuffer());
+      // disable depth test so screen-space quad is not discarded due to
+      // depth test
+      GlState::disable(GL_DEPTH_TEST);
       // clear relevant buffers
       glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -308,9 +300,8 @@ int main()
       view = camera.GetViewMatrix();
       shader.setMat4("view", view);
       // render cubes
-      glBindVertexArray(cubeVAO);
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, cubeTexture);
+      GlState::bindVertexArray(cubeVAO);
+      GlState::bindTexture(0, GL_TEXTURE_2D, cubeTexture);
       model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
       shader.setMat4("model", model);
       glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -320,25 +311,29 @@ int main()
       glDrawArrays(GL_TRIANGLES, 0, 36);
 
       // floor
-      glBindVertexArray(planeVAO);
-      glBindTexture(GL_TEXTURE_2D, floorTexture);
+      GlState::bindVertexArray(planeVAO);
+      GlState::bindTexture(0, GL_TEXTURE_2D, floorTexture);
       shader.setMat4("model", glm::mat4(1.0f));
       glDrawArrays(GL_TRIANGLES, 0, 36);
-      glBindVertexArray(0);
+
+      GpuProfiler::pop();
 
       // draw the mirror quad
-      glDisable(GL_DEPTH_TEST); // disable so screen-space quad isnt discarded
+      GpuProfiler::push("screen quad");
+      // disable so screen-space quad isnt discarded
+      GlState::disable(GL_DEPTH_TEST);
       
       screenShader.use();
-      glBindVertexArray(quadVAO);
-      glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
+      GlState::bindVertexArray(quadVAO);
+      GlState::bindTexture(0, GL_TEXTURE_2D, textureColorbuffer);
       glDrawArrays(GL_TRIANGLES, 0, 6);
       
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      GpuProfiler::pop();
+      
+      platform.endFrame();
     }
 
-  glfwTerminate();
+  platform.terminate();
   
   
   return 0;
@@ -346,30 +341,30 @@ int main()
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-  glViewport(0, 0, width, height);
+  GlState::viewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
   const float cameraSpeed = 2.5f * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
 
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_W))
     {
       camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_S))
     {
       camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_A))
     {
       camera.ProcessKeyboard(LEFT, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_D))
     {
       camera.ProcessKeyboard(RIGHT, deltaTime);
     }
@@ -405,7 +400,9 @@ GLuint loadTexture(const char* path)
   glGenTextures(1, &textureID);
 
   GLint width, height, nrComponents;
+  PROFILE_BEGIN("stbi_load");
   unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+  PROFILE_END();
   if (data)
     {
       GLenum format;
@@ -416,7 +413,7 @@ GLuint loadTexture(const char* path)
       else if (nrComponents == 4)
 	format = GL_RGBA;
 
-      glBindTexture(GL_TEXTURE_2D, textureID);
+      GlState::bindTexture(0, GL_TEXTURE_2D, textureID);
       glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
 		   GL_UNSIGNED_BYTE, data);
       glGenerateMipmap(GL_TEXTURE_2D);
@@ -8,12 +8,14 @@ out VS_OUT {
 
 out vec2 TexCoords;
 
+#include "transform.glsl"
+
+// the camera view only rotates and translates, so its own upper 3x3
+// already transforms normals
 uniform mat4 view;
-uniform mat4 model;
 
 void main()
 {
-  mat3 normalMatrix = mat3(transpose(inverse(view * model)));
-  vs_out.normal = vec3(vec4(normalMatrix * aNormal, 0.0));
+  vs_out.normal = mat3(view) * normalMatrix * aNormal;
   gl_Position = view * model * vec4(aPos, 1.0f);
 }
\ No newline at end of file
@@ -6,16 +6,23 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "platform.h"
 #include "shader.h"
+#include "shader_queue.h"
 #include "camera.h"
+#include "camera_recorder.h"
+#include "buffer_layout.h"
+#include "stream_buffer.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <string>
 #include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 GLuint loadTexture(const char* path);
@@ -42,45 +49,64 @@ float fov = 45.0f;
 float deltaTime = 0.0f; // Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
-int main()
+// CPU mirror of the Matrices uniform block in glslubo.vs, checked
+// against its std140 layout so it can be uploaded in one go
+struct Matrices
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-  GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT,
-					"LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
+  glm::mat4 projection;
+  glm::mat4 view;
+};
+typedef GpuBlock<Std140, glm::mat4, glm::mat4> MatricesLayout;
+GPU_LAYOUT_MEMBER(Matrices, projection, MatricesLayout, 0);
+GPU_LAYOUT_MEMBER(Matrices, view, MatricesLayout, 1);
+GPU_LAYOUT_SIZE(Matrices, MatricesLayout);
+
+int main(int argc, char* argv[])
+{
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
 
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
 
   // tell gflw to capture our mouse
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.captureCursor();
 
   // configure global opengl state
   glEnable(GL_DEPTH_TEST);
 
   
   
-  Shader shaderRed("./glslubo.vs", "./red.fs", nullptr);
-  Shader shaderGreen("./glslubo.vs", "./green.fs", nullptr);
-  Shader shaderBlue("./glslubo.vs", "./blue.fs", nullptr);
-  Shader shaderYellow("./glslubo.vs", "./yellow.fs", nullptr);
+  // links a program's Matrices block to uniform binding point 0
+  std::function<void(Shader&)> bindMatrices = [](Shader &shader)
+    {
+      GLuint uniformBlockIndex = glGetUniformBlockIndex(shader.ID,
+							"Matrices");
+      glUniformBlockBinding(shader.ID, uniformBlockIndex, 0);
+    };
+
+  // the fallback program is tiny and built right away, the real ones
+  // compile in parallel while the first frames are drawn with it
+  Shader fallbackShader("./glslubo.vs", "./fallback.fs", nullptr);
+  bindMatrices(fallbackShader);
+  std::vector<std::string> matricesNames;
+  matricesNames.push_back("projection");
+  matricesNames.push_back("view");
+  checkBlockLayout<MatricesLayout>(fallbackShader.ID, "Matrices",
+				   matricesNames);
+
+  ShaderQueue shaderQueue;
+  Shader shaderRed, shaderGreen, shaderBlue, shaderYellow;
+  shaderQueue.submit(shaderRed, "./glslubo.vs", "./red.fs", nullptr,
+		     bindMatrices);
+  shaderQueue.submit(shaderGreen, "./glslubo.vs", "./green.fs", nullptr,
+		     bindMatrices);
+  shaderQueue.submit(shaderBlue, "./glslubo.vs", "./blue.fs", nullptr,
+		     bindMatrices);
+  shaderQueue.submit(shaderYellow, "./glslubo.vs", "./yellow.fs", nullptr,
+		     bindMatrices);
 
   
   // points for our rectangle created with two triangles
@@ -142,94 +168,89 @@ int main()
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat),
 			(void*)0);
 
-  // configure a uniform buffer
-  // first we get the relevant block indices
-  GLuint uniformBlockIndexRed = glGetUniformBlockIndex(shaderRed.ID,
-							 "Matrices");
-  GLuint uniformBlockIndexGreen = glGetUniformBlockIndex(shaderGreen.ID,
-							   "Matrices");
-  GLuint uniformBlockIndexBlue = glGetUniformBlockIndex(shaderBlue.ID,
-							"Matrices");
-  GLuint uniformBlockIndexYellow = glGetUniformBlockIndex(shaderYellow.ID,
-							  "Matrices");
-  // then we link each shader's unifrom block to this uniform binding point
-  glUniformBlockBinding(shaderRed.ID, uniformBlockIndexRed, 0);
-  glUniformBlockBinding(shaderGreen.ID, uniformBlockIndexGreen, 0);
-  glUniformBlockBinding(shaderBlue.ID, uniformBlockIndexBlue, 0);
-  glUniformBlockBinding(shaderYellow.ID, uniformBlockIndexYellow, 0);
-  // now create the buffer
-  GLuint uboMatrices;
-  glGenBuffers(1, &uboMatrices);
-  glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-  glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4),
-	       NULL, GL_STATIC_DRAW);
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
-  // define the range of the buffer that links to a uniform binding point
-  glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0,
-		    2 * sizeof(glm::mat4));
-  // store the projection matrix (we only do this once now
-  glm::mat4 projection = glm::perspective(45.0f, (GLfloat)SCR_WIDTH /
-					  (GLfloat)SCR_HEIGHT, 1.0f, 100.0f);
-  glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4),
-		  glm::value_ptr(projection));
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  // the Matrices block is written into a streaming buffer every frame,
+  // each frame into its own region so no upload waits for the GPU
+  StreamBuffer uniformStream(4 * 1024);
+  // the projection matrix never changes, the view is updated per frame
+  Matrices matrices;
+  matrices.projection = glm::perspective(45.0f, (GLfloat)SCR_WIDTH /
+					 (GLfloat)SCR_HEIGHT, 1.0f, 100.0f);
   
-  while(!glfwWindowShouldClose(window))
+  CameraRecorder cameraRecorder(platform, camera);
+
+  while(platform.running())
     {
-      float currentFrame = glfwGetTime();
+      float currentFrame = platform.time();
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
 
-      processInput(window);
+      processInput(platform);
+      cameraRecorder.update();
 
       glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-      // set the view and projection matrix in uniform block
-      glm::mat4 view = camera.GetViewMatrix();
-      glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-      glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4),
-		      sizeof(glm::mat4), glm::value_ptr(view));
-      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      // upload the whole uniform block with a single copy
+      matrices.view = camera.GetViewMatrix();
+      uniformStream.beginFrame();
+      StreamBuffer::Range block =
+	uniformStream.allocate(sizeof(Matrices),
+			       StreamBuffer::uniformAlignment());
+      memcpy(block.pointer, &matrices, sizeof(Matrices));
+      uniformStream.commit();
+      // define the range of the buffer that links to a uniform binding point
+      glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniformStream.buffer(),
+			block.offset, block.size);
       
+      // pick up programs the driver has finished, without waiting
+      shaderQueue.poll();
+      Shader &red = shaderQueue.ready(shaderRed) ?
+	shaderRed : fallbackShader;
+      Shader &green = shaderQueue.ready(shaderGreen) ?
+	shaderGreen : fallbackShader;
+      Shader &yellow = shaderQueue.ready(shaderYellow) ?
+	shaderYellow : fallbackShader;
+      Shader &blue = shaderQueue.ready(shaderBlue) ?
+	shaderBlue : fallbackShader;
+
       // render 4 cubes
       // Red
       glBindVertexArray(cubeVAO);
-      shaderRed.use();
+      red.use();
       glm::mat4 model = glm::mat4(1.0f);
       model = glm::translate(model, glm::vec3(-0.75f, 0.75f, 0.0f));
-      shaderRed.setMat4("model", model);
+      red.setMat4("model", model);
       glDrawArrays(GL_TRIANGLES, 0, 36);
       // Green
       glBindVertexArray(cubeVAO);
-      shaderGreen.use();
+      green.use();
       model = glm::mat4(1.0f);
       model = glm::translate(model, glm::vec3(0.75f, 0.75f, 0.0f));
-      shaderGreen.setMat4("model", model);
+      green.setMat4("model", model);
       glDrawArrays(GL_TRIANGLES, 0, 36);
       // Yellow
-      shaderYellow.use();
+      yellow.use();
       model = glm::mat4(1.0f);
       model = glm::translate(model, glm::vec3(-0.75f, -0.75f, 0.0f));
-      shaderYellow.setMat4("model", model);
+      yellow.setMat4("model", model);
       glDrawArrays(GL_TRIANGLES, 0, 36);
       // Blue
-      shaderBlue.use();
+      blue.use();
       model = glm::mat4(1.0f);
       model = glm::translate(model, glm::vec3(0.75f, -0.75f, 0.0f));
-      shaderBlue.setMat4("model", model);
+      blue.setMat4("model", model);
       glDrawArrays(GL_TRIANGLES, 0, 36);
 
 
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      uniformStream.endFrame();
+      platform.endFrame();
     }
   glDeleteVertexArrays(1, &cubeVAO);
   glDeleteBuffers(1, &cubeVBO);
+  uniformStream.destroy();
 
 
-  glfwTerminate();
+  platform.terminate();
   
   
   return 0;
@@ -240,27 +261,27 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
   glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
   const float cameraSpeed = 2.5f * deltaTime;
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
 
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_W))
     {
       camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_S))
     {
       camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_A))
     {
       camera.ProcessKeyboard(LEFT, deltaTime);
     }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_D))
     {
       camera.ProcessKeyboard(RIGHT, deltaTime);
     }
@@ -296,7 +317,9 @@ GLuint loadTexture(const char* path)
   glGenTextures(1, &textureID);
 
   GLint width, height, nrComponents;
+  PROFILE_BEGIN("stbi_load");
   unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+  PROFILE_END();
   if (data)
     {
       GLenum format;
@@ -347,8 +370,10 @@ GLuint loadCubemap(std::vector<const char*> faces)
 
   GLint width, height, nrChannels;
   for (GLuint i = 0; i < faces.size(); i++) {
+    PROFILE_BEGIN("stbi_load");
     unsigned char* data = stbi_load(faces[i], &width, &height,
 				   &nrChannels, 0);
+    PROFILE_END();
     if (data)
       {
 	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB,
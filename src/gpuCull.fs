@@ -0,0 +1,8 @@
+#version 330 core
+// nothing is drawn, the cull runs with GL_RASTERIZER_DISCARD
+out vec4 FragColor;
+
+void main()
+{
+  FragColor = vec4(1.0);
+}
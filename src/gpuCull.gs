@@ -0,0 +1,42 @@
+#version 330 core
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in VS_OUT {
+  mat4 model;
+#ifdef OCCLUDED
+  vec4 sphere;
+  vec3 low;
+  vec3 high;
+#endif
+  flat int visible;
+} gs_in[];
+
+// captured by transform feedback, packed one after the other: the
+// model matrices to draw, or with OCCLUDED whole instance records to
+// test again
+#ifdef OCCLUDED
+out mat4 recordModel;
+out vec4 recordSphere;
+out vec3 recordLow;
+out vec3 recordHigh;
+#else
+out mat4 instanceModel;
+#endif
+
+void main()
+{
+  if (gs_in[0].visible != 0)
+    {
+#ifdef OCCLUDED
+      recordModel = gs_in[0].model;
+      recordSphere = gs_in[0].sphere;
+      recordLow = gs_in[0].low;
+      recordHigh = gs_in[0].high;
+#else
+      instanceModel = gs_in[0].model;
+#endif
+      EmitVertex();
+      EndPrimitive();
+    }
+}
@@ -0,0 +1,99 @@
+#version 330 core
+layout (location = 0) in mat4 aModel;
+layout (location = 4) in vec4 aSphere;
+layout (location = 5) in vec3 aLow;
+layout (location = 6) in vec3 aHigh;
+
+// the frustum in world space, pointing inwards
+uniform vec4 planes[6];
+
+out VS_OUT {
+  mat4 model;
+#ifdef OCCLUDED
+  vec4 sphere;
+  vec3 low;
+  vec3 high;
+#endif
+  flat int visible;
+} vs_out;
+
+#ifdef OCCLUSION
+// the depth pyramid (depth_pyramid.h) and the view it was drawn from
+uniform sampler2D pyramid;
+uniform mat4 pyramidViewProjection;
+uniform vec2 depthSize;
+uniform int pyramidLevels;
+
+// whether the box lies behind everything the pyramid holds where it
+// would be drawn. A box reaching behind the camera is never hidden
+bool occluded(vec3 low, vec3 high)
+{
+  vec3 near = vec3(1.0);
+  vec3 far = vec3(-1.0);
+  for (int i = 0; i < 8; i++)
+    {
+      vec3 corner = vec3((i & 1) != 0 ? high.x : low.x,
+			 (i & 2) != 0 ? high.y : low.y,
+			 (i & 4) != 0 ? high.z : low.z);
+      vec4 clip = pyramidViewProjection * vec4(corner, 1.0);
+      if (clip.w <= 0.0)
+	return false;
+      vec3 ndc = clip.xyz / clip.w;
+      near = min(near, ndc);
+      far = max(far, ndc);
+    }
+  // the pixels the box covers, and the level where they are at most
+  // 2 x 2 texels: texel i of level L covers pixels i * 2^(L + 1) on
+  vec2 first = clamp(near.xy * 0.5 + 0.5, 0.0, 1.0) * depthSize;
+  vec2 last = clamp(far.xy * 0.5 + 0.5, 0.0, 1.0) * depthSize;
+  vec2 extent = (last - first) * 0.5;
+  int level = min(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))),
+		  pyramidLevels - 1);
+  ivec2 size = max(ivec2(depthSize) >> (level + 1), ivec2(1));
+  float scale = exp2(float(-level - 1));
+  ivec2 a = min(ivec2(first * scale), size - 1);
+  ivec2 b = min(ivec2(last * scale), size - 1);
+  // the size from depthSize, and textureLod rather than texelFetch:
+  // Mesa's llvmpipe gets both textureSize and texelFetch wrong when the
+  // level differs between the vertices of a batch
+  vec2 texel = 1.0 / vec2(size);
+  float lod = float(level);
+  float farthest =
+    max(max(textureLod(pyramid, (vec2(a) + 0.5) * texel, lod).r,
+	    textureLod(pyramid, (vec2(b.x, a.y) + 0.5) * texel, lod).r),
+	max(textureLod(pyramid, (vec2(a.x, b.y) + 0.5) * texel, lod).r,
+	    textureLod(pyramid, (vec2(b) + 0.5) * texel, lod).r));
+  return near.z * 0.5 + 0.5 > farthest;
+}
+#endif
+
+void main()
+{
+  // the sphere first, then the corner of the box furthest along each
+  // plane's normal, the same tests as FrustumCuller
+  bool inside = true;
+  for (int p = 0; p < 6; p++)
+    inside = inside && dot(planes[p].xyz, aSphere.xyz) + planes[p].w >= -aSphere.w;
+  for (int p = 0; p < 6; p++)
+    {
+      vec3 corner = mix(aLow, aHigh, step(0.0, planes[p].xyz));
+      inside = inside && dot(planes[p].xyz, corner) + planes[p].w >= 0.0;
+    }
+#ifdef OCCLUSION
+  // the instances in the frustum split into those in front of the
+  // pyramid and, with OCCLUDED, those behind it
+  bool hidden = inside && occluded(aLow, aHigh);
+#ifdef OCCLUDED
+  inside = hidden;
+#else
+  inside = inside && !hidden;
+#endif
+#endif
+  vs_out.model = aModel;
+#ifdef OCCLUDED
+  vs_out.sphere = aSphere;
+  vs_out.low = aLow;
+  vs_out.high = aHigh;
+#endif
+  vs_out.visible = inside ? 1 : 0;
+}
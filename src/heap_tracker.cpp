@@ -0,0 +1,4 @@
+// The global operator new and delete of heap_tracker.h, linked into
+// every demo when built with -DTRACK_ALLOCATIONS=ON.
+#define HEAP_TRACKER_IMPLEMENTATION
+#include <heap_tracker.h>
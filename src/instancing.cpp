@@ -1,35 +1,21 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include "platform.h"
 #include "shader.h"
+#include "stream_buffer.h"
+#include <cmath>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(Platform &platform);
 
-int main()
+int main(int argc, char* argv[])
 {
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  Platform platform(argc, argv);
+  if (!platform.createWindow(800, 600, "LearnOpenGL"))
+    return -1;
 
-  GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
-  if (window == NULL)
-    {
-      std::cout << "Failed to create GLFW window" << std::endl;
-      glfwTerminate();
-      return -1;
-    }
-
-  glfwMakeContextCurrent(window);
-
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-      std::cout << "Failed to initialize GLAD" << std::endl;
-      return -1;
-    }
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
 
   glEnable(GL_DEPTH_TEST);
 
@@ -51,12 +37,8 @@ int main()
     }
   }
 
-  GLuint instanceVBO;
-  glGenBuffers(1, &instanceVBO);
-  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * 100, &translations[0],
-	       GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // the translations sway a little and are streamed every frame
+  StreamBuffer instanceStream(sizeof(glm::vec2) * 100);
 
   
   // points for our triangle
@@ -76,7 +58,7 @@ int main()
   glGenVertexArrays(1, &quadVAO);
   glGenBuffers(1, &quadVBO);
   glBindVertexArray(quadVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, quadVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices,
 	       GL_STATIC_DRAW);
   glEnableVertexAttribArray(0);
@@ -85,38 +67,48 @@ int main()
   glEnableVertexAttribArray(1);
   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
 			(void*)(2 * sizeof(GLfloat)));
-  // also set the instance data
+  // also set the instance data, pointed at this frame's region in the
+  // loop
   glEnableVertexAttribArray(2);
-  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat),
-			(void*)0);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
   glVertexAttribDivisor(2, 1); // tell OpenGL this is the instanced vertex
 
-  while(!glfwWindowShouldClose(window))
+  while(platform.running())
     {
       glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
       shader.use();
-      for (GLuint i = 0; i < 100; i++) {
-	shader.setVec2(("offsets[" + std::to_string(i) + "]"),
-		       translations[i]);
-      }
+
+      instanceStream.beginFrame();
+      StreamBuffer::Range instances =
+	instanceStream.allocate(sizeof(glm::vec2) * 100);
+      glm::vec2* offsets = (glm::vec2*)instances.pointer;
+      float t = platform.time();
+      for (GLuint i = 0; i < 100; i++)
+	offsets[i] = translations[i] + glm::vec2(0.01f * sinf(t * 2.0f + i),
+						 0.01f * cosf(t * 2.0f + i));
+      instanceStream.commit();
+      // the sway only reaches the stream buffer, so --on-demand has to
+      // be told to go on drawing
+      platform.requestRedraw();
     
       glBindVertexArray(quadVAO);
+      glBindBuffer(GL_ARRAY_BUFFER, instanceStream.buffer());
+      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat),
+			    (void*)instances.offset);
       glDrawArraysInstanced(GL_TRIANGLES, 0, 6, 100); // 100 triangles
       glBindVertexArray(0);
+      instanceStream.endFrame();
       
-      processInput(window);
+      processInput(platform);
       
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      platform.endFrame();
     }
 
   glDeleteVertexArrays(1, &quadVAO);
   glDeleteBuffers(1, &quadVBO);
-  glfwTerminate();
+  instanceStream.destroy();
+  platform.terminate();
   
   
   return 0;
@@ -127,10 +119,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
   glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(Platform &platform)
 {
-  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
     {
-      glfwSetWindowShouldClose(window, true);
+      platform.close();
     }
 }
@@ -0,0 +1,52 @@
+// shared material and light structs, included by the lighting shaders.
+// Define HAS_SPECULAR_MAP before including to sample the specular
+// color from a texture instead of using a constant, HAS_EMISSION_MAP
+// to add an emission map.
+
+struct Material {
+  sampler2D diffuse;
+#ifdef HAS_SPECULAR_MAP
+  sampler2D specular;
+#else
+  vec3 specular;
+#endif
+#ifdef HAS_EMISSION_MAP
+  sampler2D emission;
+#endif
+  float shininess;
+};
+
+struct DirLight {
+  vec3 direction;
+
+  vec3 ambient;
+  vec3 diffuse;
+  vec3 specular;
+};
+
+struct PointLight {
+  vec3 position;
+
+  float constant;
+  float linear;
+  float quadratic;
+
+  vec3 ambient;
+  vec3 diffuse;
+  vec3 specular;
+};
+
+struct SpotLight {
+  vec3 position;
+  vec3 direction;
+  float cutOff;
+  float outerCutOff;
+  
+  vec3 ambient;
+  vec3 diffuse;
+  vec3 specular;
+
+  float constant;
+  float linear;
+  float quadratic;
+};
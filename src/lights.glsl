@@ -0,0 +1,43 @@
+// scene lights shared by every lighting program through the Lights
+// uniform block, bound to binding point 1 by LightBuffer. With
+// LIGHTS_IN_TBO the point lights come from a buffer texture instead,
+// so their number is not limited by the uniform block size.
+#include "lighting.glsl"
+
+// has to match LightBuffer::MAX_UBO_POINT_LIGHTS
+#define MAX_POINT_LIGHTS 64
+
+layout (std140) uniform Lights
+{
+  DirLight dirLight;
+  SpotLight spotLight;
+  int nrPointLights;
+#ifndef LIGHTS_IN_TBO
+  PointLight pointLights[MAX_POINT_LIGHTS];
+#endif
+};
+
+#ifdef LIGHTS_IN_TBO
+// 5 texels per light, laid out like the std140 PointLight struct
+uniform samplerBuffer pointLightTexels;
+#endif
+
+PointLight getPointLight(int i)
+{
+#ifdef LIGHTS_IN_TBO
+  int base = i * 5;
+  vec4 texel0 = texelFetch(pointLightTexels, base);
+  vec4 texel1 = texelFetch(pointLightTexels, base + 1);
+  PointLight light;
+  light.position = texel0.xyz;
+  light.constant = texel0.w;
+  light.linear = texel1.x;
+  light.quadratic = texel1.y;
+  light.ambient = texelFetch(pointLightTexels, base + 2).xyz;
+  light.diffuse = texelFetch(pointLightTexels, base + 3).xyz;
+  light.specular = texelFetch(pointLightTexels, base + 4).xyz;
+  return light;
+#else
+  return pointLights[i];
+#endif
+}
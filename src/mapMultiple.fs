@@ -1,59 +1,34 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-  sampler2D diffuse;
-  sampler2D specular;
-  float shininess;
-};
-
-struct DirLight {
-  vec3 direction;
-
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};
-
-struct PointLight {
-  vec3 position;
-
-  float constant;
-  float linear;
-  float quadratic;
-
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};
-
-struct SpotLight {
-  vec3 position;
-  vec3 direction;
-  float cutOff;
-  float outerCutOff;
-  
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-
-  float constant;
-  float linear;
-  float quadratic;
-};
-
-#define NR_POINT_LIGHTS 4
+// permutation switches, injected by Shader:
+// NR_POINT_LIGHTS   fixed number of point lights (0 drops the loop),
+//                   without it the loop runs over nrPointLights
+// HAS_SPECULAR_MAP  sample material.specular instead of a constant
+// NO_DIRLIGHT       skip the directional light
+// NO_SPOTLIGHT      skip the spot light
+// LIGHTS_IN_TBO     point lights come from a buffer texture
+#ifdef NR_POINT_LIGHTS
+#if NR_POINT_LIGHTS > 0
+#define HAS_POINT_LIGHTS
+#endif
+#else
+#define HAS_POINT_LIGHTS
+#define NR_POINT_LIGHTS nrPointLights
+#endif
+
+#include "lights.glsl"
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
 uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight  spotLight;
 uniform Material material;
 
+// material colors, sampled once per fragment
+vec3 diffuseColor;
+vec3 specularColor;
 
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
@@ -67,14 +42,27 @@ void main()
     // properties
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
-
+    diffuseColor = texture(material.diffuse, TexCoords).rgb;
+#ifdef HAS_SPECULAR_MAP
+    specularColor = texture(material.specular, TexCoords).rgb;
+#else
+    specularColor = material.specular;
+#endif
+
+    vec3 result = vec3(0.0);
+#ifndef NO_DIRLIGHT
     // phase 1 directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+    result += CalcDirLight(dirLight, norm, viewDir);
+#endif
+#ifdef HAS_POINT_LIGHTS
     // phase 2 point lights
     for (int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+        result += CalcPointLight(getPointLight(i), norm, FragPos, viewDir);
+#endif
+#ifndef NO_SPOTLIGHT
     // phase 3 spot light
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
 
     FragColor = vec4(result, 1.0);
 
@@ -91,12 +79,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse,
-                                   TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse,
-                                   TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular,
-                                   TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     return (ambient + diffuse + specular);
 }
 
@@ -114,11 +99,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float attenuation = 1.0 / (light.constant + light.linear * distance
                                + light.quadratic * (distance * distance));
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse,
-                                    TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular,
-                                    TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -147,15 +130,13 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = (light.cutOff - light.outerCutOff);
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse,
-                                             TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.specular,
-                                              TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
 
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
 
     return (ambient + diffuse + specular);
-}
\ No newline at end of file
+}
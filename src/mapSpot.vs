@@ -7,16 +7,14 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "transform.glsl"
 
 void main()
 {
   FragPos = vec3(model * vec4(aPos, 1.0));
-  Normal = mat3(transpose(inverse(model))) * aNormal;
+  Normal = normalMatrix * aNormal;
   TexCoords = aTexCoords;
   
-  gl_Position = projection * view * model * vec4(FragPos, 1.0);
+  gl_Position = modelViewProjection * vec4(aPos, 1.0);
 
 }
\ No newline at end of file
@@ -1,36 +1,21 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-  sampler2D diffuse;
-  sampler2D specular;
-  float shininess;
-};
-
-struct Light {
-  vec3 position;
-  
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-
-  float constant;
-  float linear;
-  float quadratic;
-};
-
+#define HAS_SPECULAR_MAP
+#include "lights.glsl"
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
 uniform Material material;
-uniform Light    light;
 uniform vec3 viewPos;
 
 
 void main()
 {
+  PointLight light = getPointLight(0);
+
 
   // ambient
   vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
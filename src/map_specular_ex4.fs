@@ -1,28 +1,15 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-  sampler2D diffuse;
-  sampler2D specular;
-  sampler2D emission;
-  float shininess;
-};
-
-struct Light {
-  vec3 position;
-
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};
-
+#define HAS_SPECULAR_MAP
+#define HAS_EMISSION_MAP
+#include "lights.glsl"
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
 uniform Material material;
-uniform Light    light;
 uniform vec3 viewPos;
 
 vec3 calculate_emission()
@@ -34,6 +21,8 @@ vec3 calculate_emission()
 
 void main()
 {
+  PointLight light = getPointLight(0);
+
   // ambient
   vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
 
@@ -0,0 +1,502 @@
+/* a ring of shuttles, 100000 by default (--instances N), each mesh of
+   the model drawn once per frame for all of them with the model
+   matrices in an instance buffer. The shuttles outside the view are
+   culled on the CPU first (frustum_culler.h), on the GPU with --cull gpu
+   (gpu_culler.h); --cull hiz also leaves out those hidden behind others
+   (depth_pyramid.h), --cull none draws them all */
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <platform.h>
+#include <shader.h>
+#include <camera.h>
+#include <camera_recorder.h>
+#include <model.h>
+#include <depth_pyramid.h>
+#include <frustum_culler.h>
+#include <gpu_culler.h>
+#include <gpu_profiler.h>
+#include <stream_buffer.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void processInput(Platform &platform);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+
+// screen size
+const unsigned int SCR_WIDTH = 1024;
+const unsigned int SCR_HEIGHT = 768;
+
+// the ring the shuttles fly in
+const float RING_RADIUS = 150.0f;
+const float RING_WIDTH = 25.0f;
+
+// Camera
+Camera camera(glm::vec3(0.0f, 10.0f, 230.0f));
+bool firstMouse = true;
+float lastX = SCR_WIDTH / 2.0f;
+float lastY = SCR_HEIGHT / 2.0f;
+
+// the target of --cull hiz, resized with the framebuffer
+DepthPyramid* pyramid = NULL;
+
+// frame delta time
+float deltaTime = 0.0f; // Time between current frame and last frame
+float lastFrame = 0.0f; // Time of last frame
+
+// a random number in [-1, 1]
+float spread()
+{
+  return (rand() % 2001) / 1000.0f - 1.0f;
+}
+
+// how the shuttles outside the view are left out
+enum Culling { CULL_NONE, CULL_CPU, CULL_GPU, CULL_HIZ };
+const char* CULLING_NAMES[] = { "none", "cpu", "gpu", "hiz" };
+
+// counts the fragments the shuttle draws shade, with
+// ARB_pipeline_statistics_query, read LATENCY frames later. A frame's
+// draws may be split around other work, each part in a query of its own
+class FragmentCounter
+{
+ public:
+  static const unsigned int LATENCY = GpuCuller::LATENCY;
+  static const unsigned int PARTS = 2;
+
+  FragmentCounter() : frame(0), part(0), frames(0), total(0)
+  {
+    if (!available())
+      return;
+    for (unsigned int i = 0; i < LATENCY; i++)
+      {
+	glGenQueries(PARTS, queries[i]);
+	for (unsigned int p = 0; p < PARTS; p++)
+	  issued[i][p] = false;
+      }
+  }
+
+  static bool available()
+  {
+    return GLAD_GL_ARB_pipeline_statistics_query != 0;
+  }
+
+  void begin()
+  {
+    if (available())
+      glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+		   queries[frame % LATENCY][part]);
+  }
+
+  void end()
+  {
+    if (!available())
+      return;
+    glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+    issued[frame % LATENCY][part++] = true;
+  }
+
+  // reads the queries of LATENCY frames ago before they are reused
+  void nextFrame()
+  {
+    frame++;
+    part = 0;
+    if (!available() || frame < LATENCY)
+      return;
+    unsigned int slot = frame % LATENCY;
+    for (unsigned int p = 0; p < PARTS; p++)
+      if (issued[slot][p])
+	{
+	  GLuint64 value = 0;
+	  glGetQueryObjectui64v(queries[slot][p], GL_QUERY_RESULT, &value);
+	  total += value;
+	  issued[slot][p] = false;
+	}
+    frames++;
+  }
+
+  unsigned long long perFrame() const
+  {
+    return frames > 0 ? total / frames : 0;
+  }
+
+  void destroy()
+  {
+    if (available())
+      for (unsigned int i = 0; i < LATENCY; i++)
+	glDeleteQueries(PARTS, queries[i]);
+  }
+
+ private:
+  GLuint queries[LATENCY][PARTS];
+  bool issued[LATENCY][PARTS];
+  unsigned long frame;
+  unsigned int part;
+  unsigned long frames;
+  unsigned long long total;
+};
+
+int main(int argc, char* argv[])
+{
+  Culling culling = CULL_CPU;
+  for (int i = 1; i + 1 < argc; i++)
+    if (strcmp(argv[i], "--cull") == 0)
+      for (int c = CULL_NONE; c <= CULL_HIZ; c++)
+	if (strcmp(argv[i + 1], CULLING_NAMES[c]) == 0)
+	  culling = (Culling)c;
+
+  Platform platform(argc, argv);
+  if (!platform.createWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
+
+  platform.setFramebufferSizeCallback(framebuffer_size_callback);
+  platform.setCursorPosCallback(mouse_callback);
+  platform.setScrollCallback(scroll_callback);
+
+  // tell gflw to capture our mouse
+  platform.captureCursor();
+
+  // configure global opengl state
+  GlState::enable(GL_DEPTH_TEST);
+
+  Shader shader("./shuttleField.vs", "./shuttleField.fs", nullptr);
+
+  Model shuttle("./Star Wars emperor shuttle.obj");
+
+  // the model sits far from its origin, each instance matrix first moves
+  // it to the origin and scales it to about one unit
+  glm::vec3 low(1e30f), high(-1e30f);
+  unsigned long triangles = 0;
+  for (unsigned int i = 0; i < shuttle.meshes.size(); i++)
+    {
+      const Mesh &mesh = shuttle.meshes[i];
+      for (unsigned int v = 0; v < mesh.vertices.size(); v++)
+	{
+	  low = glm::min(low, mesh.vertices[v].Position);
+	  high = glm::max(high, mesh.vertices[v].Position);
+	}
+      triangles += mesh.indices.size() / 3;
+    }
+  glm::vec3 extent = high - low;
+  float size = std::max(extent.x, std::max(extent.y, extent.z));
+  glm::mat4 fit = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / size));
+  fit = glm::translate(fit, -(low + high) * 0.5f);
+
+  // the same ring on every run
+  unsigned int count = platform.instances(100000);
+  std::vector<glm::mat4> models(count);
+  srand(1);
+  for (unsigned int i = 0; i < count; i++)
+    {
+      float angle = glm::radians(360.0f) * i / count;
+      float radius = RING_RADIUS + RING_WIDTH * spread();
+      glm::vec3 position(sinf(angle) * radius, 0.2f * RING_WIDTH * spread(),
+			 cosf(angle) * radius);
+      glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+      model = glm::rotate(model, glm::radians(180.0f) * spread(),
+			  glm::normalize(glm::vec3(0.2f * spread(), 1.0f,
+						   0.2f * spread())));
+      model = glm::scale(model, glm::vec3(1.5f + spread()));
+      models[i] = model * fit;
+    }
+
+  // every shuttle, drawn without culling
+  GLuint instanceBuffer;
+  glGenBuffers(1, &instanceBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), &models[0],
+	       GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // the visible ones, streamed every frame. The culler's worker threads
+  // are only started for --cull cpu
+  FrustumCuller* culler = NULL;
+  if (culling == CULL_CPU)
+    {
+      culler = new FrustumCuller(platform.threads());
+      for (unsigned int i = 0; i < count; i++)
+	culler->add(models[i], low, high);
+    }
+  StreamBuffer instanceStream(culling == CULL_CPU ? count * sizeof(glm::mat4)
+			      : sizeof(glm::mat4));
+
+  // or kept on the GPU, which also writes their count into the draws
+  // where the context can
+  GpuCuller gpuCuller;
+  if (culling == CULL_GPU || culling == CULL_HIZ)
+    {
+      for (unsigned int i = 0; i < count; i++)
+	gpuCuller.add(models[i], low, high);
+      gpuCuller.setCommands(shuttle.indirectCommands());
+    }
+
+  // with --cull hiz the shuttles are drawn into the pyramid's target,
+  // whose depth decides what is hidden in the next frame. It takes the
+  // framebuffer's size, which a HiDPI screen makes larger than the
+  // window's
+  if (culling == CULL_HIZ)
+    {
+      int width, height;
+      platform.framebufferSize(width, height);
+      pyramid = new DepthPyramid(width, height);
+    }
+  glm::mat4 lastViewProjection;
+  FragmentCounter fragments;
+
+  shader.use();
+  shader.setVec3("lightDirection",
+		 glm::normalize(glm::vec3(-0.3f, -1.0f, -0.5f)));
+
+  CameraRecorder cameraRecorder(platform, camera);
+
+  std::cout << count << " shuttles of " << triangles << " triangles in "
+	    << shuttle.meshes.size() << " meshes" << std::endl;
+
+  // the first frame is left out of the throughput, it compiles and
+  // uploads
+  std::chrono::steady_clock::time_point firstFrame;
+  unsigned int timedFrames = 0;
+  unsigned long long drawn = 0;
+
+  while(platform.running())
+    {
+      float currentFrame = platform.time();
+      deltaTime = currentFrame - lastFrame;
+      lastFrame = currentFrame;
+
+      processInput(platform);
+      cameraRecorder.update();
+
+      if (culling == CULL_HIZ)
+	GlState::bindFramebuffer(GL_FRAMEBUFFER, pyramid->framebuffer());
+      glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      glm::mat4 view = camera.GetViewMatrix();
+      glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
+					      (float)SCR_WIDTH /
+					      (float)SCR_HEIGHT, 0.5f, 600.0f);
+      glm::mat4 viewProjection = projection * view;
+      Frustum frustum = Frustum::fromMatrix(viewProjection);
+      if (timedFrames == 0)
+	lastViewProjection = viewProjection;
+
+      // the cull and the draw are timed apart, so --bench compares the
+      // GPU time of both ways under gpu_scopes
+      if (culling == CULL_CPU)
+	{
+	  instanceStream.beginFrame();
+	  StreamBuffer::Range range;
+	  GLsizei visible;
+	  {
+	    GPU_SCOPE("cull");
+	    visible = culler->cull(frustum, instanceStream, range);
+	    instanceStream.commit();
+	  }
+	  GPU_SCOPE("shuttles");
+	  shader.use();
+	  shader.setMat4("view", view);
+	  shader.setMat4("projection", projection);
+	  fragments.begin();
+	  shuttle.DrawInstanced(shader, instanceStream.buffer(), visible,
+				range.offset);
+	  fragments.end();
+	  instanceStream.endFrame();
+	  drawn += visible;
+	}
+      else if (culling == CULL_GPU)
+	{
+	  {
+	    GPU_SCOPE("cull");
+	    gpuCuller.cull(frustum);
+	  }
+	  GPU_SCOPE("shuttles");
+	  shader.use();
+	  shader.setMat4("view", view);
+	  shader.setMat4("projection", projection);
+	  fragments.begin();
+	  if (GpuCuller::indirect())
+	    shuttle.DrawInstancedIndirect(shader, gpuCuller.buffer(),
+					  gpuCuller.commandBuffer());
+	  else
+	    shuttle.DrawInstanced(shader, gpuCuller.buffer(),
+				  gpuCuller.count());
+	  fragments.end();
+	}
+      else if (culling == CULL_HIZ)
+	{
+	  // the shuttles in front of the last frame's depth first, then
+	  // those it hid that this frame's depth so far does not
+	  {
+	    GPU_SCOPE("cull");
+	    gpuCuller.cull(frustum, *pyramid, lastViewProjection);
+	  }
+	  {
+	    GPU_SCOPE("shuttles");
+	    shader.use();
+	    shader.setMat4("view", view);
+	    shader.setMat4("projection", projection);
+	    fragments.begin();
+	    if (GpuCuller::indirect())
+	      shuttle.DrawInstancedIndirect(shader, gpuCuller.buffer(),
+					    gpuCuller.commandBuffer());
+	    else
+	      shuttle.DrawInstanced(shader, gpuCuller.buffer(),
+				    gpuCuller.count());
+	    fragments.end();
+	  }
+	  {
+	    GPU_SCOPE("occlusion");
+	    pyramid->build();
+	    gpuCuller.cullOccluded(*pyramid, viewProjection);
+	  }
+	  GPU_SCOPE("revealed");
+	  shader.use();
+	  fragments.begin();
+	  if (GpuCuller::indirect())
+	    shuttle.DrawInstancedIndirect(shader,
+					  gpuCuller.buffer(GpuCuller::REVEALED),
+					  gpuCuller.commandBuffer
+					  (GpuCuller::REVEALED));
+	  else
+	    shuttle.DrawInstanced(shader, gpuCuller.buffer(GpuCuller::REVEALED),
+				  gpuCuller.count(GpuCuller::REVEALED));
+	  fragments.end();
+	}
+      else
+	{
+	  GPU_SCOPE("shuttles");
+	  shader.use();
+	  shader.setMat4("view", view);
+	  shader.setMat4("projection", projection);
+	  fragments.begin();
+	  shuttle.DrawInstanced(shader, instanceBuffer, count);
+	  fragments.end();
+	  drawn += count;
+	}
+
+      if (culling == CULL_HIZ)
+	pyramid->present(platform.framebuffer());
+      lastViewProjection = viewProjection;
+      fragments.nextFrame();
+
+      platform.endFrame();
+      if (timedFrames++ == 0)
+	firstFrame = std::chrono::steady_clock::now();
+    }
+
+  if (timedFrames > 1)
+    {
+      double ms = std::chrono::duration<double, std::milli>
+	(std::chrono::steady_clock::now() - firstFrame).count() /
+	(timedFrames - 1);
+      std::ostringstream json;
+      // the GPU culler's count stays on the GPU, it reports its own
+      bool onGpu = culling == CULL_GPU || culling == CULL_HIZ;
+      json << "{\"culling\": \"" << CULLING_NAMES[culling]
+	   << "\", \"instances\": " << count;
+      if (!onGpu)
+	json << ", \"drawn\": " << drawn / timedFrames;
+      json
+	   << ", \"triangles_per_instance\": " << triangles
+	   << ", \"draws_per_frame\": "
+	   << shuttle.meshes.size() * (culling == CULL_HIZ ? 2 : 1);
+      // the mesh draws of the hidden shuttles, had they been drawn
+      if (culling == CULL_HIZ)
+	json << ", \"mesh_draws_saved\": "
+	     << gpuCuller.occluded() * shuttle.meshes.size();
+      if (FragmentCounter::available())
+	json << ", \"fragments\": " << fragments.perFrame();
+      json
+	   << ", \"frame_ms\": " << ms
+	   << ", \"instances_per_ms\": " << count / ms
+	   << ", \"triangles_per_ms\": " << (double)count * triangles / ms
+	   << "}";
+      std::cout << "shuttle field: " << ms << " ms per frame, "
+		<< count / ms << " instances per ms" << std::endl;
+      platform.report("shuttle_field", json.str());
+      if (culling == CULL_CPU)
+	platform.report("frustum_culling", culler->json());
+      else if (onGpu)
+	platform.report("frustum_culling", gpuCuller.json());
+    }
+
+  glDeleteBuffers(1, &instanceBuffer);
+  instanceStream.destroy();
+  gpuCuller.destroy();
+  delete culler;
+  delete pyramid;
+  fragments.destroy();
+  platform.terminate();
+
+  return 0;
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+  GlState::viewport(0, 0, width, height);
+  // a minimized window has no pixels to draw
+  if (pyramid != NULL && width > 0 && height > 0)
+    pyramid->resize(width, height);
+}
+
+void processInput(Platform &platform)
+{
+  if (platform.keyPressed(GLFW_KEY_ESCAPE))
+    {
+      platform.close();
+    }
+
+  // the ring is large, the camera crosses it quickly
+  float step = 10.0f * deltaTime;
+  if (platform.keyPressed(GLFW_KEY_W))
+    {
+      camera.ProcessKeyboard(FORWARD, step);
+    }
+  if (platform.keyPressed(GLFW_KEY_S))
+    {
+      camera.ProcessKeyboard(BACKWARD, step);
+    }
+  if (platform.keyPressed(GLFW_KEY_A))
+    {
+      camera.ProcessKeyboard(LEFT, step);
+    }
+  if (platform.keyPressed(GLFW_KEY_D))
+    {
+      camera.ProcessKeyboard(RIGHT, step);
+    }
+}
+
+// glfw: whenever the mouse mves, this callback is called
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+  if (firstMouse)
+    {
+      lastX = xpos;
+      lastY = ypos;
+      firstMouse = false;
+    }
+
+  float xoffset = xpos - lastX;
+  float yoffset = lastY - ypos; // reversed since y-coord go from bottom to top
+  lastX = xpos;
+  lastY = ypos;
+
+  camera.ProcessMouseMovement(xoffset, yoffset);
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+  camera.ProcessMouseScroll(yoffset);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Normal;
+flat in vec3 Tint;
+
+uniform vec3 lightDirection;
+
+void main()
+{
+  float diffuse = max(dot(normalize(Normal), -lightDirection), 0.0);
+  FragColor = vec4(Tint * (0.25 + 0.75 * diffuse), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 5) in mat4 aInstanceModel;
+
+out vec3 Normal;
+flat out vec3 Tint;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+  // the instance matrices scale uniformly, so they turn normals too
+  Normal = mat3(aInstanceModel) * aNormal;
+  // a shade per instance, so neighbours can be told apart. It comes
+  // from where the instance is rather than gl_InstanceID, which changes
+  // with every instance culled before it
+  uvec3 bits = floatBitsToUint(aInstanceModel[3].xyz);
+  uint hash = (bits.x ^ (bits.y * 16777619u) ^ (bits.z * 2166136261u)) *
+    2654435761u;
+  Tint = vec3(0.6) + 0.4 * vec3(float(hash >> 24u), float((hash >> 16u) & 255u),
+                                float((hash >> 8u) & 255u)) / 255.0;
+  gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+// per-object transforms computed once per frame on the CPU by
+// TransformBuffer and bound to binding point 2, so the vertex stage
+// never has to invert the model matrix
+layout (std140) uniform Transform
+{
+  mat4 model;
+  mat4 modelViewProjection;
+  mat3 normalMatrix;
+};